@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+
+#include <algorithm>
+#include <limits>
+
+struct AdaptiveRateOptions {
+	double initial_hz = 10.0;
+	double min_hz = 5.0;
+	double max_hz = 60.0;
+	double initial_step_hz = 5.0;
+	double min_step_hz = 0.5; // converged once the search step is smaller than this
+	double backoff = 0.8; // rate multiplier when a miss happens before anything sustainable is known
+	double max_latency_fraction = 0.5; // a block whose p99 flush latency exceeds this fraction of the period counts as a miss
+};
+
+// Closed-loop symbol rate search driven by flush completion.
+// The rate goes up while blocks complete cleanly and backs off when deadlines are missed, halving the step every
+// time it overshoots, so it converges on the highest rate this machine and iCUE can currently sustain.
+// A miss at a rate that was previously sustainable (e.g. iCUE got busier) restarts the search from a lower rate.
+class AdaptiveRateController {
+	AdaptiveRateOptions m_options;
+	double m_rate_hz;
+	double m_step_hz;
+	double m_best_clean_hz = 0.0; // 0 if nothing sustainable is known
+	double m_lowest_failing_hz = std::numeric_limits<double>::infinity();
+	bool m_converged = false;
+
+public:
+	explicit AdaptiveRateController(const AdaptiveRateOptions& options = {})
+		: m_options(options), m_rate_hz(std::clamp(options.initial_hz, options.min_hz, options.max_hz)), m_step_hz(options.initial_step_hz)
+	{
+	}
+
+	double getRate() const { return m_rate_hz; }
+
+	bool isConverged() const { return m_converged; }
+
+	// missed_ticks: ticks that arrived while the previous flush was still in flight, plus scheduler overruns
+	void onBlockFinished(uint64_t missed_ticks, uint64_t flush_latency_p99_ns)
+	{
+		const double period_ns = 1'000'000'000.0 / m_rate_hz;
+		const bool miss = missed_ticks > 0 || static_cast<double>(flush_latency_p99_ns) > period_ns * m_options.max_latency_fraction;
+
+		if (!miss) {
+			m_best_clean_hz = m_rate_hz;
+			if (m_converged) {
+				return;
+			}
+			if (m_rate_hz >= m_options.max_hz) {
+				m_converged = true;
+				return;
+			}
+			while (m_rate_hz + m_step_hz >= m_lowest_failing_hz && m_step_hz >= m_options.min_step_hz) {
+				m_step_hz *= 0.5;
+			}
+			if (m_step_hz < m_options.min_step_hz) {
+				m_converged = true;
+				return;
+			}
+			m_rate_hz = std::min(m_rate_hz + m_step_hz, m_options.max_hz);
+			return;
+		}
+
+		if (m_converged || m_rate_hz <= m_best_clean_hz) {
+			// a rate that used to be fine isn't any more, conditions changed so search again
+			m_converged = false;
+			m_step_hz = m_options.initial_step_hz;
+			m_best_clean_hz = 0.0;
+			m_lowest_failing_hz = std::numeric_limits<double>::infinity();
+		}
+		m_lowest_failing_hz = std::min(m_lowest_failing_hz, m_rate_hz);
+		m_step_hz *= 0.5;
+		if (m_best_clean_hz > 0.0 && m_best_clean_hz < m_rate_hz) {
+			m_rate_hz = m_best_clean_hz;
+		}
+		else {
+			m_rate_hz = std::max(m_options.min_hz, m_rate_hz * m_options.backoff);
+		}
+		if (m_step_hz < m_options.min_step_hz && m_best_clean_hz > 0.0) {
+			m_converged = true;
+		}
+	}
+};
\ No newline at end of file
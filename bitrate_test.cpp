@@ -2,6 +2,7 @@
 
 #include <cmath>
 
+#include <algorithm>
 #include <chrono>
 #include <numbers>
 #include <thread>
@@ -9,9 +10,15 @@
 #include <array>
 #include <random>
 
-#include "fixed_update_loop.h"
+#include "adaptive_rate.h"
+#include "constellation.h"
+#include "convolutional_code.h"
+#include "differential_modulation.h"
+#include "frame_pipeline.h"
+#include "line_code.h"
 #include "set_colors.h"
 #include "my_print.h"
+#include "transmission_plan.h"
 #include <unordered_map>
 
 static std::vector<bool> getPRBS7(int num_bits, uint32_t seed)
@@ -29,158 +36,74 @@ static std::vector<bool> getPRBS7(int num_bits, uint32_t seed)
 	return out;
 }
 
-static auto getKeysOrdered(const Leds& leds)
+static std::vector<bool> encodeBits(const ConvolutionalCode& code, const std::vector<bool>& bits)
 {
-	// generate LUT to get keys in order
-	std::array<std::vector<int>, 6> rows{};
-	for (int i = 0; i < leds.getCount(); ++i) {
-		auto pos = leds.getAllLedPositions()[i];
-		if (pos.cy < 34.3) {
-			// There are 112 LEDs, top 3 shouldn't be added
-			continue;
-		}
-		if (pos.cy > 34.3 && pos.cy <= 38.6) {
-			rows[0].push_back(i);
-			continue;
-		}
-		if (pos.cy > 38.6 && pos.cy <= 59.5) {
-			rows[1].push_back(i);
-			continue;
-		}
-		if (pos.cy > 59.5 && pos.cy <= 78.5) {
-			rows[2].push_back(i);
-			continue;
-		}
-		if (pos.cy > 78.5 && pos.cy <= 97.6) {
-			rows[3].push_back(i);
-			continue;
-		}
-		if (pos.cy > 97.6 && pos.cy <= 116.1) {
-			rows[4].push_back(i);
-			continue;
-		}
-		if (pos.cy > 116.1 && pos.cy <= 135.6) {
-			rows[5].push_back(i);
-			continue;
-		}
-		throw std::runtime_error("Key didn't match?");
-	}
-	for (int i = 0; i < rows.size(); ++i) {
-		std::sort(rows[i].begin(), rows[i].end(), [&](int first, int second) ->bool {
-			// returns true if first is less than second
-			double x1 = leds.getAllLedPositions()[first].cx;
-			double x2 = leds.getAllLedPositions()[second].cx;
-			return x1 < x2;
-			});
-	}
-	std::vector<int> keys_ordered;
-	for (const auto& row : rows) {
-		for (int key_index : row) {
-			keys_ordered.push_back(key_index);
-		}
-	}
-
-	//keys_ordered.erase(keys_ordered.begin() + 16);
-	//keys_ordered.erase(keys_ordered.begin() + 16);
-	//keys_ordered.erase(keys_ordered.begin() + 16);
-	//keys_ordered.erase(keys_ordered.begin() + 16);
+	const std::vector<uint8_t> encoded = convolutionalEncode(code, std::vector<uint8_t>(bits.begin(), bits.end()));
+	return std::vector<bool>(encoded.begin(), encoded.end());
+}
 
-	return keys_ordered;
+static std::vector<bool> lineEncodeBits(LineCode line_code, const std::vector<bool>& bits)
+{
+	std::vector<uint8_t> encoded{};
+	LineEncoder encoder(line_code);
+	encoder.encode(std::vector<uint8_t>(bits.begin(), bits.end()), encoded);
+	encoder.flush(encoded);
+	return std::vector<bool>(encoded.begin(), encoded.end());
 }
 
-void bitrateTest(const CorsairDeviceId* device_id, Leds& leds)
+void bitrateTest(const CorsairDeviceId* device_id, Leds& leds, const ConvolutionalCode* code, LineCode line_code)
 {
 	constexpr int num_bits = 50; // per frequency test
 	constexpr std::array FREQUENCIES{ 10, 15, 20, 25, 30 };
 
-	// generate LUT to get keys in order
-	std::array<std::vector<int>, 6> rows{};
-	for (int i = 0; i < leds.getCount(); ++i) {
-		auto pos = leds.getAllLedPositions()[i];
-		if (pos.cy < 34.3) {
-			// There are 112 LEDs, top 3 shouldn't be added
-			continue;
-		}
-		if (pos.cy > 34.3 && pos.cy <= 38.6) {
-			rows[0].push_back(i);
-			continue;
-		}
-		if (pos.cy > 38.6 && pos.cy <= 59.5) {
-			rows[1].push_back(i);
-			continue;
-		}
-		if (pos.cy > 59.5 && pos.cy <= 78.5) {
-			rows[2].push_back(i);
-			continue;
-		}
-		if (pos.cy > 78.5 && pos.cy <= 97.6) {
-			rows[3].push_back(i);
-			continue;
-		}
-		if (pos.cy > 97.6 && pos.cy <= 116.1) {
-			rows[4].push_back(i);
-			continue;
-		}
-		if (pos.cy > 116.1 && pos.cy <= 135.6) {
-			rows[5].push_back(i);
-			continue;
-		}
-		throw std::runtime_error("Key didn't match?");
-	}
-	for (int i = 0; i < rows.size(); ++i) {
-		std::sort(rows[i].begin(), rows[i].end(), [&](int first, int second) ->bool {
-			// returns true if first is less than second
-			double x1 = leds.getAllLedPositions()[first].cx;
-			double x2 = leds.getAllLedPositions()[second].cx;
-			return x1 < x2;
-			});
-	}
-	std::vector<int> keys_ordered;
-	for (const auto& row : rows) {
-		for (int key_index : row) {
-			keys_ordered.push_back(key_index);
-		}
-	}
+	const auto keys_ordered = leds.getLayout().getOrderedKeys();
 
+	// with a code, num_bits payload bits per key are encoded and the frame count grows by 1 / rate,
+	// the line code goes on last so its run length limit holds for what is actually shown
 	std::vector<std::vector<bool>> bits_for_keys{};
 	for (int i = 0; i < keys_ordered.size(); ++i) {
-		bits_for_keys.push_back(getPRBS7(num_bits, i));
+		bits_for_keys.push_back(lineEncodeBits(line_code, code ? encodeBits(*code, getPRBS7(num_bits, i)) : getPRBS7(num_bits, i)));
 	}
+	const int num_frames = static_cast<int>(bits_for_keys[0].size());
+
+	// the same bits are sent at every frequency
+	const TransmissionPlan plan = TransmissionPlan::compile(leds, num_frames, [&](int iteration) {
+		leds.setAll(0, 0, 0);
+		for (int i = 0; i < keys_ordered.size(); ++i) {
+			uint8_t val = bits_for_keys[i][iteration] ? 255 : 0;
+			leds.setLed(keys_ordered[i], 0, val, 0);
+		}
+		});
 
 	myPrint("Showing green...");
 	leds.setAll(0, 255, 0);
 	setColors(device_id, leds);
-	waitForColors();
+	waitForColors(leds);
 	std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
 	myPrint("Showing black...");
 	leds.setAll(0, 0, 0);
 	setColors(device_id, leds);
-	waitForColors();
+	waitForColors(leds);
 	std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
 	for (const auto frequency : FREQUENCIES) {
 		myPrint("Starting {} Hz...", frequency);
 		leds.setAll(255, 0, 0);
 		setColors(device_id, leds);
-		waitForColors();
+		waitForColors(leds);
 		std::this_thread::sleep_for(std::chrono::seconds(1));
-		startFixedUpdateLoop(num_bits, static_cast<int64_t>(1'000'000.0 / frequency), [&](int iteration) {
-			leds.setAll(0, 0, 0);
-			for (int i = 0; i < keys_ordered.size(); ++i) {
-				uint8_t val = bits_for_keys[i][iteration] ? 255 : 0;
-				leds.setLed(keys_ordered[i], 0, val, 0);
-			}
-			waitForColors();
-			setColors(device_id, leds);
-			});
-		waitForColors();
+		playTransmissionPlan(device_id, leds, plan, static_cast<int64_t>(1'000'000.0 / frequency));
 	}
 
+	if (line_code != LineCode::None) {
+		const std::vector<double> symbol_rates(FREQUENCIES.begin(), FREQUENCIES.end());
+		reportLineCodeGoodput(symbol_rates, static_cast<uint32_t>(keys_ordered.size()), code ? code->getRate() : 1.0);
+	}
 
 	leds.setAll(0, 0, 255);
 	setColors(device_id, leds);
-	waitForColors();
+	waitForColors(leds);
 	std::this_thread::sleep_for(std::chrono::seconds(1));
 }
 
@@ -195,34 +118,31 @@ void bitrateTestFreqSweep(const CorsairDeviceId* device_id, Leds& leds)
 	myPrint("Showing green...");
 	leds.setAll(0, 255, 0);
 	setColors(device_id, leds);
-	waitForColors();
+	waitForColors(leds);
 	std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
 	myPrint("Showing black...");
 	leds.setAll(0, 0, 0);
 	setColors(device_id, leds);
-	waitForColors();
+	waitForColors(leds);
 	std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
 	for (const auto frequency : FREQUENCIES) {
 		myPrint("Starting {} Hz...", frequency);
 		leds.setAll(255, 0, 0);
 		setColors(device_id, leds);
-		waitForColors();
+		waitForColors(leds);
 		std::this_thread::sleep_for(std::chrono::seconds(1));
-		startFixedUpdateLoop(NUM_BITS, static_cast<int64_t>(1'000'000.0 / frequency), [&](int iteration) {
+		startFramePipeline(device_id, leds, NUM_BITS, static_cast<int64_t>(1'000'000.0 / frequency), [&](int iteration) {
 			uint8_t val = bits[iteration] ? 255 : 0;
 			leds.setAll(0, val, 0);
-			waitForColors();
-			setColors(device_id, leds);
 			});
-		waitForColors();
 	}
 
 
 	leds.setAll(0, 0, 255);
 	setColors(device_id, leds);
-	waitForColors();
+	waitForColors(leds);
 	std::this_thread::sleep_for(std::chrono::seconds(1));
 }
 
@@ -242,13 +162,14 @@ static std::vector<std::vector<int>> divideLedsIntoCells(const Leds& leds, float
 	int num_cells_y = static_cast<int>(std::ceil((max_y - min_y) / cellRadius));
 
 	// Loop over the grid
+	LedIndexList ledIndices{};
 	for (int y = 0; y < num_cells_y; ++y) {
 		for (int x = 0; x < num_cells_x; ++x) {
 			float left = min_x + x * cellRadius;
 			float top = min_y + y * cellRadius;
 
 			// Get all LEDs in this "cell rectangle"
-			std::vector<uint32_t> ledIndices = leds.getLedsInBounds(left, top, cellRadius, cellRadius);
+			leds.getLedsInBounds(left, top, cellRadius, cellRadius, ledIndices);
 
 			// Only add cells that contain at least one LED
 			if (!ledIndices.empty()) {
@@ -275,16 +196,16 @@ void bitrateTestCellSize(const CorsairDeviceId* device_id, Leds& leds)
 	myPrint("Showing green...");
 	leds.setAll(0, 255, 0);
 	setColors(device_id, leds);
-	waitForColors();
+	waitForColors(leds);
 	std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
 	myPrint("Showing black...");
 	leds.setAll(0, 0, 0);
 	setColors(device_id, leds);
-	waitForColors();
+	waitForColors(leds);
 	std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
-	auto ordered = getKeysOrdered(leds);
+	const auto ordered = leds.getLayout().getOrderedKeys();
 
 	std::unordered_map<int, int> syskey_to_ordered_index;
 	for (int i = 0; i < ordered.size(); ++i) {
@@ -295,7 +216,7 @@ void bitrateTestCellSize(const CorsairDeviceId* device_id, Leds& leds)
 		myPrint("Cell radius {}...", radius);
 		leds.setAll(255, 0, 0);
 		setColors(device_id, leds);
-		waitForColors();
+		waitForColors(leds);
 		std::this_thread::sleep_for(std::chrono::seconds(1));
 
 		auto cells = divideLedsIntoCells(leds, radius);
@@ -316,7 +237,7 @@ void bitrateTestCellSize(const CorsairDeviceId* device_id, Leds& leds)
 
 		continue;
 
-		startFixedUpdateLoop(NUM_BITS, static_cast<int64_t>(1'000'000.0 / FREQUENCY), [&](int iteration) {
+		startFramePipeline(device_id, leds, NUM_BITS, static_cast<int64_t>(1'000'000.0 / FREQUENCY), [&](int iteration) {
 			leds.setAll(0, 0, 0);
 			for (int cell_index = 0; cell_index < cells.size(); ++cell_index) {
 				for (const auto led_index : cells[cell_index]) {
@@ -324,98 +245,250 @@ void bitrateTestCellSize(const CorsairDeviceId* device_id, Leds& leds)
 					leds.setLed(led_index, 0, val, 0);
 				}
 			}
-			waitForColors();
-			setColors(device_id, leds);
 			});
-		waitForColors();
 	}
 
 
 	leds.setAll(0, 0, 255);
 	setColors(device_id, leds);
-	waitForColors();
+	waitForColors(leds);
 	std::this_thread::sleep_for(std::chrono::seconds(1));
 }
 
-void bitrateTestColors(const CorsairDeviceId* device_id, Leds& leds)
+void bitrateTestColors(const CorsairDeviceId* device_id, Leds& leds, const ConvolutionalCode* code)
 {
 	constexpr int NUM_STATES_BITS = 4;
 	constexpr int NUM_STATES = 1 << NUM_STATES_BITS;
-	constexpr int ITERS = 100;
-	constexpr int BITSTREAM_LENGTH = ITERS * NUM_STATES_BITS;
+	constexpr int PAYLOAD_LENGTH = 100 * NUM_STATES_BITS;
 	constexpr double FREQUENCY = 10.0;
 
+	// with a code the symbols carry the encoded stream, padded with zeros to whole symbols
+	auto bitstream = code ? encodeBits(*code, getPRBS7(PAYLOAD_LENGTH, 0)) : getPRBS7(PAYLOAD_LENGTH, 0);
+	const int iters = static_cast<int>((bitstream.size() + NUM_STATES_BITS - 1) / NUM_STATES_BITS);
+	bitstream.resize(static_cast<size_t>(iters) * NUM_STATES_BITS);
+
+	const TransmissionPlan calibration_plan = TransmissionPlan::compile(leds, NUM_STATES, [&](int iteration) {
+		uint32_t value = iteration;
+		// Scale to 0255
+		// max possible value for num_bits is (2^num_bits - 1)
+		uint32_t max_value = NUM_STATES - 1;
+
+		// Scale value to 0255
+		uint8_t scaled = static_cast<uint8_t>(std::round((value * 255.0) / max_value));
+		leds.setAll(0, scaled, 0);
+		});
+
+	auto it = bitstream.begin();
+	const TransmissionPlan data_plan = TransmissionPlan::compile(leds, iters, [&](int) {
+		uint32_t value = 0;
+		for (int i = 0; i < NUM_STATES_BITS; ++i) {
+			value <<= 1;
+			value |= ((*it) ? 1 : 0);
+			++it;
+		}
+
+		// Scale to 0255
+		// max possible value for num_bits is (2^num_bits - 1)
+		uint32_t max_value = NUM_STATES - 1;
+
+		// Scale value to 0255
+		uint8_t scaled = static_cast<uint8_t>(std::round((value * 255.0) / max_value));
+		leds.setAll(0, scaled, 0);
+		});
+
 	const auto start_time = std::chrono::high_resolution_clock::now();
 
 	myPrint("Showing colour...");
 	leds.setAll(0, 255, 0);
 	setColors(device_id, leds);
-	waitForColors();
+	waitForColors(leds);
 	std::this_thread::sleep_for(std::chrono::milliseconds(250));
 
 	myPrint("Showing black...");
 	leds.setAll(0, 0, 0);
 	setColors(device_id, leds);
-	waitForColors();
+	waitForColors(leds);
 	std::this_thread::sleep_for(std::chrono::milliseconds(250));
 
 	myPrint("showing calibration sequence for {} states", NUM_STATES);
 	leds.setAll(255, 255, 255);
 	setColors(device_id, leds);
-	waitForColors();
+	waitForColors(leds);
 	std::this_thread::sleep_for(std::chrono::milliseconds(250));
 
-	startFixedUpdateLoop(NUM_STATES, static_cast<int64_t>(1'000'000.0 / FREQUENCY), [&](int iteration) {
-		uint32_t value = iteration;
-		// Scale to 0255
-		// max possible value for num_bits is (2^num_bits - 1)
-		uint32_t max_value = NUM_STATES - 1;
-
-		// Scale value to 0255
-		uint8_t scaled = static_cast<uint8_t>(std::round((value * 255.0) / max_value));
-		leds.setAll(0, scaled, 0);
-		waitForColors();
-		setColors(device_id, leds);
-		});
-	waitForColors();
+	playTransmissionPlan(device_id, leds, calibration_plan, static_cast<int64_t>(1'000'000.0 / FREQUENCY));
 
 	myPrint("Done calibrating. Transmitting...");
 
 	leds.setAll(255, 255, 255);
 	setColors(device_id, leds);
-	waitForColors();
+	waitForColors(leds);
 	std::this_thread::sleep_for(std::chrono::seconds(1));
 
-	const auto bitstream = getPRBS7(BITSTREAM_LENGTH, 0);
+	playTransmissionPlan(device_id, leds, data_plan, static_cast<int64_t>(1'000'000.0 / FREQUENCY));
 
-	auto it = bitstream.begin();
-	startFixedUpdateLoop(ITERS, static_cast<int64_t>(1'000'000.0 / FREQUENCY), [&](int iteration) {
-		uint32_t value = 0;
-		for (int i = 0; i < NUM_STATES_BITS; ++i) {
-			value |= ((*it) ? 1 : 0);
-			value <<= 1;
-			++it;
+	const auto elapsed = std::chrono::high_resolution_clock::now() - start_time;
+
+	myPrint("Took: {}", elapsed);
+
+
+	leds.setAll(0, 0, 255);
+	setColors(device_id, leds);
+	waitForColors(leds);
+	std::this_thread::sleep_for(std::chrono::seconds(1));
+}
+
+void bitrateTestDifferential(const CorsairDeviceId* device_id, Leds& leds, uint32_t bits_per_symbol)
+{
+	constexpr int NUM_SYMBOLS = 600; // per key, long enough for the room and camera to drift
+	constexpr double FREQUENCY = 10.0;
+
+	const auto keys = leds.getLayout().getDataKeys();
+
+	std::vector<std::vector<uint8_t>> frames_for_keys{};
+	for (int i = 0; i < keys.size(); ++i) {
+		const auto bits = getPRBS7(NUM_SYMBOLS * bits_per_symbol, i);
+		frames_for_keys.push_back(DifferentialModulator(bits_per_symbol).modulate(std::vector<uint8_t>(bits.begin(), bits.end())));
+	}
+	const int num_frames = static_cast<int>(frames_for_keys[0].size());
+
+	const TransmissionPlan plan = TransmissionPlan::compile(leds, num_frames, [&](int iteration) {
+		leds.setAll(0, 0, 0);
+		for (int i = 0; i < keys.size(); ++i) {
+			leds.setLed(keys[i], 0, frames_for_keys[i][iteration], 0);
 		}
+		});
 
-		// Scale to 0255
-		// max possible value for num_bits is (2^num_bits - 1)
-		uint32_t max_value = NUM_STATES - 1;
+	myPrint("Showing black...");
+	leds.setAll(0, 0, 0);
+	setColors(device_id, leds);
+	waitForColors(leds);
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
-		// Scale value to 0255
-		uint8_t scaled = static_cast<uint8_t>(std::round((value * 255.0) / max_value));
-		leds.setAll(0, scaled, 0);
-		waitForColors();
-		setColors(device_id, leds);
+	myPrint("Transmitting {} differential symbols of {} bits per key at {} Hz, no calibration needed...", NUM_SYMBOLS, bits_per_symbol, FREQUENCY);
+	playTransmissionPlan(device_id, leds, plan, static_cast<int64_t>(1'000'000.0 / FREQUENCY));
+
+	leds.setAll(0, 0, 0);
+	setColors(device_id, leds);
+	waitForColors(leds);
+}
+
+void bitrateTestConstellation(const CorsairDeviceId* device_id, Leds& leds, const Constellation& constellation)
+{
+	constexpr int NUM_SYMBOLS = 100; // per key
+	constexpr double FREQUENCY = 10.0;
+
+	const auto keys = leds.getLayout().getDataKeys();
+	const uint32_t bits_per_symbol = constellation.getBitsPerSymbol();
+	constellation.report();
+
+	// every symbol once on every key, so the receiver can measure where each label really lands
+	const TransmissionPlan reference_plan = TransmissionPlan::compile(leds, static_cast<int>(constellation.getSize()), [&](int iteration) {
+		const DriveColor& color = constellation.modulate(static_cast<uint32_t>(iteration));
+		leds.setAll(color[0], color[1], color[2]);
 		});
-	waitForColors();
 
-	const auto elapsed = std::chrono::high_resolution_clock::now() - start_time;
+	std::vector<std::vector<bool>> bits_for_keys{};
+	for (int i = 0; i < keys.size(); ++i) {
+		bits_for_keys.push_back(getPRBS7(NUM_SYMBOLS * bits_per_symbol, i));
+	}
+	const TransmissionPlan data_plan = TransmissionPlan::compile(leds, NUM_SYMBOLS, [&](int iteration) {
+		leds.setAll(0, 0, 0);
+		for (int i = 0; i < keys.size(); ++i) {
+			uint32_t label = 0;
+			for (uint32_t b = 0; b < bits_per_symbol; ++b) {
+				label = (label << 1) | (bits_for_keys[i][iteration * bits_per_symbol + b] ? 1 : 0);
+			}
+			const DriveColor& color = constellation.modulate(label);
+			leds.setLed(keys[i], color[0], color[1], color[2]);
+		}
+		});
 
-	myPrint("Took: {}", elapsed);
+	myPrint("Showing black...");
+	leds.setAll(0, 0, 0);
+	setColors(device_id, leds);
+	waitForColors(leds);
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+	myPrint("Showing {} reference symbols...", constellation.getSize());
+	playTransmissionPlan(device_id, leds, reference_plan, static_cast<int64_t>(1'000'000.0 / FREQUENCY));
+
+	leds.setAll(0, 0, 0);
+	setColors(device_id, leds);
+	waitForColors(leds);
+	std::this_thread::sleep_for(std::chrono::seconds(1));
+
+	myPrint("Transmitting {} bits per key per symbol at {} Hz...", bits_per_symbol, FREQUENCY);
+	playTransmissionPlan(device_id, leds, data_plan, static_cast<int64_t>(1'000'000.0 / FREQUENCY));
+
+	leds.setAll(0, 0, 0);
+	setColors(device_id, leds);
+	waitForColors(leds);
+}
+
+void bitrateTestAdaptive(const CorsairDeviceId* device_id, Leds& leds)
+{
+	constexpr int SYMBOLS_PER_BLOCK = 40;
+	constexpr int NUM_BLOCKS = 30;
+	// Every block starts with a rate announcement held long enough for a receiver to catch it at any rate:
+	// red on every key, with the block's symbol rate in centihertz as 16 bits (MSB first) on the green channel of the first 16 ordered keys
+	constexpr int RATE_ANNOUNCE_BITS = 16;
+	constexpr auto RATE_ANNOUNCE_HOLD = std::chrono::milliseconds(250);
+
+	const auto keys_ordered = leds.getLayout().getOrderedKeys();
+	assert(keys_ordered.size() >= RATE_ANNOUNCE_BITS);
+
+	AdaptiveRateController controller{};
+	const uint32_t max_outstanding = leds.getFlushTracker().getMaxOutstanding();
+	myPrint("Up to {} flushes in flight (--max-outstanding)", max_outstanding);
+
+	myPrint("Showing green...");
+	leds.setAll(0, 255, 0);
+	setColors(device_id, leds);
+	waitForColors(leds);
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+	myPrint("Showing black...");
+	leds.setAll(0, 0, 0);
+	setColors(device_id, leds);
+	waitForColors(leds);
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+	for (int block = 0; block < NUM_BLOCKS; ++block) {
+		const double frequency = controller.getRate();
+		const auto centihertz = static_cast<uint16_t>(std::round(frequency * 100.0));
+		myPrint("Block {}: {} Hz{}", block, frequency, controller.isConverged() ? " (converged)" : "");
+
+		leds.setAll(255, 0, 0);
+		for (int i = 0; i < RATE_ANNOUNCE_BITS; ++i) {
+			const bool bit = (centihertz >> (RATE_ANNOUNCE_BITS - 1 - i)) & 1;
+			leds.setLed(keys_ordered[i], 255, bit ? 255 : 0, 0);
+		}
+		setColors(device_id, leds);
+		waitForColors(leds);
+		std::this_thread::sleep_for(RATE_ANNOUNCE_HOLD);
+
+		std::vector<std::vector<bool>> bits_for_keys{};
+		for (int i = 0; i < keys_ordered.size(); ++i) {
+			bits_for_keys.push_back(getPRBS7(SYMBOLS_PER_BLOCK, block * static_cast<uint32_t>(keys_ordered.size()) + i));
+		}
+
+		const auto loop_stats = startFramePipeline(device_id, leds, SYMBOLS_PER_BLOCK, static_cast<int64_t>(1'000'000.0 / frequency), [&](int iteration) {
+			leds.setAll(0, 0, 0);
+			for (int i = 0; i < keys_ordered.size(); ++i) {
+				uint8_t val = bits_for_keys[i][iteration] ? 255 : 0;
+				leds.setLed(keys_ordered[i], 0, val, 0);
+			}
+			});
+
+		const FlushTelemetry telemetry = leds.getFlushTracker().getTelemetry();
+		controller.onBlockFinished(telemetry.busy_ticks + static_cast<uint64_t>(loop_stats.overruns), telemetry.latency_p99_ns);
+	}
 
+	myPrint("Highest sustainable rate with up to {} flushes in flight: {} Hz{}", max_outstanding, controller.getRate(), controller.isConverged() ? "" : " (not converged)");
 
 	leds.setAll(0, 0, 255);
 	setColors(device_id, leds);
-	waitForColors();
+	waitForColors(leds);
 	std::this_thread::sleep_for(std::chrono::seconds(1));
 }
\ No newline at end of file
@@ -1,16 +1,36 @@
 #pragma once
 
+#include <cstdint>
+
 #include <filesystem>
 #include <vector>
 
 #include <iCUESDK/iCUESDK.h>
 
+#include "constellation.h"
+#include "convolutional_code.h"
+#include "line_code.h"
 #include "leds.h"
 
-void bitrateTest(const CorsairDeviceId* device_id, Leds& leds);
+// With a code every key's bits are convolutionally encoded, decode captures with ViterbiDecoder and softBitFromLevel().
+// With a line code each key's stream is line coded last (see LineEncoder), decode it with a LineDecoder per key first.
+void bitrateTest(const CorsairDeviceId* device_id, Leds& leds, const ConvolutionalCode* code = nullptr, LineCode line_code = LineCode::None);
 
 void bitrateTestFreqSweep(const CorsairDeviceId* device_id, Leds& leds);
 
 void bitrateTestCellSize(const CorsairDeviceId* device_id, Leds& leds);
 
-void bitrateTestColors(const CorsairDeviceId* device_id, Leds& leds);
\ No newline at end of file
+// 4 bits per symbol on the green channel, MSB first. With a code, decode captures with ViterbiDecoder and pamSoftBits().
+void bitrateTestColors(const CorsairDeviceId* device_id, Leds& leds, const ConvolutionalCode* code = nullptr);
+
+// Differential levels (see DifferentialModulator) on the green channel of every data key, each key with its own PRBS stream.
+// Decode captures of each key with a DifferentialDemodulator, no calibration sequence is shown or needed.
+void bitrateTestDifferential(const CorsairDeviceId* device_id, Leds& leds, uint32_t bits_per_symbol = 2);
+
+// Color shift keying with a designed constellation on every data key, PRBS bits MSB first into each label.
+// The constellation's reference symbols are shown first, feed what the receiver measured for them to setReceivedColors()
+// before demodulating. The model it was designed with should describe the LEDs as driven through leds' transfer function.
+void bitrateTestConstellation(const CorsairDeviceId* device_id, Leds& leds, const Constellation& constellation);
+
+// Closed-loop version of bitrateTest() that searches for the highest symbol rate the flush path can sustain
+void bitrateTestAdaptive(const CorsairDeviceId* device_id, Leds& leds);
\ No newline at end of file
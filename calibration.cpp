@@ -2,15 +2,18 @@
 
 #include <cmath>
 
+#include <algorithm>
 #include <chrono>
 #include <numbers>
+#include <optional>
 #include <thread>
 
-#include <conio.h>
-
+#include "calibration_profile.h"
 #include "fixed_update_loop.h"
+#include "frame_pipeline.h"
 #include "set_colors.h"
 #include "my_print.h"
+#include "console.h"
 
 template <typename T>
 static constexpr T lerp(T a, T b, T t) {
@@ -74,19 +77,16 @@ void calibrationTransmit(const CorsairDeviceId* device_id, Leds& leds)
 
 	for (int awd = 0; awd < 4; ++awd) {
 
-		(void)_getch();
+		waitForKeyPress();
 
 		auto start = std::chrono::high_resolution_clock::now();
-		startFixedUpdateLoop(128, static_cast<int64_t>(1'000'000.0 / FREQUENCY), [&](int iteration) {
+		startFramePipeline(device_id, leds, 128, static_cast<int64_t>(1'000'000.0 / FREQUENCY), [&](int iteration) {
 			Color c = getColor((128 * awd) + iteration);
 			leds.setAll(c.r, c.g, c.b);
-			waitForColors();
-			setColors(device_id, leds);
 			});
-		waitForColors();
 		leds.setAll(255, 0, 0);
 		setColors(device_id, leds);
-		waitForColors();
+		waitForColors(leds);
 
 	}
 }
@@ -101,18 +101,78 @@ void calibrationTransmitForText(const CorsairDeviceId* device_id, Leds& leds)
 	std::this_thread::sleep_for(std::chrono::seconds(1));
 
 	auto start = std::chrono::high_resolution_clock::now();
-	startFixedUpdateLoop(iters, static_cast<int64_t>(1'000'000.0 / FREQUENCY), [&](int iteration) {
+	startFramePipeline(device_id, leds, iters, static_cast<int64_t>(1'000'000.0 / FREQUENCY), [&](int iteration) {
 		Color c{};
 		c.r = ((iteration >> 0) & 1) * 255;
 		c.g = ((iteration >> 1) & 1) * 255;
 		c.b = ((iteration >> 2) & 1) * 255;
 		leds.setAll(c.r, c.g, c.b);
-		waitForColors();
-		setColors(device_id, leds);
 		});
-	waitForColors();
 	//leds.setAll(255, 0, 0);
 	setColors(device_id, leds);
-	waitForColors();
+	waitForColors(leds);
 	std::this_thread::sleep_for(std::chrono::seconds(1));
+}
+
+void calibrationSweep(const CorsairDeviceId* device_id, Leds& leds)
+{
+	constexpr double FREQUENCY = 1.0; // levels per second
+	constexpr int NUM_LEVELS = static_cast<int>(CALIBRATION_SWEEP_LEVELS.size());
+
+	// the receiver has to see the raw response of every LED, whatever the caller had set comes back afterwards
+	const std::optional<TransferFunction> previous_transfer = leds.getTransferFunction() ? std::optional(*leds.getTransferFunction()) : std::nullopt;
+	const std::optional<CalibrationProfile> previous_calibration = leds.getCalibration() ? std::optional(*leds.getCalibration()) : std::nullopt;
+	leds.clearTransferFunction();
+	leds.clearCalibration();
+
+	myPrint("Sweeping {} levels of R, G and B at {} Hz", NUM_LEVELS, FREQUENCY);
+	waitForKeyPress();
+
+	// one level submitted per tick, so each label is printed as its level goes to the keyboard
+	FlushTracker& tracker = leds.getFlushTracker();
+	startFixedUpdateLoop(3 * NUM_LEVELS, static_cast<int64_t>(1'000'000.0 / FREQUENCY), [&](int iteration) {
+		const int channel = iteration / NUM_LEVELS;
+		const uint8_t level = CALIBRATION_SWEEP_LEVELS[iteration % NUM_LEVELS];
+		leds.setAll(channel == 0 ? level : 0, channel == 1 ? level : 0, channel == 2 ? level : 0);
+		tracker.waitForFreeSlot();
+		setColors(device_id, leds);
+		myPrint("{}: channel {} level {}", iteration, channel, level);
+		});
+	leds.setAll(0, 0, 0);
+	setColors(device_id, leds);
+	waitForColors(leds);
+
+	if (previous_transfer) {
+		leds.setTransferFunction(*previous_transfer);
+	}
+	if (previous_calibration) {
+		leds.setCalibration(*previous_calibration);
+	}
+}
+
+bool buildCalibrationProfile(const Leds& leds, const std::filesystem::path& measurements_path, const std::filesystem::path& profile_path)
+{
+	const auto measurements = loadCalibrationMeasurements(measurements_path);
+	if (!measurements) {
+		myPrint("Failed to read calibration measurements from {}", measurements_path.string());
+		return false;
+	}
+
+	const CalibrationProfile profile = CalibrationProfile::fit(leds.getAllLedPositions(), *measurements);
+	for (uint32_t channel = 0; channel < 3; ++channel) {
+		float min_gain = CalibrationProfile::MAX_GAIN;
+		float max_gain = 0.0f;
+		for (uint32_t i = 0; i < profile.size(); ++i) {
+			min_gain = std::min(min_gain, profile.getCorrection(i).channels[channel].gain);
+			max_gain = std::max(max_gain, profile.getCorrection(i).channels[channel].gain);
+		}
+		myPrint("Calibration channel {}: gains from {:.3f} to {:.3f}", channel, min_gain, max_gain);
+	}
+
+	if (!profile.save(profile_path)) {
+		myPrint("Failed to write calibration profile to {}", profile_path.string());
+		return false;
+	}
+	myPrint("Calibration profile with {} LEDs written to {}", profile.size(), profile_path.string());
+	return true;
 }
\ No newline at end of file
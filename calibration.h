@@ -1,9 +1,25 @@
 #pragma once
 
+#include <cstdint>
+
+#include <array>
+#include <filesystem>
+
 #include <iCUESDK/iCUESDK.h>
 
 #include "leds.h"
 
+// Levels each channel is shown at by calibrationSweep()
+constexpr std::array<uint8_t, 9> CALIBRATION_SWEEP_LEVELS{ 0, 32, 64, 96, 128, 160, 192, 224, 255 };
+
 void calibrationTransmit(const CorsairDeviceId* device_id, Leds& leds);
 
-void calibrationTransmitForText(const CorsairDeviceId* device_id, Leds& leds);
\ No newline at end of file
+void calibrationTransmitForText(const CorsairDeviceId* device_id, Leds& leds);
+
+// Shows R, then G, then B at every level of CALIBRATION_SWEEP_LEVELS on the whole device, one level per second, with
+// the transfer function and calibration turned off. The receiver records how bright each LED came out as
+// "<id> <channel> <level> <measured>" lines for buildCalibrationProfile().
+void calibrationSweep(const CorsairDeviceId* device_id, Leds& leds);
+
+// Fits a profile to the receiver's measurements of a sweep and saves it for --calibration=
+bool buildCalibrationProfile(const Leds& leds, const std::filesystem::path& measurements_path, const std::filesystem::path& profile_path);
\ No newline at end of file
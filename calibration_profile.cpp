@@ -0,0 +1,232 @@
+#include "calibration_profile.h"
+
+#include <cassert>
+#include <cmath>
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+#include <immintrin.h>
+
+#include "led_color_store.h"
+#include "my_print.h"
+
+static_assert(CalibrationProfile::CAPACITY % LedColorStore::LANES == 0);
+
+static int16_t toFixed(double value)
+{
+	return static_cast<int16_t>(std::lround(value * 256.0));
+}
+
+CalibrationProfile::CalibrationProfile(std::span<const CorsairLedPosition> positions)
+{
+	assert(positions.size() <= CAPACITY);
+	m_count = static_cast<uint32_t>(positions.size());
+	for (uint32_t i = 0; i < CAPACITY; ++i) {
+		if (i < m_count) {
+			m_ids[i] = positions[i].id;
+		}
+		setCorrection(i, LedCorrection{});
+	}
+}
+
+void CalibrationProfile::setCorrection(uint32_t led_index, const LedCorrection& correction)
+{
+	assert(led_index < CAPACITY);
+	LedCorrection& stored = m_corrections[led_index];
+	for (uint32_t channel = 0; channel < 3; ++channel) {
+		stored.channels[channel].gain = std::clamp(correction.channels[channel].gain, 0.0f, MAX_GAIN);
+		stored.channels[channel].offset = std::clamp(correction.channels[channel].offset, -MAX_OFFSET, MAX_OFFSET);
+		// the + 0.5 rounds to nearest when the vector path shifts the 8 fraction bits back out
+		m_coefficients[channel][led_index * 2 + 0] = toFixed(stored.channels[channel].gain);
+		m_coefficients[channel][led_index * 2 + 1] = toFixed(stored.channels[channel].offset + 0.5);
+	}
+}
+
+void CalibrationProfile::apply(uint32_t channel, uint8_t* values, uint32_t count) const
+{
+	assert(channel < 3);
+	assert(count <= m_count);
+	assert(reinterpret_cast<uintptr_t>(values) % 16 == 0);
+
+	const int16_t* coefficients = m_coefficients[channel].data();
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+	uint32_t i = 0;
+	for (; i + LedColorStore::LANES <= count; i += LedColorStore::LANES) {
+		const __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(values + i));
+		const __m128i v_lo = _mm_unpacklo_epi8(v, zero);
+		const __m128i v_hi = _mm_unpackhi_epi8(v, zero);
+		// (value, 1) pairs against (gain, offset) pairs, madd gives value * gain + offset per LED as int32
+		const __m128i pairs[4]{
+			_mm_unpacklo_epi16(v_lo, one), _mm_unpackhi_epi16(v_lo, one),
+			_mm_unpacklo_epi16(v_hi, one), _mm_unpackhi_epi16(v_hi, one),
+		};
+		__m128i corrected[4];
+		for (int quarter = 0; quarter < 4; ++quarter) {
+			const __m128i c = _mm_load_si128(reinterpret_cast<const __m128i*>(coefficients + (i + quarter * 4) * 2));
+			corrected[quarter] = _mm_srai_epi32(_mm_madd_epi16(pairs[quarter], c), 8);
+		}
+		// packs then packus clamps to 0-255
+		const __m128i lo = _mm_packs_epi32(corrected[0], corrected[1]);
+		const __m128i hi = _mm_packs_epi32(corrected[2], corrected[3]);
+		_mm_store_si128(reinterpret_cast<__m128i*>(values + i), _mm_packus_epi16(lo, hi));
+	}
+	for (; i < count; ++i) {
+		values[i] = applyOne(channel, i, values[i]);
+	}
+}
+
+bool CalibrationProfile::save(const std::filesystem::path& path) const
+{
+	std::ofstream file(path, std::ios::trunc);
+	file << "# lighttest calibration profile: <id> <r gain> <r offset> <g gain> <g offset> <b gain> <b offset>\n";
+	for (uint32_t i = 0; i < m_count; ++i) {
+		file << m_ids[i];
+		for (const ChannelCorrection& c : m_corrections[i].channels) {
+			file << ' ' << c.gain << ' ' << c.offset;
+		}
+		file << '\n';
+	}
+	file.close();
+	return !file.fail();
+}
+
+static std::unordered_map<CorsairLedLuid, uint32_t> indexById(std::span<const CorsairLedPosition> positions)
+{
+	std::unordered_map<CorsairLedLuid, uint32_t> index_for_id{};
+	for (uint32_t i = 0; i < positions.size(); ++i) {
+		index_for_id.emplace(positions[i].id, i);
+	}
+	return index_for_id;
+}
+
+std::optional<CalibrationProfile> CalibrationProfile::load(const std::filesystem::path& path, std::span<const CorsairLedPosition> positions)
+{
+	std::ifstream file(path);
+	if (!file) {
+		return std::nullopt;
+	}
+
+	CalibrationProfile profile(positions);
+	const auto index_for_id = indexById(positions);
+	std::string line{};
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		std::istringstream fields(line);
+		CorsairLedLuid id{};
+		LedCorrection correction{};
+		fields >> id;
+		for (ChannelCorrection& c : correction.channels) {
+			fields >> c.gain >> c.offset;
+		}
+		if (!fields) {
+			myPrint("Bad line in calibration profile {}: {}", path.string(), line);
+			return std::nullopt;
+		}
+		if (const auto it = index_for_id.find(id); it != index_for_id.end()) {
+			profile.setCorrection(it->second, correction);
+		}
+	}
+	return profile;
+}
+
+CalibrationProfile CalibrationProfile::fit(std::span<const CorsairLedPosition> positions, std::span<const CalibrationMeasurement> measurements)
+{
+	struct LineFit {
+		double n = 0.0, sum_x = 0.0, sum_y = 0.0, sum_xx = 0.0, sum_xy = 0.0;
+		uint8_t min_level = 255, max_level = 0;
+		double slope = 0.0, intercept = 0.0;
+		bool valid = false;
+	};
+
+	CalibrationProfile profile(positions);
+	const auto index_for_id = indexById(positions);
+	std::vector<std::array<LineFit, 3>> fits(positions.size());
+
+	for (const CalibrationMeasurement& m : measurements) {
+		const auto it = index_for_id.find(m.id);
+		if (it == index_for_id.end() || m.channel >= 3) {
+			continue;
+		}
+		LineFit& f = fits[it->second][m.channel];
+		f.n += 1.0;
+		f.sum_x += m.level;
+		f.sum_y += m.measured;
+		f.sum_xx += static_cast<double>(m.level) * m.level;
+		f.sum_xy += m.level * m.measured;
+		f.min_level = std::min(f.min_level, m.level);
+		f.max_level = std::max(f.max_level, m.level);
+	}
+
+	for (uint32_t channel = 0; channel < 3; ++channel) {
+		// the target line runs from the brightest black to the dimmest full brightness, every LED can reach all of it
+		double target_black = -std::numeric_limits<double>::infinity();
+		double target_full = std::numeric_limits<double>::infinity();
+		for (auto& led_fits : fits) {
+			LineFit& f = led_fits[channel];
+			if (f.min_level == f.max_level) {
+				continue;
+			}
+			f.slope = (f.n * f.sum_xy - f.sum_x * f.sum_y) / (f.n * f.sum_xx - f.sum_x * f.sum_x);
+			f.intercept = (f.sum_y - f.slope * f.sum_x) / f.n;
+			f.valid = f.slope > 0.0;
+			if (f.valid) {
+				target_black = std::max(target_black, f.intercept);
+				target_full = std::min(target_full, f.intercept + f.slope * 255.0);
+			}
+		}
+		if (!(target_full > target_black)) {
+			myPrint("Calibration: channel {} has no range every LED can reach, left uncorrected", channel);
+			continue;
+		}
+
+		const double target_slope = (target_full - target_black) / 255.0;
+		for (uint32_t i = 0; i < fits.size(); ++i) {
+			const LineFit& f = fits[i][channel];
+			if (!f.valid) {
+				continue;
+			}
+			// solve intercept + slope * sent = target_black + target_slope * value for sent
+			LedCorrection correction = profile.getCorrection(i);
+			correction.channels[channel].gain = static_cast<float>(target_slope / f.slope);
+			correction.channels[channel].offset = static_cast<float>((target_black - f.intercept) / f.slope);
+			profile.setCorrection(i, correction);
+		}
+	}
+
+	return profile;
+}
+
+std::optional<std::vector<CalibrationMeasurement>> loadCalibrationMeasurements(const std::filesystem::path& path)
+{
+	std::ifstream file(path);
+	if (!file) {
+		return std::nullopt;
+	}
+
+	std::vector<CalibrationMeasurement> measurements{};
+	std::string line{};
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		std::istringstream fields(line);
+		CalibrationMeasurement m{};
+		uint32_t level{};
+		fields >> m.id >> m.channel >> level >> m.measured;
+		if (!fields || level > 255) {
+			myPrint("Bad line in calibration measurements {}: {}", path.string(), line);
+			return std::nullopt;
+		}
+		m.level = static_cast<uint8_t>(level);
+		measurements.push_back(m);
+	}
+	return measurements;
+}
\ No newline at end of file
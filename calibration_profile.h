@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+
+#include <array>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <iCUESDK/iCUESDK.h>
+
+// sent = value * gain + offset, clamped to 0-255
+struct ChannelCorrection {
+	float gain = 1.0f;
+	float offset = 0.0f;
+};
+
+struct LedCorrection {
+	std::array<ChannelCorrection, 3> channels{}; // R, G, B
+};
+
+// One reading from the receiver: how bright a channel of an LED came out when sent at level
+struct CalibrationMeasurement {
+	CorsairLedLuid id;
+	uint32_t channel; // 0 = R, 1 = G, 2 = B
+	uint8_t level;
+	double measured; // any unit, as long as every reading uses the same one
+};
+
+// Per-LED, per-channel gain and offset that make every key of a device respond the same way.
+// Applied to every submitted frame after the transfer function (which shapes the response of the device as a whole).
+// Profiles are stored as text, one line per LED keyed by LED id so they survive LED order changes:
+// <id> <r gain> <r offset> <g gain> <g offset> <b gain> <b offset>
+class CalibrationProfile {
+public:
+	static constexpr uint32_t CAPACITY = CORSAIR_DEVICE_LEDCOUNT_MAX;
+	static constexpr float MAX_GAIN = 127.0f;
+	static constexpr float MAX_OFFSET = 127.0f;
+
+private:
+	std::array<CorsairLedLuid, CAPACITY> m_ids{};
+	std::array<LedCorrection, CAPACITY> m_corrections{};
+	// per channel, (gain * 256, offset * 256 + 128) pairs of int16 per LED, laid out for _mm_madd_epi16
+	alignas(16) std::array<std::array<int16_t, CAPACITY * 2>, 3> m_coefficients{};
+	uint32_t m_count = 0;
+
+public:
+	CalibrationProfile() = default;
+
+	// Every LED starts uncorrected
+	explicit CalibrationProfile(std::span<const CorsairLedPosition> positions);
+
+	uint32_t size() const { return m_count; }
+
+	// gain is clamped to 0 to MAX_GAIN and offset to +-MAX_OFFSET
+	void setCorrection(uint32_t led_index, const LedCorrection& correction);
+
+	const LedCorrection& getCorrection(uint32_t led_index) const { return m_corrections[led_index]; }
+
+	// Corrects count values of one channel in place, values[i] belongs to LED i and values must be 16-byte aligned
+	void apply(uint32_t channel, uint8_t* values, uint32_t count) const;
+
+	uint8_t applyOne(uint32_t channel, uint32_t led_index, uint8_t value) const
+	{
+		const int16_t* coefficients = &m_coefficients[channel][led_index * 2];
+		// >> on a negative int is arithmetic, same as the vector path
+		const int32_t corrected = (static_cast<int32_t>(value) * coefficients[0] + coefficients[1]) >> 8;
+		return static_cast<uint8_t>(corrected < 0 ? 0 : (corrected > 255 ? 255 : corrected));
+	}
+
+	bool save(const std::filesystem::path& path) const;
+
+	// LEDs of positions missing from the file stay uncorrected, LEDs in the file the device doesn't have are ignored
+	static std::optional<CalibrationProfile> load(const std::filesystem::path& path, std::span<const CorsairLedPosition> positions);
+
+	// Fits a straight line to the readings of each LED channel, then picks gains and offsets that map every LED onto the
+	// dimmest common range, so the whole device can reach it without clipping. LED channels with fewer than two levels
+	// measured are left uncorrected.
+	static CalibrationProfile fit(std::span<const CorsairLedPosition> positions, std::span<const CalibrationMeasurement> measurements);
+};
+
+// Reads "<id> <channel> <level> <measured>" lines as written by the receiver, lines starting with # are skipped
+std::optional<std::vector<CalibrationMeasurement>> loadCalibrationMeasurements(const std::filesystem::path& path);
\ No newline at end of file
@@ -0,0 +1,381 @@
+#include "compression.h"
+
+#include <cassert>
+
+#include <algorithm>
+#include <bit>
+
+#include "framing.h"
+
+constexpr uint32_t MIN_MATCH = 3;
+constexpr uint32_t MAX_MATCH = MIN_MATCH + 255;
+constexpr uint32_t HASH_BITS = 15;
+constexpr uint32_t MAX_CHAIN = 64; // candidates checked per position
+constexpr uint32_t FAR_MIN_MATCH_DISTANCE = 4096; // a 3 byte match further back than this costs more than its literals
+
+constexpr uint32_t PROBABILITY_BITS = 11;
+constexpr uint32_t PROBABILITY_ONE = 1 << PROBABILITY_BITS;
+constexpr uint32_t MOVE_BITS = 5;
+constexpr uint32_t RANGE_TOP = 1 << 24;
+
+// No token can take more input than this, the streaming decoder waits until it has this much or the input is finished
+constexpr size_t MAX_TOKEN_INPUT = 64;
+
+// Relative frequency of each ASCII byte in English prose (space = 255): letter frequencies with capitals at 1/20
+// of their lower case, plus newlines, punctuation and digits. 0 means rare rather than impossible.
+static constexpr std::array<uint8_t, 128> ENGLISH_BYTE_WEIGHTS{
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 21, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	255, 1, 3, 0, 0, 0, 0, 4, 1, 1, 0, 0, 14, 3, 13, 0,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1,
+	0, 5, 1, 2, 2, 7, 1, 1, 3, 4, 1, 1, 2, 1, 4, 4,
+	1, 1, 3, 3, 5, 2, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+	0, 91, 17, 31, 48, 140, 24, 22, 67, 77, 2, 9, 44, 27, 74, 83,
+	21, 1, 66, 70, 101, 31, 11, 27, 2, 22, 1, 0, 0, 0, 0, 0,
+};
+
+CompressionModel::CompressionModel()
+{
+	is_match.fill(PROBABILITY_ONE / 2);
+	length.fill(PROBABILITY_ONE / 2);
+	distance_slot.fill(PROBABILITY_ONE / 2);
+
+	// node m of the literal tree at depth d covers the bytes whose top d bits are m without its leading 1,
+	// its probability of a 0 is the share of the lower half of them
+	const auto weight = [](uint32_t byte) { return (byte < 128 ? ENGLISH_BYTE_WEIGHTS[byte] : 0) + 0.25; };
+	literal[0] = PROBABILITY_ONE / 2;
+	for (uint32_t node = 1; node < 256; ++node) {
+		const uint32_t depth = static_cast<uint32_t>(std::bit_width(node)) - 1;
+		const uint32_t span = 256U >> depth;
+		const uint32_t first = (node - (1U << depth)) * span;
+		double zero = 0.0;
+		double total = 0.0;
+		for (uint32_t byte = first; byte < first + span; ++byte) {
+			total += weight(byte);
+			if (byte < first + span / 2) {
+				zero += weight(byte);
+			}
+		}
+		literal[node] = static_cast<uint16_t>(std::clamp<double>(zero / total * PROBABILITY_ONE, 31.0, PROBABILITY_ONE - 31.0));
+	}
+}
+
+class RangeEncoder {
+	std::vector<uint8_t>& m_out;
+	uint64_t m_low = 0;
+	uint32_t m_range = 0xFFFFFFFF;
+	uint8_t m_cache = 0;
+	uint64_t m_cache_size = 1;
+
+	void shiftLow()
+	{
+		if (static_cast<uint32_t>(m_low) < 0xFF000000 || (m_low >> 32) != 0) {
+			const uint8_t carry = static_cast<uint8_t>(m_low >> 32);
+			uint8_t byte = m_cache;
+			do {
+				m_out.push_back(static_cast<uint8_t>(byte + carry));
+				byte = 0xFF;
+			} while (--m_cache_size != 0);
+			m_cache = static_cast<uint8_t>(m_low >> 24);
+		}
+		++m_cache_size;
+		m_low = (m_low & 0x00FFFFFF) << 8;
+	}
+
+public:
+	explicit RangeEncoder(std::vector<uint8_t>& out) : m_out(out) {}
+
+	void encodeBit(uint16_t& probability, uint32_t bit)
+	{
+		const uint32_t bound = (m_range >> PROBABILITY_BITS) * probability;
+		if (bit == 0) {
+			m_range = bound;
+			probability += static_cast<uint16_t>((PROBABILITY_ONE - probability) >> MOVE_BITS);
+		}
+		else {
+			m_low += bound;
+			m_range -= bound;
+			probability -= static_cast<uint16_t>(probability >> MOVE_BITS);
+		}
+		while (m_range < RANGE_TOP) {
+			m_range <<= 8;
+			shiftLow();
+		}
+	}
+
+	void encodeDirectBits(uint32_t value, uint32_t num_bits)
+	{
+		for (uint32_t i = num_bits; i-- > 0;) {
+			m_range >>= 1;
+			if ((value >> i) & 1) {
+				m_low += m_range;
+			}
+			while (m_range < RANGE_TOP) {
+				m_range <<= 8;
+				shiftLow();
+			}
+		}
+	}
+
+	void encodeTree(uint16_t* probabilities, uint32_t num_bits, uint32_t value)
+	{
+		uint32_t node = 1;
+		for (uint32_t i = num_bits; i-- > 0;) {
+			const uint32_t bit = (value >> i) & 1;
+			encodeBit(probabilities[node], bit);
+			node = (node << 1) | bit;
+		}
+	}
+
+	void flush()
+	{
+		for (int i = 0; i < 5; ++i) {
+			shiftLow();
+		}
+	}
+};
+
+static uint32_t hash3(const uint8_t* bytes)
+{
+	const uint32_t value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
+	return (value * 2654435761U) >> (32 - HASH_BITS);
+}
+
+std::vector<uint8_t> compressPayload(std::span<const uint8_t> source)
+{
+	const uint32_t n = static_cast<uint32_t>(source.size());
+	std::vector<uint8_t> out{};
+	const uint32_t crc = crc32(source);
+	for (uint32_t i = 0; i < 4; ++i) {
+		out.push_back(static_cast<uint8_t>(n >> (i * 8)));
+	}
+	for (uint32_t i = 0; i < 4; ++i) {
+		out.push_back(static_cast<uint8_t>(crc >> (i * 8)));
+	}
+
+	CompressionModel model{};
+	RangeEncoder encoder(out);
+
+	std::vector<int32_t> head(1 << HASH_BITS, -1);
+	std::vector<int32_t> previous(n, -1);
+	const auto insert = [&](uint32_t pos) {
+		if (pos + MIN_MATCH <= n) {
+			const uint32_t h = hash3(source.data() + pos);
+			previous[pos] = head[h];
+			head[h] = static_cast<int32_t>(pos);
+		}
+		};
+	struct Match {
+		uint32_t length;
+		uint32_t distance;
+	};
+	const auto findMatch = [&](uint32_t pos) {
+		Match best{ 0, 0 };
+		if (pos + MIN_MATCH > n) {
+			return best;
+		}
+		const uint32_t max_length = std::min(MAX_MATCH, n - pos);
+		int32_t candidate = head[hash3(source.data() + pos)];
+		for (uint32_t chain = 0; candidate >= 0 && pos - candidate <= StreamingDecompressor::WINDOW_SIZE && chain < MAX_CHAIN; ++chain) {
+			uint32_t length = 0;
+			while (length < max_length && source[candidate + length] == source[pos + length]) {
+				++length;
+			}
+			if (length > best.length) {
+				best = Match{ length, pos - static_cast<uint32_t>(candidate) };
+				if (length == max_length) {
+					break;
+				}
+			}
+			candidate = previous[candidate];
+		}
+		if (best.length < MIN_MATCH || (best.length == MIN_MATCH && best.distance > FAR_MIN_MATCH_DISTANCE)) {
+			best.length = 0;
+		}
+		return best;
+		};
+
+	uint32_t previous_match = 0;
+	uint32_t pos = 0;
+	while (pos < n) {
+		const Match match = findMatch(pos);
+		insert(pos);
+		// lazy matching: a longer match starting at the next byte is worth a literal first
+		if (match.length > 0 && findMatch(pos + 1).length > match.length) {
+			encoder.encodeBit(model.is_match[previous_match], 0);
+			encoder.encodeTree(model.literal.data(), 8, source[pos]);
+			previous_match = 0;
+			++pos;
+			continue;
+		}
+		if (match.length == 0) {
+			encoder.encodeBit(model.is_match[previous_match], 0);
+			encoder.encodeTree(model.literal.data(), 8, source[pos]);
+			previous_match = 0;
+			++pos;
+			continue;
+		}
+
+		encoder.encodeBit(model.is_match[previous_match], 1);
+		encoder.encodeTree(model.length.data(), 8, match.length - MIN_MATCH);
+		const uint32_t d = match.distance - 1;
+		const uint32_t slot = static_cast<uint32_t>(std::bit_width(d));
+		encoder.encodeTree(model.distance_slot.data(), 4, slot);
+		if (slot >= 2) {
+			encoder.encodeDirectBits(d - (1U << (slot - 1)), slot - 1);
+		}
+		previous_match = 1;
+		for (uint32_t i = 1; i < match.length; ++i) {
+			insert(pos + i);
+		}
+		pos += match.length;
+	}
+	encoder.flush();
+	return out;
+}
+
+uint8_t StreamingDecompressor::nextByte()
+{
+	// past the end only happens with a truncated stream, which shows up as a failure later
+	const uint8_t byte = m_input_position < m_input.size() ? m_input[m_input_position] : 0;
+	++m_input_position;
+	return byte;
+}
+
+void StreamingDecompressor::normalize()
+{
+	if (m_range < RANGE_TOP) {
+		m_range <<= 8;
+		m_code = (m_code << 8) | nextByte();
+	}
+}
+
+uint32_t StreamingDecompressor::decodeBit(uint16_t& probability)
+{
+	const uint32_t bound = (m_range >> PROBABILITY_BITS) * probability;
+	uint32_t bit = 0;
+	if (m_code < bound) {
+		m_range = bound;
+		probability += static_cast<uint16_t>((PROBABILITY_ONE - probability) >> MOVE_BITS);
+	}
+	else {
+		m_code -= bound;
+		m_range -= bound;
+		probability -= static_cast<uint16_t>(probability >> MOVE_BITS);
+		bit = 1;
+	}
+	normalize();
+	return bit;
+}
+
+uint32_t StreamingDecompressor::decodeDirectBits(uint32_t num_bits)
+{
+	uint32_t value = 0;
+	for (uint32_t i = 0; i < num_bits; ++i) {
+		m_range >>= 1;
+		const uint32_t bit = m_code >= m_range ? 1 : 0;
+		if (bit) {
+			m_code -= m_range;
+		}
+		value = (value << 1) | bit;
+		normalize();
+	}
+	return value;
+}
+
+uint32_t StreamingDecompressor::decodeTree(uint16_t* probabilities, uint32_t num_bits)
+{
+	uint32_t node = 1;
+	for (uint32_t i = 0; i < num_bits; ++i) {
+		node = (node << 1) | decodeBit(probabilities[node]);
+	}
+	return node - (1U << num_bits);
+}
+
+void StreamingDecompressor::emit(uint8_t byte, std::vector<uint8_t>& out)
+{
+	m_window[m_produced % WINDOW_SIZE] = byte;
+	++m_produced;
+	out.push_back(byte);
+}
+
+void StreamingDecompressor::feed(std::span<const uint8_t> bytes)
+{
+	// drop input that has been used up once there is a fair amount of it
+	if (m_input_position > (1 << 16) && m_input_position <= m_input.size()) {
+		m_input.erase(m_input.begin(), m_input.begin() + m_input_position);
+		m_input_position = 0;
+	}
+	m_input.insert(m_input.end(), bytes.begin(), bytes.end());
+}
+
+bool StreamingDecompressor::decode(std::vector<uint8_t>& out)
+{
+	if (m_failed) {
+		return false;
+	}
+	const auto available = [&]() { return m_input.size() > m_input_position ? m_input.size() - m_input_position : 0; };
+
+	if (!m_started) {
+		// length and CRC, then the encoder's leading zero and the first 4 bytes of code
+		if (!m_input_finished && available() < 13) {
+			return true;
+		}
+		for (uint32_t i = 0; i < 4; ++i) {
+			m_source_length |= static_cast<uint32_t>(nextByte()) << (i * 8);
+		}
+		for (uint32_t i = 0; i < 4; ++i) {
+			m_source_crc |= static_cast<uint32_t>(nextByte()) << (i * 8);
+		}
+		for (uint32_t i = 0; i < 5; ++i) {
+			m_code = (m_code << 8) | nextByte();
+		}
+		m_started = true;
+	}
+
+	const size_t first_out = out.size();
+	while (m_produced < m_source_length) {
+		if (!m_input_finished && available() < MAX_TOKEN_INPUT) {
+			m_crc = crc32(std::span<const uint8_t>(out).subspan(first_out), m_crc);
+			return true;
+		}
+		if (m_input_position > m_input.size() + 4) {
+			// the encoder's flush is never read in full, reading further means the input was cut short
+			m_failed = true;
+			return false;
+		}
+
+		if (!decodeBit(m_model.is_match[m_previous_match])) {
+			emit(static_cast<uint8_t>(decodeTree(m_model.literal.data(), 8)), out);
+			m_previous_match = 0;
+			continue;
+		}
+
+		const uint32_t length = decodeTree(m_model.length.data(), 8) + MIN_MATCH;
+		const uint32_t slot = decodeTree(m_model.distance_slot.data(), 4);
+		const uint32_t d = slot < 2 ? slot : (1U << (slot - 1)) + decodeDirectBits(slot - 1);
+		const uint32_t distance = d + 1;
+		if (distance > m_produced || distance > WINDOW_SIZE || length > m_source_length - m_produced) {
+			m_failed = true;
+			return false;
+		}
+		for (uint32_t i = 0; i < length; ++i) {
+			emit(m_window[(m_produced - distance) % WINDOW_SIZE], out);
+		}
+		m_previous_match = 1;
+	}
+	m_crc = crc32(std::span<const uint8_t>(out).subspan(first_out), m_crc);
+	if (m_crc != m_source_crc) {
+		m_failed = true;
+		return false;
+	}
+	return true;
+}
+
+bool decompressPayload(std::span<const uint8_t> compressed, std::vector<uint8_t>& out)
+{
+	StreamingDecompressor decompressor{};
+	decompressor.feed(compressed);
+	decompressor.finish();
+	return decompressor.decode(out) && decompressor.isDone();
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+
+#include <array>
+#include <span>
+#include <vector>
+
+enum class PayloadCompression : uint8_t {
+	None,
+	Lz, // compressPayload()
+};
+
+// Adaptive bit probabilities shared by the compressor and decompressor, 11-bit like LZMA's.
+// The literal model starts from the byte frequencies of English prose, so short text compresses from the first byte
+// instead of after the model has learned the language; anything else just takes a little longer to adapt to.
+struct CompressionModel {
+	std::array<uint16_t, 2> is_match; // by whether the previous token was a match
+	std::array<uint16_t, 256> literal; // bit tree over the 8 bits of a literal, MSB first
+	std::array<uint16_t, 256> length; // bit tree over match length - MIN_MATCH
+	std::array<uint16_t, 16> distance_slot; // bit tree over the number of significant bits of distance - 1
+
+	CompressionModel();
+};
+
+// LZ77 (32 KiB window, matches of 3 to 258 bytes, one step of lazy matching) followed by a binary range coder.
+// The stream starts with the source length and a CRC-32 of the source (4 bytes each, little endian).
+std::vector<uint8_t> compressPayload(std::span<const uint8_t> source);
+
+// Decompresses as bytes arrive, so a receiver can hand over each block as soon as it is decoded and read the text so far.
+// Only the last 32 KiB of output is kept.
+class StreamingDecompressor {
+public:
+	static constexpr uint32_t WINDOW_SIZE = 1 << 15;
+
+private:
+	CompressionModel m_model{};
+	std::vector<uint8_t> m_input{};
+	size_t m_input_position = 0;
+	bool m_input_finished = false;
+
+	bool m_started = false;
+	uint32_t m_source_length = 0;
+	uint32_t m_source_crc = 0;
+	uint32_t m_produced = 0;
+	uint32_t m_crc = 0; // of the output so far
+	std::vector<uint8_t> m_window = std::vector<uint8_t>(WINDOW_SIZE);
+	uint32_t m_range = 0xFFFFFFFF;
+	uint32_t m_code = 0;
+	uint32_t m_previous_match = 0;
+	bool m_failed = false;
+
+	uint8_t nextByte();
+	void normalize();
+	uint32_t decodeBit(uint16_t& probability);
+	uint32_t decodeDirectBits(uint32_t num_bits);
+	uint32_t decodeTree(uint16_t* probabilities, uint32_t num_bits);
+	void emit(uint8_t byte, std::vector<uint8_t>& out);
+
+public:
+	void feed(std::span<const uint8_t> bytes);
+
+	// No more input is coming, decode() may then use up what is left
+	void finish() { m_input_finished = true; }
+
+	// Appends everything that can be decoded from the input so far, returns false once the stream turned out to be corrupt.
+	// Corruption the decoder doesn't trip over is only found by the CRC once the last byte is out.
+	bool decode(std::vector<uint8_t>& out);
+
+	bool isDone() const { return m_started && !m_failed && m_produced == m_source_length; }
+
+	uint32_t getSourceLength() const { return m_source_length; }
+};
+
+// Decompresses a whole payload, false if it is corrupt (including a CRC mismatch) or cut short
+bool decompressPayload(std::span<const uint8_t> compressed, std::vector<uint8_t>& out);
\ No newline at end of file
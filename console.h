@@ -0,0 +1,18 @@
+#pragma once
+
+#ifdef _WIN32
+#include <conio.h>
+#else
+#include <cstdio>
+#endif
+
+// Blocks until a key is pressed.
+// Without conio this waits for a line instead, and returns straight away when stdin is closed (headless runs).
+inline void waitForKeyPress()
+{
+#ifdef _WIN32
+	(void)_getch();
+#else
+	(void)std::getchar();
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,515 @@
+#include "constellation.h"
+
+#include <cassert>
+#include <cmath>
+
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <limits>
+#include <numbers>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+
+#include "my_print.h"
+
+static float distanceSquared(const ReceivedColor& a, const ReceivedColor& b)
+{
+	const float d0 = a[0] - b[0];
+	const float d1 = a[1] - b[1];
+	const float d2 = a[2] - b[2];
+	return d0 * d0 + d1 * d1 + d2 * d2;
+}
+
+ReceiverColorModel ReceiverColorModel::modelled(double gamma, const std::array<ReceivedColor, 3>& mixing)
+{
+	constexpr uint32_t NUM_LEVELS = 18; // steps of 15, close enough to the curve for trilinear interpolation
+
+	ReceiverColorModel model{};
+	for (auto& levels : model.m_levels) {
+		for (uint32_t i = 0; i < NUM_LEVELS; ++i) {
+			levels.push_back(static_cast<uint8_t>(i * 255 / (NUM_LEVELS - 1)));
+		}
+	}
+	for (const uint8_t r : model.m_levels[0]) {
+		for (const uint8_t g : model.m_levels[1]) {
+			for (const uint8_t b : model.m_levels[2]) {
+				const std::array<uint8_t, 3> drive{ r, g, b };
+				ReceivedColor received{};
+				for (uint32_t c = 0; c < 3; ++c) {
+					const float light = static_cast<float>(std::pow(drive[c] / 255.0, gamma));
+					for (uint32_t k = 0; k < 3; ++k) {
+						received[k] += light * mixing[c][k];
+					}
+				}
+				model.m_grid.push_back(received);
+			}
+		}
+	}
+	return model;
+}
+
+std::optional<ReceiverColorModel> ReceiverColorModel::load(const std::filesystem::path& path)
+{
+	std::ifstream file(path);
+	if (!file) {
+		return std::nullopt;
+	}
+
+	struct Sample {
+		DriveColor drive;
+		ReceivedColor received;
+	};
+	std::vector<Sample> samples{};
+	std::array<std::set<uint8_t>, 3> levels{};
+	std::string line{};
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		std::istringstream fields(line);
+		std::array<uint32_t, 3> drive{};
+		ReceivedColor received{};
+		if (!(fields >> drive[0] >> drive[1] >> drive[2] >> received[0] >> received[1] >> received[2]) ||
+			drive[0] > 255 || drive[1] > 255 || drive[2] > 255) {
+			myPrint("Bad receiver color line: {}", line);
+			return std::nullopt;
+		}
+		Sample sample{ .drive = {}, .received = received };
+		for (uint32_t c = 0; c < 3; ++c) {
+			sample.drive[c] = static_cast<uint8_t>(drive[c]);
+			levels[c].insert(sample.drive[c]);
+		}
+		samples.push_back(sample);
+	}
+
+	ReceiverColorModel model{};
+	for (uint32_t c = 0; c < 3; ++c) {
+		model.m_levels[c].assign(levels[c].begin(), levels[c].end());
+		if (model.m_levels[c].size() < 2) {
+			myPrint("Receiver color model needs at least 2 levels per channel");
+			return std::nullopt;
+		}
+	}
+	const size_t n1 = model.m_levels[1].size();
+	const size_t n2 = model.m_levels[2].size();
+	model.m_grid.resize(model.m_levels[0].size() * n1 * n2);
+	std::vector<uint32_t> counts(model.m_grid.size(), 0);
+	for (const Sample& sample : samples) {
+		size_t index = 0;
+		for (uint32_t c = 0; c < 3; ++c) {
+			const auto& axis = model.m_levels[c];
+			index = index * axis.size() + static_cast<size_t>(std::lower_bound(axis.begin(), axis.end(), sample.drive[c]) - axis.begin());
+		}
+		// repeated drive colors are averaged
+		for (uint32_t k = 0; k < 3; ++k) {
+			model.m_grid[index][k] += sample.received[k];
+		}
+		++counts[index];
+	}
+	for (size_t i = 0; i < model.m_grid.size(); ++i) {
+		if (counts[i] == 0) {
+			myPrint("Receiver color measurements don't cover the full grid of drive levels");
+			return std::nullopt;
+		}
+		for (float& value : model.m_grid[i]) {
+			value /= static_cast<float>(counts[i]);
+		}
+	}
+	return model;
+}
+
+ReceivedColor ReceiverColorModel::map(const DriveColor& drive) const
+{
+	std::array<size_t, 3> lower{};
+	std::array<float, 3> t{};
+	for (uint32_t c = 0; c < 3; ++c) {
+		const auto& axis = m_levels[c];
+		const size_t upper = std::clamp<size_t>(static_cast<size_t>(std::upper_bound(axis.begin(), axis.end(), drive[c]) - axis.begin()), 1, axis.size() - 1);
+		lower[c] = upper - 1;
+		t[c] = std::clamp(static_cast<float>(drive[c] - axis[lower[c]]) / static_cast<float>(axis[upper] - axis[lower[c]]), 0.0f, 1.0f);
+	}
+
+	const size_t n1 = m_levels[1].size();
+	const size_t n2 = m_levels[2].size();
+	ReceivedColor result{};
+	for (uint32_t corner = 0; corner < 8; ++corner) {
+		const size_t i0 = lower[0] + ((corner >> 2) & 1);
+		const size_t i1 = lower[1] + ((corner >> 1) & 1);
+		const size_t i2 = lower[2] + (corner & 1);
+		const float weight = ((corner & 4) ? t[0] : 1.0f - t[0]) * ((corner & 2) ? t[1] : 1.0f - t[1]) * ((corner & 1) ? t[2] : 1.0f - t[2]);
+		const ReceivedColor& value = m_grid[(i0 * n1 + i1) * n2 + i2];
+		for (uint32_t k = 0; k < 3; ++k) {
+			result[k] += weight * value[k];
+		}
+	}
+	return result;
+}
+
+// Each point's neighbours that matter for labeling and how much, pairs too far apart to be confused are left out
+struct LabelNeighbour {
+	uint32_t point;
+	float weight;
+};
+using LabelNeighbours = std::vector<std::vector<LabelNeighbour>>;
+
+// Sum over pairs of weight * bits that differ between their labels
+static double labelingCost(const LabelNeighbours& neighbours, const std::vector<uint32_t>& labels)
+{
+	double cost = 0.0;
+	for (size_t i = 0; i < labels.size(); ++i) {
+		for (const LabelNeighbour& neighbour : neighbours[i]) {
+			cost += neighbour.weight * std::popcount(labels[i] ^ labels[neighbour.point]);
+		}
+	}
+	return cost * 0.5;
+}
+
+// Binary switching: keep swapping the labels of two points while that lowers the cost
+static void improveLabeling(const LabelNeighbours& neighbours, std::vector<uint32_t>& labels)
+{
+	const size_t n = labels.size();
+	bool improved = true;
+	while (improved) {
+		improved = false;
+		for (size_t i = 0; i < n; ++i) {
+			for (size_t j = i + 1; j < n; ++j) {
+				// only the terms involving i or j change, and the pair itself keeps its distance
+				double delta = 0.0;
+				for (const LabelNeighbour& neighbour : neighbours[i]) {
+					if (neighbour.point != j) {
+						delta += neighbour.weight * (std::popcount(labels[j] ^ labels[neighbour.point]) - std::popcount(labels[i] ^ labels[neighbour.point]));
+					}
+				}
+				for (const LabelNeighbour& neighbour : neighbours[j]) {
+					if (neighbour.point != i) {
+						delta += neighbour.weight * (std::popcount(labels[i] ^ labels[neighbour.point]) - std::popcount(labels[j] ^ labels[neighbour.point]));
+					}
+				}
+				if (delta < -1e-9) {
+					std::swap(labels[i], labels[j]);
+					improved = true;
+				}
+			}
+		}
+	}
+}
+
+Constellation Constellation::design(const ReceiverColorModel& model, uint32_t bits_per_symbol, const ConstellationDesignOptions& options)
+{
+	assert(bits_per_symbol >= 1 && bits_per_symbol <= 8);
+	const uint32_t num_points = 1U << bits_per_symbol;
+	const uint32_t num_levels = std::max(options.candidate_levels, 2U);
+
+	std::vector<DriveColor> candidates{};
+	std::vector<ReceivedColor> candidate_colors{};
+	for (uint32_t r = 0; r < num_levels; ++r) {
+		for (uint32_t g = 0; g < num_levels; ++g) {
+			for (uint32_t b = 0; b < num_levels; ++b) {
+				const DriveColor drive{ static_cast<uint8_t>(r * 255 / (num_levels - 1)), static_cast<uint8_t>(g * 255 / (num_levels - 1)),
+					static_cast<uint8_t>(b * 255 / (num_levels - 1)) };
+				candidates.push_back(drive);
+				candidate_colors.push_back(model.map(drive));
+			}
+		}
+	}
+	assert(candidates.size() >= num_points);
+
+	// Farthest point first: start at black, then keep adding the candidate furthest from every point so far
+	std::vector<size_t> chosen{ 0 };
+	std::vector<float> nearest(candidates.size(), std::numeric_limits<float>::infinity());
+	while (chosen.size() < num_points) {
+		const ReceivedColor& last = candidate_colors[chosen.back()];
+		for (size_t c = 0; c < candidates.size(); ++c) {
+			nearest[c] = std::min(nearest[c], distanceSquared(candidate_colors[c], last));
+		}
+		chosen.push_back(static_cast<size_t>(std::max_element(nearest.begin(), nearest.end()) - nearest.begin()));
+	}
+
+	// Then move the points that set the minimum distance to wherever is furthest from the others, until none can improve
+	// stops early once the distance is known to be at most floor
+	const auto nearestOther = [&](size_t point, const ReceivedColor& at, float floor = -1.0f) {
+		float d = std::numeric_limits<float>::infinity();
+		for (size_t j = 0; j < chosen.size() && d > floor; ++j) {
+			if (j != point) {
+				d = std::min(d, distanceSquared(at, candidate_colors[chosen[j]]));
+			}
+		}
+		return d;
+		};
+	uint32_t moves = 0;
+	bool moved = true;
+	while (moved && moves < options.max_moves) {
+		moved = false;
+		std::vector<float> point_nearest(num_points);
+		for (size_t i = 0; i < num_points; ++i) {
+			point_nearest[i] = nearestOther(i, candidate_colors[chosen[i]]);
+		}
+		const float min_distance = *std::min_element(point_nearest.begin(), point_nearest.end());
+		for (size_t i = 0; i < num_points && moves < options.max_moves; ++i) {
+			if (point_nearest[i] > min_distance * 1.0001f) {
+				continue;
+			}
+			size_t best = chosen[i];
+			float best_distance = point_nearest[i];
+			for (size_t c = 0; c < candidates.size(); ++c) {
+				const float d = nearestOther(i, candidate_colors[c], best_distance);
+				if (d > best_distance) {
+					best = c;
+					best_distance = d;
+				}
+			}
+			if (best != chosen[i]) {
+				chosen[i] = best;
+				moved = true;
+				++moves;
+			}
+		}
+	}
+
+	Constellation constellation{};
+	constellation.m_bits_per_symbol = bits_per_symbol;
+	constellation.m_min_distance = std::numeric_limits<float>::infinity();
+	for (size_t i = 0; i < num_points; ++i) {
+		constellation.m_min_distance = std::min(constellation.m_min_distance, nearestOther(i, candidate_colors[chosen[i]]));
+	}
+	constellation.m_min_distance = std::sqrt(constellation.m_min_distance);
+
+	// Labels: the weight of a pair falls off like the chance of noise taking one point to the other,
+	// with the nearest pairs at noise where symbol errors are rare but not negligible
+	const float sigma = constellation.m_min_distance * 0.5f;
+	LabelNeighbours neighbours(num_points);
+	for (uint32_t i = 0; i < num_points; ++i) {
+		for (uint32_t j = 0; j < num_points; ++j) {
+			const float weight = std::exp(-distanceSquared(candidate_colors[chosen[i]], candidate_colors[chosen[j]]) / (2.0f * sigma * sigma));
+			if (i != j && weight > 1e-4f) {
+				neighbours[i].push_back(LabelNeighbour{ .point = j, .weight = weight });
+			}
+		}
+	}
+	std::vector<uint32_t> labels(num_points);
+	for (uint32_t i = 0; i < num_points; ++i) {
+		labels[i] = i;
+	}
+	improveLabeling(neighbours, labels);
+	double best_cost = labelingCost(neighbours, labels);
+	std::mt19937 rng(bits_per_symbol);
+	for (uint32_t restart = 0; restart < options.label_restarts; ++restart) {
+		std::vector<uint32_t> trial(num_points);
+		for (uint32_t i = 0; i < num_points; ++i) {
+			trial[i] = i;
+		}
+		std::shuffle(trial.begin(), trial.end(), rng);
+		improveLabeling(neighbours, trial);
+		const double cost = labelingCost(neighbours, trial);
+		if (cost < best_cost) {
+			best_cost = cost;
+			labels = std::move(trial);
+		}
+	}
+
+	constellation.m_drive.resize(num_points);
+	constellation.m_received.resize(num_points);
+	for (size_t i = 0; i < num_points; ++i) {
+		constellation.m_drive[labels[i]] = candidates[chosen[i]];
+		constellation.m_received[labels[i]] = candidate_colors[chosen[i]];
+	}
+	constellation.buildDemodTable();
+	return constellation;
+}
+
+void Constellation::setReceivedColors(std::span<const ReceivedColor> received)
+{
+	assert(received.size() == m_received.size());
+	m_received.assign(received.begin(), received.end());
+	float min_distance = std::numeric_limits<float>::infinity();
+	for (size_t i = 0; i < m_received.size(); ++i) {
+		for (size_t j = i + 1; j < m_received.size(); ++j) {
+			min_distance = std::min(min_distance, distanceSquared(m_received[i], m_received[j]));
+		}
+	}
+	m_min_distance = std::sqrt(min_distance);
+	buildDemodTable();
+}
+
+void Constellation::buildDemodTable()
+{
+	// the grid covers the points plus half the minimum distance around them, colors further out are compared against every point
+	ReceivedColor low{}, high{};
+	for (uint32_t k = 0; k < 3; ++k) {
+		low[k] = std::numeric_limits<float>::infinity();
+		high[k] = -std::numeric_limits<float>::infinity();
+		for (const ReceivedColor& point : m_received) {
+			low[k] = std::min(low[k], point[k]);
+			high[k] = std::max(high[k], point[k]);
+		}
+		low[k] -= m_min_distance * 0.5f;
+		high[k] += m_min_distance * 0.5f;
+		m_grid_origin[k] = low[k];
+		m_grid_scale[k] = high[k] > low[k] ? DEMOD_GRID_SIZE / (high[k] - low[k]) : 0.0f;
+	}
+
+	// A point can only be the nearest to some color in a cell if its closest approach to the cell is no further than
+	// the furthest any point is from the cell. A channel every point has the same value in (scale 0) adds the same to
+	// every distance and is left out. Cells are grown by a little so colors rounded into a neighbouring cell still count.
+	m_cell_start.clear();
+	m_cell_start.reserve(DEMOD_GRID_SIZE * DEMOD_GRID_SIZE * DEMOD_GRID_SIZE + 1);
+	m_cell_candidates.clear();
+	std::vector<float> nearest_approach(m_received.size());
+	for (uint32_t x = 0; x < DEMOD_GRID_SIZE; ++x) {
+		for (uint32_t y = 0; y < DEMOD_GRID_SIZE; ++y) {
+			for (uint32_t z = 0; z < DEMOD_GRID_SIZE; ++z) {
+				const std::array<uint32_t, 3> cell{ x, y, z };
+				ReceivedColor cell_low{}, cell_high{};
+				for (uint32_t k = 0; k < 3; ++k) {
+					if (m_grid_scale[k] > 0.0f) {
+						const float margin = 1e-3f / m_grid_scale[k];
+						cell_low[k] = m_grid_origin[k] + cell[k] / m_grid_scale[k] - margin;
+						cell_high[k] = m_grid_origin[k] + (cell[k] + 1) / m_grid_scale[k] + margin;
+					}
+				}
+				float bound = std::numeric_limits<float>::infinity();
+				for (size_t label = 0; label < m_received.size(); ++label) {
+					float nearest = 0.0f, furthest = 0.0f;
+					for (uint32_t k = 0; k < 3; ++k) {
+						if (m_grid_scale[k] > 0.0f) {
+							const float value = m_received[label][k];
+							const float outside = std::max({ cell_low[k] - value, value - cell_high[k], 0.0f });
+							const float far_side = std::max(value - cell_low[k], cell_high[k] - value);
+							nearest += outside * outside;
+							furthest += far_side * far_side;
+						}
+					}
+					nearest_approach[label] = nearest;
+					bound = std::min(bound, furthest);
+				}
+				m_cell_start.push_back(static_cast<uint32_t>(m_cell_candidates.size()));
+				for (size_t label = 0; label < m_received.size(); ++label) {
+					if (nearest_approach[label] <= bound) {
+						m_cell_candidates.push_back(static_cast<uint8_t>(label));
+					}
+				}
+			}
+		}
+	}
+	m_cell_start.push_back(static_cast<uint32_t>(m_cell_candidates.size()));
+}
+
+uint32_t Constellation::demodulate(const ReceivedColor& color) const
+{
+	std::array<uint32_t, 3> cell{};
+	for (uint32_t k = 0; k < 3; ++k) {
+		const float position = (color[k] - m_grid_origin[k]) * m_grid_scale[k];
+		if (!(position >= 0.0f && position < static_cast<float>(DEMOD_GRID_SIZE))) {
+			return demodulateExact(color);
+		}
+		cell[k] = static_cast<uint32_t>(position);
+	}
+	const size_t index = (cell[0] * DEMOD_GRID_SIZE + cell[1]) * DEMOD_GRID_SIZE + cell[2];
+
+	// in label order like demodulateExact(), so ties go the same way
+	uint32_t best = 0;
+	float best_distance = std::numeric_limits<float>::infinity();
+	for (uint32_t i = m_cell_start[index]; i < m_cell_start[index + 1]; ++i) {
+		const uint32_t label = m_cell_candidates[i];
+		const float d = distanceSquared(color, m_received[label]);
+		if (d < best_distance) {
+			best = label;
+			best_distance = d;
+		}
+	}
+	return best;
+}
+
+uint32_t Constellation::demodulateExact(const ReceivedColor& color) const
+{
+	uint32_t best = 0;
+	float best_distance = std::numeric_limits<float>::infinity();
+	for (uint32_t label = 0; label < m_received.size(); ++label) {
+		const float d = distanceSquared(color, m_received[label]);
+		if (d < best_distance) {
+			best = label;
+			best_distance = d;
+		}
+	}
+	return best;
+}
+
+void Constellation::softBits(const ReceivedColor& color, uint8_t* out) const
+{
+	for (uint32_t b = 0; b < m_bits_per_symbol; ++b) {
+		const uint32_t bit_mask = 1U << (m_bits_per_symbol - 1 - b);
+		float nearest_0 = std::numeric_limits<float>::infinity();
+		float nearest_1 = std::numeric_limits<float>::infinity();
+		for (uint32_t label = 0; label < m_received.size(); ++label) {
+			float& nearest = (label & bit_mask) ? nearest_1 : nearest_0;
+			nearest = std::min(nearest, distanceSquared(color, m_received[label]));
+		}
+		// a full minimum distance closer to one side is treated as certain
+		const float t = m_min_distance > 0.0f ? std::clamp(0.5f + (std::sqrt(nearest_0) - std::sqrt(nearest_1)) / (2.0f * m_min_distance), 0.0f, 1.0f) : 0.5f;
+		out[b] = static_cast<uint8_t>(std::lround(t * 255.0f));
+	}
+}
+
+double Constellation::estimateSymbolErrorRate(double noise_sigma) const
+{
+	if (noise_sigma <= 0.0) {
+		return 0.0;
+	}
+	// each other point contributes the chance of noise pushing past the halfway plane towards it
+	double total = 0.0;
+	for (size_t i = 0; i < m_received.size(); ++i) {
+		for (size_t j = 0; j < m_received.size(); ++j) {
+			if (i != j) {
+				const double distance = std::sqrt(distanceSquared(m_received[i], m_received[j]));
+				total += 0.5 * std::erfc(distance / (2.0 * noise_sigma * std::numbers::sqrt2));
+			}
+		}
+	}
+	return std::min(1.0, total / static_cast<double>(m_received.size()));
+}
+
+double Constellation::getBitsPerNeighbourError() const
+{
+	// neighbours are the points within a little more than the minimum distance
+	const float limit = m_min_distance * m_min_distance * 1.21f;
+	uint64_t bits = 0;
+	uint64_t pairs = 0;
+	for (uint32_t i = 0; i < m_received.size(); ++i) {
+		for (uint32_t j = i + 1; j < m_received.size(); ++j) {
+			if (distanceSquared(m_received[i], m_received[j]) <= limit) {
+				bits += std::popcount(i ^ j);
+				++pairs;
+			}
+		}
+	}
+	return pairs > 0 ? static_cast<double>(bits) / static_cast<double>(pairs) : 0.0;
+}
+
+void Constellation::report() const
+{
+	myPrint("{}-point constellation: minimum distance {:.4f}, {:.2f} bits per nearest neighbour error",
+		m_drive.size(), m_min_distance, getBitsPerNeighbourError());
+	for (uint32_t label = 0; label < m_drive.size(); ++label) {
+		std::string bits(m_bits_per_symbol, '0');
+		for (uint32_t b = 0; b < m_bits_per_symbol; ++b) {
+			bits[b] = '0' + ((label >> (m_bits_per_symbol - 1 - b)) & 1);
+		}
+		myPrint("  {}: drive ({:3}, {:3}, {:3}) received ({:.3f}, {:.3f}, {:.3f})", bits,
+			m_drive[label][0], m_drive[label][1], m_drive[label][2], m_received[label][0], m_received[label][1], m_received[label][2]);
+	}
+}
+
+uint32_t chooseBitsPerSymbol(const ReceiverColorModel& model, double noise_sigma, double max_symbol_error_rate, uint32_t max_bits)
+{
+	uint32_t chosen = 0;
+	for (uint32_t bits = 1; bits <= std::min(max_bits, 8U); ++bits) {
+		if (Constellation::design(model, bits).estimateSymbolErrorRate(noise_sigma) > max_symbol_error_rate) {
+			break;
+		}
+		chosen = bits;
+	}
+	return chosen;
+}
\ No newline at end of file
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+
+#include <array>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+// A color as the receiver measures it, roughly 0 to 1 per receiver channel
+using ReceivedColor = std::array<float, 3>;
+
+// Drive values sent to an LED
+using DriveColor = std::array<uint8_t, 3>;
+
+// What the receiver measures for each drive color, interpolated trilinearly from a grid of drive colors
+class ReceiverColorModel {
+	std::array<std::vector<uint8_t>, 3> m_levels{}; // grid drive levels along R, G and B, ascending
+	std::vector<ReceivedColor> m_grid{}; // R slowest, B fastest
+
+public:
+	// Each channel's light output is (drive / 255)^gamma, and drive channel c adds that much of mixing[c] to the received
+	// color. The default is a receiver whose channels match the LEDs' exactly, sensor crosstalk goes in mixing.
+	static ReceiverColorModel modelled(double gamma = 2.2, const std::array<ReceivedColor, 3>& mixing = { { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } } });
+
+	// "<r> <g> <b> <measured 0> <measured 1> <measured 2>" lines, the drive colors have to form a full grid
+	// (e.g. the 512 colors of calibrationTransmit()). Lines starting with # are skipped.
+	static std::optional<ReceiverColorModel> load(const std::filesystem::path& path);
+
+	ReceivedColor map(const DriveColor& drive) const;
+};
+
+struct ConstellationDesignOptions {
+	uint32_t candidate_levels = 18; // drive levels per channel the points are picked from
+	uint32_t max_moves = 4096; // point moves allowed while spreading the points out
+	uint32_t label_restarts = 4; // random starting labelings tried besides the one from point order
+};
+
+// An M-ary color alphabet (M = 2^bits_per_symbol, up to 256) with lookup tables for both directions.
+// Points are spread to maximise the minimum distance between any two of them in the receiver's color space, then given
+// labels so that close points differ in as few bits as possible: the symbol errors noise actually causes, between
+// neighbours, then cost as close to one bit each as the geometry allows, like a Gray code does for a ramp.
+class Constellation {
+public:
+	static constexpr uint32_t DEMOD_GRID_SIZE = 32; // cells per receiver channel in the demodulation grid
+
+private:
+	uint32_t m_bits_per_symbol = 0;
+	std::vector<DriveColor> m_drive{}; // by label
+	std::vector<ReceivedColor> m_received{}; // by label
+	float m_min_distance = 0.0f;
+
+	ReceivedColor m_grid_origin{};
+	ReceivedColor m_grid_scale{}; // cells per unit
+	// labels that are nearest to some color in each cell (channel 0 slowest) are
+	// m_cell_candidates[m_cell_start[cell]] up to m_cell_candidates[m_cell_start[cell + 1]]
+	std::vector<uint32_t> m_cell_start{};
+	std::vector<uint8_t> m_cell_candidates{};
+
+	void buildDemodTable();
+
+public:
+	static Constellation design(const ReceiverColorModel& model, uint32_t bits_per_symbol, const ConstellationDesignOptions& options = {});
+
+	uint32_t getBitsPerSymbol() const { return m_bits_per_symbol; }
+
+	uint32_t getSize() const { return static_cast<uint32_t>(m_drive.size()); }
+
+	// Smallest distance between two points in the receiver's color space
+	float getMinDistance() const { return m_min_distance; }
+
+	// Modulation table, the drive color of every label
+	std::span<const DriveColor> getDriveColors() const { return m_drive; }
+
+	// Where the model expects each label to be received. Replace with the means of measured symbols when available.
+	std::span<const ReceivedColor> getReceivedColors() const { return m_received; }
+
+	void setReceivedColors(std::span<const ReceivedColor> received);
+
+	const DriveColor& modulate(uint32_t label) const { return m_drive[label]; }
+
+	// Nearest label, the same as demodulateExact() but only compared against the few points that can be nearest
+	// somewhere in the grid cell the color falls in
+	uint32_t demodulate(const ReceivedColor& color) const;
+
+	// Nearest label by comparing against every point
+	uint32_t demodulateExact(const ReceivedColor& color) const;
+
+	// Soft values (0 certain 0, 255 certain 1) of each bit of the label, most significant first, for ViterbiDecoder.
+	// Like pamSoftBits(), each bit compares the nearest point with that bit clear against the nearest with it set.
+	void softBits(const ReceivedColor& color, uint8_t* out) const;
+
+	// Union bound on the symbol error rate with Gaussian noise of noise_sigma per receiver channel
+	double estimateSymbolErrorRate(double noise_sigma) const;
+
+	// Expected wrong bits per symbol error, 1 for a perfect Gray labeling
+	double getBitsPerNeighbourError() const;
+
+	void report() const;
+};
+
+// The most bits per symbol (up to max_bits) whose designed constellation stays under max_symbol_error_rate at noise_sigma,
+// 0 if even 1 bit doesn't
+uint32_t chooseBitsPerSymbol(const ReceiverColorModel& model, double noise_sigma, double max_symbol_error_rate, uint32_t max_bits = 8);
\ No newline at end of file
@@ -0,0 +1,253 @@
+#include "convolutional_code.h"
+
+#include <cassert>
+#include <cmath>
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+#include <immintrin.h>
+
+constexpr uint8_t SOFT_UNKNOWN = 128;
+constexpr uint32_t STATES_PER_VECTOR = 8; // 16-bit metrics in an SSE2 register
+constexpr size_t TRACEBACK_CHUNK = 4096; // steps decided per traceback
+
+double ConvolutionalCode::getRate() const
+{
+	if (puncture_pattern.empty()) {
+		return 1.0 / static_cast<double>(generators.size());
+	}
+	// a pattern period covers pattern.size() / n input bits
+	const auto kept = std::count(puncture_pattern.begin(), puncture_pattern.end(), static_cast<uint8_t>(1));
+	return static_cast<double>(puncture_pattern.size()) / static_cast<double>(generators.size()) / static_cast<double>(kept);
+}
+
+ConvolutionalCode ConvolutionalCode::rate1of2()
+{
+	return ConvolutionalCode{ .constraint_length = 7, .generators = { 0171, 0133 } };
+}
+
+ConvolutionalCode ConvolutionalCode::rate1of3()
+{
+	return ConvolutionalCode{ .constraint_length = 7, .generators = { 0133, 0171, 0165 } };
+}
+
+ConvolutionalCode ConvolutionalCode::rate2of3()
+{
+	return ConvolutionalCode{ .constraint_length = 7, .generators = { 0171, 0133 }, .puncture_pattern = { 1, 1, 1, 0 } };
+}
+
+ConvolutionalCode ConvolutionalCode::rate3of4()
+{
+	return ConvolutionalCode{ .constraint_length = 7, .generators = { 0171, 0133 }, .puncture_pattern = { 1, 1, 0, 1, 1, 0 } };
+}
+
+static bool isKept(const ConvolutionalCode& code, size_t symbol_index)
+{
+	return code.puncture_pattern.empty() || code.puncture_pattern[symbol_index % code.puncture_pattern.size()] != 0;
+}
+
+static uint32_t branchOutput(const ConvolutionalCode& code, uint32_t shift_register, uint32_t output)
+{
+	return static_cast<uint32_t>(std::popcount(shift_register & code.generators[output])) & 1;
+}
+
+size_t convolutionalEncodedLength(const ConvolutionalCode& code, size_t num_bits)
+{
+	const size_t full_length = (num_bits + code.constraint_length - 1) * code.generators.size();
+	size_t length = 0;
+	for (size_t i = 0; i < full_length; ++i) {
+		length += isKept(code, i);
+	}
+	return length;
+}
+
+std::vector<uint8_t> convolutionalEncode(const ConvolutionalCode& code, std::span<const uint8_t> bits)
+{
+	const uint32_t register_mask = (1U << code.constraint_length) - 1;
+	const size_t num_steps = bits.size() + code.constraint_length - 1;
+
+	std::vector<uint8_t> out{};
+	out.reserve(convolutionalEncodedLength(code, bits.size()));
+	uint32_t shift_register = 0;
+	size_t symbol_index = 0;
+	for (size_t step = 0; step < num_steps; ++step) {
+		const uint32_t bit = step < bits.size() ? (bits[step] & 1) : 0;
+		shift_register = ((shift_register << 1) | bit) & register_mask;
+		for (uint32_t i = 0; i < code.generators.size(); ++i) {
+			if (isKept(code, symbol_index++)) {
+				out.push_back(static_cast<uint8_t>(branchOutput(code, shift_register, i)));
+			}
+		}
+	}
+	return out;
+}
+
+// Butterfly j joins the predecessors j (lower) and j + states / 2 (upper) into the new states 2j (input 0) and 2j + 1 (input 1)
+enum Branch : uint32_t {
+	LOWER_0,
+	UPPER_0,
+	LOWER_1,
+	UPPER_1,
+	NUM_BRANCHES
+};
+
+ViterbiDecoder::ViterbiDecoder(const ConvolutionalCode& code)
+	: m_code(code), m_num_states(1U << (code.constraint_length - 1)), m_num_outputs(static_cast<uint32_t>(code.generators.size()))
+{
+	assert(code.constraint_length >= 5 && code.constraint_length <= 9);
+	assert(m_num_outputs >= 2 && m_num_outputs <= 4);
+
+	const uint32_t half = m_num_states / 2;
+	m_expected.resize(static_cast<size_t>(NUM_BRANCHES) * m_num_outputs * half);
+	for (uint32_t branch = 0; branch < NUM_BRANCHES; ++branch) {
+		const uint32_t input = branch >= LOWER_1 ? 1 : 0;
+		const uint32_t upper = (branch == UPPER_0 || branch == UPPER_1) ? half : 0;
+		for (uint32_t output = 0; output < m_num_outputs; ++output) {
+			for (uint32_t j = 0; j < half; ++j) {
+				const uint32_t shift_register = ((j + upper) << 1) | input;
+				m_expected[(static_cast<size_t>(branch) * m_num_outputs + output) * half + j] = branchOutput(code, shift_register, output) ? 255 : 0;
+			}
+		}
+	}
+}
+
+std::vector<uint8_t> ViterbiDecoder::decode(std::span<const uint8_t> soft) const
+{
+	// put back what puncturing dropped as unknowns
+	std::vector<uint8_t> symbols{};
+	symbols.reserve(m_code.puncture_pattern.empty() ? soft.size() : soft.size() * 2);
+	for (size_t consumed = 0, i = 0; consumed < soft.size(); ++i) {
+		symbols.push_back(isKept(m_code, i) ? soft[consumed++] : SOFT_UNKNOWN);
+	}
+	while (symbols.size() % m_num_outputs != 0) {
+		symbols.push_back(SOFT_UNKNOWN);
+	}
+
+	const size_t num_steps = symbols.size() / m_num_outputs;
+	const uint32_t tail = m_code.constraint_length - 1;
+	if (num_steps <= tail) {
+		return {};
+	}
+
+	const uint32_t half = m_num_states / 2;
+	const uint32_t num_vectors = half / STATES_PER_VECTOR;
+	const size_t traceback_depth = 16 * m_code.constraint_length; // plenty even for punctured codes
+
+	std::vector<uint8_t> bits(num_steps);
+
+	// one 16-bit mask per vector of butterflies: the low 8 bits for the even new states, the high 8 for the odd ones
+	std::vector<uint16_t> decisions{};
+	decisions.reserve((TRACEBACK_CHUNK + traceback_depth) * num_vectors);
+	size_t first_stored_step = 0;
+
+	std::vector<int16_t> metrics(m_num_states, std::numeric_limits<int16_t>::max() / 4);
+	std::vector<int16_t> next_metrics(m_num_states);
+	metrics[0] = 0; // the encoder starts in state 0
+
+	// Writes the decided input bits of steps first_stored_step to last_step by following survivors back from end_state
+	const auto traceback = [&](size_t last_step, uint32_t end_state, size_t num_to_output) {
+		uint32_t state = end_state;
+		for (size_t step = last_step + 1; step-- > first_stored_step;) {
+			const size_t offset = step - first_stored_step;
+			if (offset < num_to_output) {
+				bits[step] = static_cast<uint8_t>(state & 1);
+			}
+			const uint32_t j = state >> 1;
+			const uint16_t mask = decisions[offset * num_vectors + j / STATES_PER_VECTOR];
+			const uint32_t decision = (mask >> ((j % STATES_PER_VECTOR) + (state & 1) * STATES_PER_VECTOR)) & 1;
+			state = j + decision * half;
+		}
+		};
+
+	for (size_t step = 0; step < num_steps; ++step) {
+		__m128i received[4]{};
+		for (uint32_t output = 0; output < m_num_outputs; ++output) {
+			received[output] = _mm_set1_epi16(symbols[step * m_num_outputs + output]);
+		}
+
+		for (uint32_t v = 0; v < num_vectors; ++v) {
+			const uint32_t j = v * STATES_PER_VECTOR;
+			// |soft - expected| is soft ^ expected when expected is 0 or 255
+			__m128i branch_metric[NUM_BRANCHES];
+			for (uint32_t branch = 0; branch < NUM_BRANCHES; ++branch) {
+				__m128i sum = _mm_setzero_si128();
+				for (uint32_t output = 0; output < m_num_outputs; ++output) {
+					const __m128i expected = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_expected[(static_cast<size_t>(branch) * m_num_outputs + output) * half + j]));
+					sum = _mm_add_epi16(sum, _mm_xor_si128(received[output], expected));
+				}
+				branch_metric[branch] = sum;
+			}
+
+			const __m128i lower = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&metrics[j]));
+			const __m128i upper = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&metrics[j + half]));
+			const __m128i lower_0 = _mm_add_epi16(lower, branch_metric[LOWER_0]);
+			const __m128i upper_0 = _mm_add_epi16(upper, branch_metric[UPPER_0]);
+			const __m128i lower_1 = _mm_add_epi16(lower, branch_metric[LOWER_1]);
+			const __m128i upper_1 = _mm_add_epi16(upper, branch_metric[UPPER_1]);
+
+			// ties go to the lower predecessor
+			const __m128i even = _mm_min_epi16(lower_0, upper_0);
+			const __m128i odd = _mm_min_epi16(lower_1, upper_1);
+			const __m128i even_decision = _mm_cmpgt_epi16(lower_0, upper_0);
+			const __m128i odd_decision = _mm_cmpgt_epi16(lower_1, upper_1);
+			decisions.push_back(static_cast<uint16_t>(_mm_movemask_epi8(_mm_packs_epi16(even_decision, odd_decision))));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&next_metrics[j * 2]), _mm_unpacklo_epi16(even, odd));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&next_metrics[j * 2 + STATES_PER_VECTOR]), _mm_unpackhi_epi16(even, odd));
+		}
+
+		// keep metrics relative to state 0 so they stay well inside 16 bits
+		const __m128i reference = _mm_set1_epi16(next_metrics[0]);
+		for (uint32_t s = 0; s < m_num_states; s += STATES_PER_VECTOR) {
+			const __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&next_metrics[s]));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&metrics[s]), _mm_sub_epi16(m, reference));
+		}
+
+		// once enough steps are stored, the oldest chunk has merged into a single survivor from any end state
+		const size_t stored_steps = step + 1 - first_stored_step;
+		if (stored_steps == TRACEBACK_CHUNK + traceback_depth) {
+			const uint32_t best_state = static_cast<uint32_t>(std::min_element(metrics.begin(), metrics.end()) - metrics.begin());
+			traceback(step, best_state, TRACEBACK_CHUNK);
+			decisions.erase(decisions.begin(), decisions.begin() + TRACEBACK_CHUNK * num_vectors);
+			first_stored_step += TRACEBACK_CHUNK;
+		}
+	}
+
+	// terminated, so the path ends in state 0
+	traceback(num_steps - 1, 0, num_steps - first_stored_step);
+	bits.resize(num_steps - tail);
+	return bits;
+}
+
+uint8_t softBitFromLevel(double measured, double level_0, double level_1)
+{
+	if (level_1 == level_0) {
+		return SOFT_UNKNOWN;
+	}
+	const double t = std::clamp((measured - level_0) / (level_1 - level_0), 0.0, 1.0);
+	return static_cast<uint8_t>(std::lround(t * 255.0));
+}
+
+void pamSoftBits(double measured, std::span<const double> level_means, uint32_t bits_per_symbol, uint8_t* out)
+{
+	assert(level_means.size() == (size_t{ 1 } << bits_per_symbol));
+
+	const auto [min_level, max_level] = std::minmax_element(level_means.begin(), level_means.end());
+	const double spacing = (*max_level - *min_level) / static_cast<double>(level_means.size() - 1);
+
+	for (uint32_t b = 0; b < bits_per_symbol; ++b) {
+		const uint32_t bit_mask = 1U << (bits_per_symbol - 1 - b);
+		double nearest_0 = std::numeric_limits<double>::infinity();
+		double nearest_1 = std::numeric_limits<double>::infinity();
+		for (uint32_t value = 0; value < level_means.size(); ++value) {
+			const double distance = std::abs(measured - level_means[value]);
+			double& nearest = (value & bit_mask) ? nearest_1 : nearest_0;
+			nearest = std::min(nearest, distance);
+		}
+		// a full level spacing closer to one side is treated as certain
+		const double t = spacing > 0.0 ? std::clamp(0.5 + (nearest_0 - nearest_1) / (2.0 * spacing), 0.0, 1.0) : 0.5;
+		out[b] = static_cast<uint8_t>(std::lround(t * 255.0));
+	}
+}
\ No newline at end of file
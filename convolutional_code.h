@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+#include <span>
+#include <vector>
+
+// A rate 1/n convolutional code, optionally punctured to a higher rate.
+// The shift register holds the newest input bit in bit 0, output i is the parity of (register & generators[i]).
+// Encoding is terminated with constraint_length - 1 zero bits so the decoder knows the final state.
+struct ConvolutionalCode {
+	uint32_t constraint_length; // 5 to 9
+	std::vector<uint32_t> generators; // 2 to 4 of them
+	std::vector<uint8_t> puncture_pattern{}; // repeating keep (1) / drop (0) mask over the output symbols, empty keeps everything
+
+	double getRate() const;
+
+	// K = 7 (171, 133), the usual industry standard code
+	static ConvolutionalCode rate1of2();
+	static ConvolutionalCode rate1of3();
+	// rate 1/2 punctured
+	static ConvolutionalCode rate2of3();
+	static ConvolutionalCode rate3of4();
+};
+
+// Bits are one per byte (0 or 1), the output is what gets transmitted (punctured)
+std::vector<uint8_t> convolutionalEncode(const ConvolutionalCode& code, std::span<const uint8_t> bits);
+
+// Number of symbols convolutionalEncode() produces for num_bits input bits
+size_t convolutionalEncodedLength(const ConvolutionalCode& code, size_t num_bits);
+
+// Soft-decision Viterbi decoder.
+// Soft symbols are 0 (certainly a 0) to 255 (certainly a 1), 128 means no idea. Branch metrics are the distance
+// between those and the expected symbols, so a symbol the receiver wasn't sure about barely influences the path.
+// Add-compare-select runs 8 states per SSE2 instruction with 16-bit path metrics, and survivors are traced back
+// in chunks so memory use doesn't grow with the length of the capture.
+class ViterbiDecoder {
+	ConvolutionalCode m_code;
+	uint32_t m_num_states;
+	uint32_t m_num_outputs;
+	// per butterfly branch (lower/upper predecessor, input 0/1) and per output: 255 where that output is a 1, else 0, one int16 per butterfly
+	std::vector<int16_t> m_expected{};
+
+public:
+	explicit ViterbiDecoder(const ConvolutionalCode& code);
+
+	// soft holds one value per transmitted symbol of a whole terminated transmission, returns the decoded bits
+	std::vector<uint8_t> decode(std::span<const uint8_t> soft) const;
+};
+
+// Soft value of an on/off keyed bit that measured in between level_0 and level_1
+uint8_t softBitFromLevel(double measured, double level_0, double level_1);
+
+// Soft values of the bits (most significant first) of a PAM symbol, level_means[v] is what symbol value v measures as.
+// Each bit compares the nearest level with that bit clear against the nearest level with it set.
+void pamSoftBits(double measured, std::span<const double> level_means, uint32_t bits_per_symbol, uint8_t* out);
\ No newline at end of file
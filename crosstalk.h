@@ -6,5 +6,7 @@
 #include <iCUESDK/iCUESDK.h>
 
 #include "leds.h"
+#include "transfer_function.h"
 
-void crosstalkTransmit(const CorsairDeviceId* device_id, Leds& leds);
\ No newline at end of file
+// response shapes the blue ramp, e.g. makeGammaCurve(2.0) or makeGammaCurve(3.0) for a square or cube law
+void crosstalkTransmit(const CorsairDeviceId* device_id, Leds& leds, const TransferCurve& response = makeIdentityCurve());
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "differential_modulation.h"
+
+#include <cassert>
+#include <cmath>
+
+#include <algorithm>
+
+static uint32_t toGray(uint32_t value)
+{
+	return value ^ (value >> 1);
+}
+
+static uint32_t fromGray(uint32_t gray)
+{
+	uint32_t value = 0;
+	for (; gray; gray >>= 1) {
+		value ^= gray;
+	}
+	return value;
+}
+
+DifferentialModulator::DifferentialModulator(uint32_t bits_per_symbol) : m_bits_per_symbol(bits_per_symbol)
+{
+	assert(bits_per_symbol >= 1 && bits_per_symbol <= 6);
+}
+
+size_t DifferentialModulator::getNumFrames(uint32_t bits_per_symbol, size_t num_bits)
+{
+	return TRAINING_FRAMES + (num_bits + bits_per_symbol - 1) / bits_per_symbol;
+}
+
+std::vector<uint8_t> DifferentialModulator::modulate(std::span<const uint8_t> bits)
+{
+	const uint32_t num_levels = getNumLevels();
+	const auto drive = [&](uint32_t level) {
+		return static_cast<uint8_t>((level * 255 + (num_levels - 1) / 2) / (num_levels - 1));
+		};
+
+	std::vector<uint8_t> frames{};
+	frames.reserve(getNumFrames(m_bits_per_symbol, bits.size()));
+	for (uint32_t i = 0; i < TRAINING_FRAMES; ++i) {
+		m_level = (i & 1) ? num_levels - 1 : 0;
+		frames.push_back(drive(m_level));
+	}
+	for (size_t start = 0; start < bits.size(); start += m_bits_per_symbol) {
+		uint32_t symbol = 0;
+		for (uint32_t b = 0; b < m_bits_per_symbol; ++b) {
+			symbol = (symbol << 1) | (start + b < bits.size() ? bits[start + b] & 1 : 0);
+		}
+		m_level = (m_level + fromGray(symbol)) % num_levels;
+		frames.push_back(drive(m_level));
+	}
+	return frames;
+}
+
+DifferentialDemodulator::DifferentialDemodulator(uint32_t bits_per_symbol, double tracking_rate)
+	: m_bits_per_symbol(bits_per_symbol), m_tracking_rate(tracking_rate)
+{
+	assert(bits_per_symbol >= 1 && bits_per_symbol <= 6);
+}
+
+void DifferentialDemodulator::demodulate(std::span<const float> measured, std::vector<uint8_t>& out)
+{
+	const int32_t num_levels = 1 << m_bits_per_symbol;
+
+	for (const float value : measured) {
+		const double delta = static_cast<double>(value) - m_previous;
+		m_previous = value;
+		const uint32_t frame = m_frames_seen++;
+		if (frame == 0) {
+			continue;
+		}
+
+		if (frame < DifferentialModulator::TRAINING_FRAMES) {
+			// every training transition is a full swing, average them
+			const double step = std::abs(delta) / (num_levels - 1);
+			m_step += (step - m_step) / frame;
+			continue;
+		}
+
+		// the level moved by steps, the symbol is that modulo the number of levels
+		const int32_t steps = m_step > 0.0 ? static_cast<int32_t>(std::clamp<double>(std::round(delta / m_step), -(num_levels - 1), num_levels - 1)) : 0;
+		if (steps != 0) {
+			// decision directed: a move of several levels says the most about the spacing
+			const double weight = m_tracking_rate * std::abs(steps) / (num_levels - 1);
+			m_step += weight * (delta / steps - m_step);
+		}
+		const uint32_t symbol = toGray(static_cast<uint32_t>((steps + num_levels) % num_levels));
+		for (uint32_t b = m_bits_per_symbol; b-- > 0;) {
+			out.push_back((symbol >> b) & 1);
+		}
+	}
+}
\ No newline at end of file
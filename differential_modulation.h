@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+#include <span>
+#include <vector>
+
+// Differential brightness modulation for one key. The key steps through 2^bits_per_symbol evenly spaced levels and each
+// symbol is how many levels it moved since the previous frame, modulo the number of levels, so the receiver only ever
+// compares a frame with the one before it. A slowly drifting offset (room lighting) cancels out entirely and a drifting
+// gain (camera exposure) is followed by the demodulator from its own decisions, so no absolute calibration is needed.
+// The price is noise from two measurements in every decision, about 3 dB compared to absolute levels.
+// Symbols are Gray coded around the cycle so a decision off by one level costs one bit.
+// Levels are evenly spaced in drive value, set a transfer function on Leds if the LEDs aren't linear.
+class DifferentialModulator {
+public:
+	// Frames at the start alternating between the lowest and highest level, the demodulator learns the level spacing from them
+	static constexpr uint32_t TRAINING_FRAMES = 6;
+
+private:
+	uint32_t m_bits_per_symbol;
+	uint32_t m_level = 0;
+
+public:
+	explicit DifferentialModulator(uint32_t bits_per_symbol);
+
+	uint32_t getNumLevels() const { return 1U << m_bits_per_symbol; }
+
+	// Frames for bits (one per byte, MSB first into each symbol, padded with zeros to whole symbols), training included
+	static size_t getNumFrames(uint32_t bits_per_symbol, size_t num_bits);
+
+	// Drive value (0-255) of every frame, starting with the training frames
+	std::vector<uint8_t> modulate(std::span<const uint8_t> bits);
+};
+
+class DifferentialDemodulator {
+	uint32_t m_bits_per_symbol;
+	double m_tracking_rate;
+	double m_step = 0.0; // measured brightness per level
+	float m_previous = 0.0f;
+	uint32_t m_frames_seen = 0;
+
+public:
+	// tracking_rate is how quickly the level spacing estimate follows changes in gain, per symbol
+	explicit DifferentialDemodulator(uint32_t bits_per_symbol, double tracking_rate = 0.05);
+
+	// measured is the receiver's brightness reading of the key, one per frame from the first training frame on, in any
+	// units and with any offset. Can be called piece by piece. Appends bits_per_symbol bits per data frame to out.
+	void demodulate(std::span<const float> measured, std::vector<uint8_t>& out);
+
+	// Current estimate of the measured brightness between adjacent levels
+	double getStep() const { return m_step; }
+};
\ No newline at end of file
@@ -1,43 +1,118 @@
 #pragma once
 
 #include <cassert>
+#include <cmath>
 #include <cstdint>
 
-#include <Windows.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
 
-inline void waitTil(LARGE_INTEGER until)
-{
-	// Busy-waits to avoid oversleeping
-	LARGE_INTEGER now{};
-	do {
-		QueryPerformanceCounter(&now);
-	} while (now.QuadPart < until.QuadPart);
-}
+#include <immintrin.h>
+
+#include "my_print.h"
+
+using LoopClock = std::chrono::steady_clock;
+
+// Sleeps for as long as it safely can then busy-waits for the rest.
+// Keeps a running estimate of how long a short sleep really takes (mean + 1 stddev) so it adapts to the OS timer resolution,
+// which is ~1 ms on Linux and anywhere up to 15.6 ms on Windows.
+class PreciseWaiter {
+	static constexpr std::chrono::nanoseconds SLEEP_CHUNK{ 1'000'000 };
+
+	double m_mean_ns = 5'000'000.0; // pessimistic until measured
+	double m_m2 = 0.0;
+	int64_t m_count = 1;
+	double m_estimate_ns = 5'000'000.0;
+
+	void updateEstimate(double observed_ns)
+	{
+		// Welford's online variance
+		++m_count;
+		const double delta = observed_ns - m_mean_ns;
+		m_mean_ns += delta / static_cast<double>(m_count);
+		m_m2 += delta * (observed_ns - m_mean_ns);
+		m_estimate_ns = m_mean_ns + std::sqrt(m_m2 / static_cast<double>(m_count - 1));
+	}
+
+public:
+	void waitUntil(LoopClock::time_point deadline)
+	{
+		auto now = LoopClock::now();
+		while (static_cast<double>((deadline - now).count()) > m_estimate_ns) {
+			std::this_thread::sleep_for(SLEEP_CHUNK);
+			const auto after = LoopClock::now();
+			updateEstimate(static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(after - now).count()));
+			now = after;
+		}
+
+		// Busy-waits the final slice to avoid oversleeping
+		while (LoopClock::now() < deadline) {
+			_mm_pause();
+		}
+	}
+};
 
-// Adds a number of microseconds to a performance counter value
-inline LARGE_INTEGER addMicroseconds(LARGE_INTEGER timeline, int64_t microseconds)
+struct FixedUpdateLoopStats {
+	std::chrono::nanoseconds period{};
+	std::vector<int64_t> lateness_ns{}; // how long after its deadline each iteration actually started
+	int overruns = 0; // iterations that were still running when the next one was due
+};
+
+inline void reportFixedUpdateLoopStats(const FixedUpdateLoopStats& stats)
 {
-	static int64_t s_counts_per_microsecond{};
-	if (!s_counts_per_microsecond) {
-		LARGE_INTEGER freq{};
-		QueryPerformanceFrequency(&freq);
-		assert(freq.QuadPart > 1'000'000LL);
-		s_counts_per_microsecond = freq.QuadPart / 1'000'000LL;
+	if (stats.lateness_ns.empty()) {
+		return;
+	}
+	std::vector<int64_t> sorted = stats.lateness_ns;
+	std::sort(sorted.begin(), sorted.end());
+	int64_t total = 0;
+	for (const int64_t lateness : sorted) {
+		total += lateness;
 	}
-	return LARGE_INTEGER{ .QuadPart = timeline.QuadPart + (microseconds * s_counts_per_microsecond) };
+	const auto percentile = [&](double p) {
+		return sorted[static_cast<size_t>(p * static_cast<double>(sorted.size() - 1))];
+		};
+	myPrint("Loop: {} iterations, period {} us, lateness mean {} us, p99 {} us, max {} us, {} overruns",
+		sorted.size(), stats.period.count() / 1000, total / static_cast<int64_t>(sorted.size()) / 1000,
+		percentile(0.99) / 1000, sorted.back() / 1000, stats.overruns);
 }
 
+// Calls func(i) for i in [0, iterations) with the start of each call aligned to start + i * period.
+// Deadlines are absolute so lateness in one iteration never accumulates into the following ones.
 template<typename Func>
-inline void startFixedUpdateLoop(int iterations, int64_t period_microseconds, Func&& func)
+inline FixedUpdateLoopStats startFixedUpdateLoop(int iterations, std::chrono::nanoseconds period, Func&& func)
 {
-	LARGE_INTEGER timeline{};
-	QueryPerformanceCounter(&timeline);
+	assert(period.count() > 0);
+
+	FixedUpdateLoopStats stats{};
+	stats.period = period;
+	stats.lateness_ns.reserve(static_cast<size_t>(std::max(iterations, 0)));
+
+	PreciseWaiter waiter{};
+	const LoopClock::time_point start = LoopClock::now();
 	for (int i = 0; i < iterations; ++i) {
 
+		const auto deadline = start + period * i;
+		stats.lateness_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(LoopClock::now() - deadline).count());
+
 		func(i);
 
-		timeline = addMicroseconds(timeline, period_microseconds);
-		waitTil(timeline);
+		const auto next_deadline = start + period * (i + 1);
+		if (LoopClock::now() > next_deadline) {
+			++stats.overruns;
+		}
+		waiter.waitUntil(next_deadline);
 
 	}
+
+	reportFixedUpdateLoopStats(stats);
+	return stats;
+}
+
+template<typename Func>
+inline FixedUpdateLoopStats startFixedUpdateLoop(int iterations, int64_t period_microseconds, Func&& func)
+{
+	return startFixedUpdateLoop(iterations, std::chrono::nanoseconds(period_microseconds * 1'000LL), std::forward<Func>(func));
 }
\ No newline at end of file
@@ -0,0 +1,175 @@
+#include "flush_tracker.h"
+
+#include <cassert>
+
+#include <algorithm>
+#include <chrono>
+
+#include <immintrin.h>
+
+#include "corsair_helpers.h"
+#include "my_print.h"
+
+static int64_t nowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FlushTracker::FlushTracker()
+{
+	for (Slot& slot : m_slots) {
+		slot.tracker = this;
+	}
+}
+
+void FlushTracker::onFlushComplete(void* context, CorsairError error)
+{
+	const int64_t callback_time_ns = nowNs();
+	CHECKCORSAIR(error);
+
+	assert(context);
+	Slot& slot = *reinterpret_cast<Slot*>(context);
+	FlushTracker& tracker = *slot.tracker;
+
+	tracker.m_latency.record(static_cast<uint64_t>(std::max<int64_t>(0, callback_time_ns - slot.submit_time_ns)));
+
+	const uint64_t completed = slot.sequence + 1;
+	uint64_t highest = tracker.m_highest_completed.load(std::memory_order_relaxed);
+	if (completed < highest) {
+		tracker.m_num_out_of_order.fetch_add(1, std::memory_order_relaxed);
+	}
+	while (completed > highest && !tracker.m_highest_completed.compare_exchange_weak(highest, completed, std::memory_order_relaxed)) {
+	}
+
+	tracker.m_last_completion_ns.store(callback_time_ns, std::memory_order_release);
+	slot.in_flight.store(false, std::memory_order_release);
+	// seq_cst pairs with the waiter registering itself before it re-checks the count, so a wakeup can't be lost
+	tracker.m_num_in_flight.fetch_sub(1, std::memory_order_seq_cst);
+	if (tracker.m_num_waiters.load(std::memory_order_seq_cst) != 0) {
+		tracker.m_num_in_flight.notify_all();
+	}
+}
+
+template<typename Pred>
+void FlushTracker::waitUntil(Pred done) const
+{
+	uint32_t in_flight = m_num_in_flight.load(std::memory_order_acquire);
+	if (done(in_flight)) {
+		return;
+	}
+
+	if (m_wait_strategy != FlushWaitStrategy::Block) {
+		const auto spin_end = std::chrono::steady_clock::now() + m_spin_duration;
+		uint32_t spins = 0;
+		while (!done(in_flight)) {
+			_mm_pause(); // designed for spinning on an atomic variable (like here)
+			in_flight = m_num_in_flight.load(std::memory_order_acquire);
+			// reading the clock costs far more than a pause so only check it now and then
+			if (m_wait_strategy == FlushWaitStrategy::SpinThenBlock && (++spins & 63) == 0 && std::chrono::steady_clock::now() >= spin_end) {
+				break;
+			}
+		}
+		if (done(in_flight)) {
+			return;
+		}
+	}
+
+	m_num_waiters.fetch_add(1, std::memory_order_seq_cst);
+	in_flight = m_num_in_flight.load(std::memory_order_seq_cst);
+	while (!done(in_flight)) {
+		m_num_in_flight.wait(in_flight, std::memory_order_acquire);
+		in_flight = m_num_in_flight.load(std::memory_order_acquire);
+	}
+	m_num_waiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void FlushTracker::setMaxOutstanding(uint32_t max_outstanding)
+{
+	assert(max_outstanding >= 1 && max_outstanding <= MAX_OUTSTANDING);
+	assert(m_num_in_flight.load(std::memory_order_relaxed) == 0);
+	m_max_outstanding = std::clamp(max_outstanding, 1U, MAX_OUTSTANDING);
+}
+
+void FlushTracker::setWaitStrategy(FlushWaitStrategy strategy, std::chrono::nanoseconds spin_duration)
+{
+	assert(m_num_waiters.load(std::memory_order_relaxed) == 0);
+	m_wait_strategy = strategy;
+	m_spin_duration = spin_duration;
+}
+
+bool FlushTracker::hasFreeSlot() const
+{
+	return m_num_in_flight.load(std::memory_order_acquire) < m_max_outstanding;
+}
+
+void FlushTracker::waitForFreeSlot() const
+{
+	waitUntil([this](uint32_t in_flight) { return in_flight < m_max_outstanding; });
+}
+
+void FlushTracker::waitForAll() const
+{
+	waitUntil([](uint32_t in_flight) { return in_flight == 0; });
+}
+
+FlushTracker::Ticket FlushTracker::beginFlush()
+{
+	assert(hasFreeSlot());
+
+	// Completions can arrive out of order so the slot after the last one used isn't necessarily free
+	Slot* free_slot = nullptr;
+	for (Slot& slot : m_slots) {
+		if (!slot.in_flight.load(std::memory_order_acquire)) {
+			free_slot = &slot;
+			break;
+		}
+	}
+	assert(free_slot);
+
+	free_slot->sequence = m_next_sequence++;
+	free_slot->submit_time_ns = nowNs();
+	free_slot->in_flight.store(true, std::memory_order_relaxed);
+	m_num_in_flight.fetch_add(1, std::memory_order_acq_rel);
+
+	return Ticket{ .callback = onFlushComplete, .context = free_slot, .sequence = free_slot->sequence };
+}
+
+void FlushTracker::recordTick()
+{
+	m_num_ticks.fetch_add(1, std::memory_order_relaxed);
+	if (!hasFreeSlot()) {
+		m_num_busy_ticks.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void FlushTracker::resetTelemetry()
+{
+	m_latency.reset();
+	m_num_ticks.store(0, std::memory_order_relaxed);
+	m_num_busy_ticks.store(0, std::memory_order_relaxed);
+	m_num_out_of_order.store(0, std::memory_order_relaxed);
+}
+
+FlushTelemetry FlushTracker::getTelemetry() const
+{
+	return FlushTelemetry{
+		.flushes = m_latency.count(),
+		.ticks = m_num_ticks.load(std::memory_order_relaxed),
+		.busy_ticks = m_num_busy_ticks.load(std::memory_order_relaxed),
+		.out_of_order = m_num_out_of_order.load(std::memory_order_relaxed),
+		.latency_p50_ns = m_latency.percentile(0.5),
+		.latency_p90_ns = m_latency.percentile(0.9),
+		.latency_p99_ns = m_latency.percentile(0.99),
+		.latency_max_ns = m_latency.max(),
+	};
+}
+
+void FlushTracker::reportTelemetry() const
+{
+	const FlushTelemetry telemetry = getTelemetry();
+	myPrint("Flush latency over {} flushes: p50 {} us, p90 {} us, p99 {} us, max {} us",
+		telemetry.flushes, telemetry.latency_p50_ns / 1000, telemetry.latency_p90_ns / 1000,
+		telemetry.latency_p99_ns / 1000, telemetry.latency_max_ns / 1000);
+	myPrint("{} of {} ticks arrived with {} flush(es) still in flight, {} completions out of order",
+		telemetry.busy_ticks, telemetry.ticks, m_max_outstanding, telemetry.out_of_order);
+}
\ No newline at end of file
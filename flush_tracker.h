@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+
+#include <iCUESDK/iCUESDK.h>
+
+#include "latency_histogram.h"
+
+struct FlushTelemetry {
+	uint64_t flushes;
+	uint64_t ticks;
+	uint64_t busy_ticks; // ticks where every allowed flush was still in flight
+	uint64_t out_of_order; // completions that arrived after a completion for a later frame
+	uint64_t latency_p50_ns;
+	uint64_t latency_p90_ns;
+	uint64_t latency_p99_ns;
+	uint64_t latency_max_ns;
+};
+
+// How a thread waits for flush completions
+enum class FlushWaitStrategy {
+	Spin, // lowest wake latency, burns a core for as long as the wait lasts
+	Block, // sleeps in atomic::wait (futex / WaitOnAddress), woken by the completion callback
+	SpinThenBlock, // spins for a short while first, completions that arrive quickly are caught without a wakeup
+};
+
+// Tracks the flushes of one device that have been submitted but not completed yet.
+// Every flush gets the next sequence number, which is also the number of the frame it carries,
+// and its callback context points back to it so completions are attributed to the right frame even when they arrive out of order.
+// By default only one flush may be in flight, allowing more lets CPU-side buffer preparation overlap with iCUE's processing.
+class FlushTracker {
+public:
+	static constexpr uint32_t MAX_OUTSTANDING = 8;
+
+private:
+	struct Slot {
+		FlushTracker* tracker;
+		uint64_t sequence;
+		int64_t submit_time_ns;
+		std::atomic<bool> in_flight;
+	};
+
+	std::array<Slot, MAX_OUTSTANDING> m_slots{};
+	uint32_t m_max_outstanding = 1;
+	uint64_t m_next_sequence = 0; // only used by the submitting thread
+	std::atomic<uint32_t> m_num_in_flight{};
+
+	FlushWaitStrategy m_wait_strategy = FlushWaitStrategy::SpinThenBlock;
+	std::chrono::nanoseconds m_spin_duration = std::chrono::microseconds(50);
+	mutable std::atomic<uint32_t> m_num_waiters{}; // completions only notify when someone is blocked
+	std::atomic<int64_t> m_last_completion_ns{};
+
+	// Telemetry for the current run, see resetTelemetry()
+	LatencyHistogram m_latency{};
+	std::atomic<uint64_t> m_num_ticks{};
+	std::atomic<uint64_t> m_num_busy_ticks{};
+	std::atomic<uint64_t> m_num_out_of_order{};
+	std::atomic<uint64_t> m_highest_completed{}; // sequence + 1, 0 if nothing completed
+
+	static void onFlushComplete(void* context, CorsairError error);
+
+	// Waits until done(number of flushes in flight) is true
+	template<typename Pred>
+	void waitUntil(Pred done) const;
+
+public:
+	FlushTracker();
+	FlushTracker(const FlushTracker&) = delete;
+	FlushTracker& operator=(const FlushTracker&) = delete;
+
+	// Between 1 and MAX_OUTSTANDING. Only change while nothing is in flight.
+	void setMaxOutstanding(uint32_t max_outstanding);
+
+	uint32_t getMaxOutstanding() const { return m_max_outstanding; }
+
+	// spin_duration is only used by SpinThenBlock. Only change while nothing is waiting.
+	void setWaitStrategy(FlushWaitStrategy strategy, std::chrono::nanoseconds spin_duration = std::chrono::microseconds(50));
+
+	FlushWaitStrategy getWaitStrategy() const { return m_wait_strategy; }
+
+	std::chrono::nanoseconds getSpinDuration() const { return m_spin_duration; }
+
+	bool hasFreeSlot() const;
+
+	// Waits until another flush may be submitted
+	void waitForFreeSlot() const;
+
+	// Waits until every submitted flush has completed
+	void waitForAll() const;
+
+	// steady_clock time the most recent completion callback ran, for measuring wake-up latency
+	int64_t getLastCompletionTimeNs() const { return m_last_completion_ns.load(std::memory_order_acquire); }
+
+	struct Ticket {
+		CorsairAsyncCallback callback;
+		void* context;
+		uint64_t sequence;
+	};
+
+	// Reserves a slot for a new flush, there must be a free one.
+	// Pass callback and context to CorsairSetLedColorsFlushBufferAsync().
+	Ticket beginFlush();
+
+	// Call on every scheduled tick before waiting for a free slot
+	void recordTick();
+
+	// Starts a new run
+	void resetTelemetry();
+
+	FlushTelemetry getTelemetry() const;
+
+	void reportTelemetry() const;
+};
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+
+#include <algorithm>
+#include <memory>
+#include <span>
+#include <thread>
+
+#include <iCUESDK/iCUESDK.h>
+
+#include "fixed_update_loop.h"
+#include "leds.h"
+#include "my_print.h"
+#include "set_colors.h"
+#include "spsc_ring.h"
+
+// How many frames the producer may render ahead of the submit thread
+constexpr uint32_t FRAME_PIPELINE_DEPTH = 4;
+
+// Like startFixedUpdateLoop(), but render(i) only has to fill in leds for frame i.
+// Rendering happens ahead of time on the calling thread, and a dedicated submit thread running the scheduler
+// hands each finished frame to the device exactly on its tick, so frame build cost never shifts the flush instant.
+// When render() returns, leds holds the last frame just like with a plain loop.
+template<typename Func>
+inline FixedUpdateLoopStats startFramePipeline(const CorsairDeviceId* device_id, Leds& leds, int iterations, int64_t period_microseconds, Func&& render)
+{
+	// heap allocated as each slot can hold a full device worth of LEDs
+	auto ring = std::make_unique<SpscRing<FrameColors, FRAME_PIPELINE_DEPTH>>();
+	LightingBackend& backend = leds.getBackend();
+	FlushTracker& tracker = leds.getFlushTracker();
+
+	FixedUpdateLoopStats stats{};
+	int underruns = 0; // ticks where the producer hadn't finished the frame yet
+	uint64_t leds_submitted = 0;
+
+	auto submit = [&]() {
+		stats = startFixedUpdateLoop(iterations, period_microseconds, [&](int) {
+			FrameColors* frame = ring->tryBeginPop();
+			if (!frame) {
+				++underruns;
+				frame = ring->beginPop();
+			}
+			leds_submitted += frame->size();
+			tracker.recordTick();
+			tracker.waitForFreeSlot();
+			setColors(device_id, backend, tracker, std::span<const CorsairLedColor>(frame->data(), frame->size()));
+			ring->endPop();
+			});
+		tracker.waitForAll();
+		};
+
+	tracker.resetTelemetry();
+
+	// The submit thread only starts once the ring is full so the first ticks aren't starved
+	const int prefill = std::min(iterations, static_cast<int>(ring->capacity()));
+	std::thread submit_thread{};
+	for (int i = 0; i < iterations; ++i) {
+		render(i);
+
+		FrameColors* slot = ring->beginPush();
+		leds.takeChangedColors(*slot);
+		ring->endPush();
+
+		if (i + 1 == prefill) {
+			submit_thread = std::thread(submit);
+		}
+	}
+	if (submit_thread.joinable()) {
+		submit_thread.join();
+	}
+
+	if (underruns > 0) {
+		myPrint("Frame pipeline: {} frames were not rendered in time", underruns);
+	}
+	if (iterations > 0) {
+		myPrint("Frame pipeline: {:.1f} of {} LEDs submitted per frame on average", static_cast<double>(leds_submitted) / iterations, leds.getCount());
+	}
+	tracker.reportTelemetry();
+
+	return stats;
+}
\ No newline at end of file
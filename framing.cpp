@@ -0,0 +1,371 @@
+#include "framing.h"
+
+#include <cstdlib>
+
+#include <algorithm>
+
+#include "corsair_helpers.h"
+
+constexpr uint8_t HEADER_MAGIC[2]{ 'L', 'T' };
+constexpr uint8_t HEADER_VERSION = 1;
+
+constexpr uint32_t PREAMBLE_MAX_MISMATCHES = 3; // tolerates a skipped or repeated preamble frame
+constexpr double SYNC_MIN_MATCH = 0.85; // fraction of sync bits that must match
+constexpr uint32_t MAX_LEAD_IN_SLIP = 2; // extra frames the sync and header frames may be late by
+
+static constexpr std::array<uint32_t, 256> makeCrcTable()
+{
+	std::array<uint32_t, 256> table{};
+	for (uint32_t i = 0; i < 256; ++i) {
+		uint32_t crc = i;
+		for (int bit = 0; bit < 8; ++bit) {
+			crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320U : crc >> 1;
+		}
+		table[i] = crc;
+	}
+	return table;
+}
+
+static constexpr std::array<uint32_t, 256> CRC_TABLE = makeCrcTable();
+
+uint32_t crc32(std::span<const uint8_t> bytes, uint32_t crc)
+{
+	crc ^= 0xFFFFFFFFU;
+	for (const uint8_t byte : bytes) {
+		crc = CRC_TABLE[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+	}
+	return crc ^ 0xFFFFFFFFU;
+}
+
+// most significant bit first, the last byte padded with zeros
+static std::vector<uint8_t> packBits(const uint8_t* bits, size_t num_bits)
+{
+	std::vector<uint8_t> bytes((num_bits + 7) / 8);
+	for (size_t i = 0; i < num_bits; ++i) {
+		bytes[i / 8] |= static_cast<uint8_t>((bits[i] & 1) << (7 - i % 8));
+	}
+	return bytes;
+}
+
+static void appendBits(std::vector<uint8_t>& bits, uint64_t value, uint32_t num_bits)
+{
+	for (uint32_t i = num_bits; i-- > 0;) {
+		bits.push_back(static_cast<uint8_t>((value >> i) & 1));
+	}
+}
+
+static uint64_t readBits(const uint8_t* bits, uint32_t num_bits)
+{
+	uint64_t value = 0;
+	for (uint32_t i = 0; i < num_bits; ++i) {
+		value = (value << 1) | (bits[i] & 1);
+	}
+	return value;
+}
+
+static std::array<uint8_t, FrameFormat::HEADER_BYTES> serializeHeader(const FrameHeader& header)
+{
+	std::array<uint8_t, FrameFormat::HEADER_BYTES> bytes{};
+	size_t offset = 0;
+	const auto put = [&](uint64_t value, size_t size) {
+		for (size_t i = 0; i < size; ++i) {
+			bytes[offset++] = static_cast<uint8_t>(value >> (i * 8));
+		}
+		};
+	put(HEADER_MAGIC[0], 1);
+	put(HEADER_MAGIC[1], 1);
+	put(HEADER_VERSION, 1);
+	put(static_cast<uint8_t>(header.payload_type), 1);
+	put(header.payload_length, 4);
+	put(header.width, 2);
+	put(header.height, 2);
+	put(header.bits_per_channel, 1);
+	put(header.symbol_rate_centihertz, 2);
+	put(header.rs_block_length, 1);
+	put(header.rs_data_length, 1);
+	put(header.interleaver_type, 1);
+	put(header.interleaver_depth, 2);
+	put(header.interleaver_delay, 1);
+	put(header.transmission_number, 2);
+	put(header.num_data_frames, 4);
+	put(header.compression, 1);
+	// the rest is reserved
+	return bytes;
+}
+
+static std::optional<FrameHeader> deserializeHeader(std::span<const uint8_t> bytes)
+{
+	if (bytes[0] != HEADER_MAGIC[0] || bytes[1] != HEADER_MAGIC[1] || bytes[2] != HEADER_VERSION) {
+		return std::nullopt;
+	}
+	size_t offset = 3;
+	const auto get = [&](size_t size) {
+		uint64_t value = 0;
+		for (size_t i = 0; i < size; ++i) {
+			value |= static_cast<uint64_t>(bytes[offset++]) << (i * 8);
+		}
+		return value;
+		};
+	FrameHeader header{};
+	header.payload_type = static_cast<PayloadType>(get(1));
+	header.payload_length = static_cast<uint32_t>(get(4));
+	header.width = static_cast<uint16_t>(get(2));
+	header.height = static_cast<uint16_t>(get(2));
+	header.bits_per_channel = static_cast<uint8_t>(get(1));
+	header.symbol_rate_centihertz = static_cast<uint16_t>(get(2));
+	header.rs_block_length = static_cast<uint8_t>(get(1));
+	header.rs_data_length = static_cast<uint8_t>(get(1));
+	header.interleaver_type = static_cast<uint8_t>(get(1));
+	header.interleaver_depth = static_cast<uint16_t>(get(2));
+	header.interleaver_delay = static_cast<uint8_t>(get(1));
+	header.transmission_number = static_cast<uint16_t>(get(2));
+	header.num_data_frames = static_cast<uint32_t>(get(4));
+	header.compression = static_cast<uint8_t>(get(1));
+	return header;
+}
+
+FrameFormat::FrameFormat(uint32_t bits_per_frame) : m_bits_per_frame(bits_per_frame)
+{
+	// the header frame is the fullest, with fewer bits the header and its CRC would be cut off and nothing could parse it
+	// (on the keyboard that is fewer than 91 data keys, e.g. after giving too many to pilots)
+	if (bits_per_frame < HEADER_BYTES * 8 + CRC_BITS) {
+		die("Frames of {} bits can't carry the {} bit header, need {} data keys or more", bits_per_frame, HEADER_BYTES * 8 + CRC_BITS,
+			(HEADER_BYTES * 8 + CRC_BITS + 2) / 3);
+	}
+
+	// PRBS9 (x^9 + x^5 + 1)
+	uint32_t lfsr = 0x1FF;
+	m_sync_pattern.resize(bits_per_frame);
+	for (uint8_t& bit : m_sync_pattern) {
+		const uint32_t feedback = ((lfsr >> 8) ^ (lfsr >> 4)) & 1;
+		lfsr = ((lfsr << 1) | feedback) & 0x1FF;
+		bit = static_cast<uint8_t>(feedback);
+	}
+}
+
+uint32_t FrameFormat::getNumDataFrames(size_t num_payload_bits) const
+{
+	return static_cast<uint32_t>((num_payload_bits + getPayloadBitsPerFrame() - 1) / getPayloadBitsPerFrame());
+}
+
+std::vector<uint8_t> FrameFormat::buildLeadIn(const FrameHeader& header) const
+{
+	std::vector<uint8_t> bits{};
+	bits.reserve(static_cast<size_t>(NUM_LEAD_IN_FRAMES) * m_bits_per_frame);
+	for (const uint8_t on : FRAME_PREAMBLE) {
+		bits.insert(bits.end(), m_bits_per_frame, on);
+	}
+	bits.insert(bits.end(), m_sync_pattern.begin(), m_sync_pattern.end());
+
+	const auto header_bytes = serializeHeader(header);
+	const size_t header_start = bits.size();
+	for (const uint8_t byte : header_bytes) {
+		appendBits(bits, byte, 8);
+	}
+	appendBits(bits, crc32(header_bytes), CRC_BITS);
+	bits.resize(header_start + m_bits_per_frame);
+	for (uint32_t i = 1; i < HEADER_REPEATS; ++i) {
+		bits.insert(bits.end(), bits.begin() + header_start, bits.begin() + header_start + m_bits_per_frame);
+	}
+	return bits;
+}
+
+std::vector<uint8_t> FrameFormat::build(FrameHeader header, std::span<const uint8_t> payload_bits) const
+{
+	const uint32_t payload_bits_per_frame = getPayloadBitsPerFrame();
+	header.num_data_frames = getNumDataFrames(payload_bits.size());
+
+	std::vector<uint8_t> bits = buildLeadIn(header);
+	bits.reserve(bits.size() + static_cast<size_t>(header.num_data_frames) * m_bits_per_frame);
+	for (uint32_t frame = 0; frame < header.num_data_frames; ++frame) {
+		const size_t frame_start = bits.size();
+		appendBits(bits, frame & 0xFFFF, SEQUENCE_BITS);
+		const size_t first = static_cast<size_t>(frame) * payload_bits_per_frame;
+		const size_t last = std::min(first + payload_bits_per_frame, payload_bits.size());
+		bits.insert(bits.end(), payload_bits.begin() + first, payload_bits.begin() + last);
+		bits.resize(frame_start + SEQUENCE_BITS + payload_bits_per_frame);
+		appendBits(bits, crc32(packBits(bits.data() + frame_start, SEQUENCE_BITS + payload_bits_per_frame)), CRC_BITS);
+	}
+	return bits;
+}
+
+std::optional<ParsedTransmission> FrameParser::parse(std::span<const uint8_t> received_bits) const
+{
+	const uint32_t bits_per_frame = m_format.getBitsPerFrame();
+	const uint32_t payload_bits_per_frame = m_format.getPayloadBitsPerFrame();
+	const size_t num_frames = received_bits.size() / bits_per_frame;
+	const auto frame = [&](size_t i) { return received_bits.data() + i * bits_per_frame; };
+
+	// on/off per frame by majority, for the preamble
+	std::vector<uint8_t> frame_on(num_frames);
+	for (size_t i = 0; i < num_frames; ++i) {
+		const auto ones = std::count_if(frame(i), frame(i) + bits_per_frame, [](uint8_t bit) { return bit != 0; });
+		frame_on[i] = ones * 2 >= static_cast<std::ptrdiff_t>(bits_per_frame);
+	}
+
+	const auto matchesSync = [&](size_t i) {
+		size_t matching = 0;
+		for (uint32_t b = 0; b < bits_per_frame; ++b) {
+			matching += (frame(i)[b] & 1) == m_format.getSyncPattern()[b];
+		}
+		return static_cast<double>(matching) >= SYNC_MIN_MATCH * bits_per_frame;
+		};
+
+	constexpr uint32_t header_bits = FrameFormat::HEADER_BYTES * 8 + FrameFormat::CRC_BITS;
+	const auto readHeader = [&](const uint8_t* bits) -> std::optional<FrameHeader> {
+		const auto bytes = packBits(bits, FrameFormat::HEADER_BYTES * 8);
+		const uint32_t crc = static_cast<uint32_t>(readBits(bits + FrameFormat::HEADER_BYTES * 8, FrameFormat::CRC_BITS));
+		if (crc32(bytes) != crc) {
+			return std::nullopt;
+		}
+		return deserializeHeader(bytes);
+		};
+	// first the bitwise majority of the copies starting at first, then that with one bit corrected, then each copy on its own
+	const auto readHeaderCopies = [&](size_t first, size_t& last_header_index) -> std::optional<FrameHeader> {
+		const size_t num_copies = std::min<size_t>(FrameFormat::HEADER_REPEATS, num_frames - first);
+		std::array<uint8_t, header_bits> voted{};
+		for (uint32_t b = 0; b < header_bits; ++b) {
+			uint32_t ones = 0;
+			for (size_t copy = 0; copy < num_copies; ++copy) {
+				ones += frame(first + copy)[b] & 1;
+			}
+			voted[b] = ones * 2 > num_copies;
+		}
+		last_header_index = first + num_copies - 1;
+		if (auto header = readHeader(voted.data())) {
+			return header;
+		}
+		// a bit wrong in two copies is left wrong by the vote, flipping each bit in turn finds it
+		for (uint32_t b = 0; b < header_bits; ++b) {
+			voted[b] ^= 1;
+			if (auto header = readHeader(voted.data())) {
+				return header;
+			}
+			voted[b] ^= 1;
+		}
+		for (size_t copy = 0; copy < num_copies; ++copy) {
+			if (auto header = readHeader(frame(first + copy))) {
+				return header;
+			}
+		}
+		return std::nullopt;
+		};
+
+	for (size_t start = 0; start + FRAME_PREAMBLE.size() + 2 <= num_frames; ++start) {
+		uint32_t mismatches = 0;
+		for (size_t i = 0; i < FRAME_PREAMBLE.size(); ++i) {
+			mismatches += frame_on[start + i] != FRAME_PREAMBLE[i];
+		}
+		if (mismatches > PREAMBLE_MAX_MISMATCHES) {
+			continue;
+		}
+
+		std::optional<size_t> sync_index{};
+		for (size_t i = start + FRAME_PREAMBLE.size(); i < std::min(num_frames, start + FRAME_PREAMBLE.size() + 1 + MAX_LEAD_IN_SLIP); ++i) {
+			if (matchesSync(i)) {
+				sync_index = i;
+				break;
+			}
+		}
+		if (!sync_index) {
+			continue;
+		}
+
+		std::optional<FrameHeader> header{};
+		size_t header_index = 0;
+		for (size_t i = *sync_index + 1; i < std::min(num_frames, *sync_index + 2 + MAX_LEAD_IN_SLIP) && !header; ++i) {
+			header = readHeaderCopies(i, header_index);
+		}
+		if (!header) {
+			continue;
+		}
+
+		ParsedTransmission result{};
+		result.header = *header;
+		result.payload_bits.assign(static_cast<size_t>(header->num_data_frames) * payload_bits_per_frame, 0);
+		result.frame_lost.assign(header->num_data_frames, 1);
+
+		// sequence numbers are 16 bits, each is taken as the closest to the one after the last seen
+		struct IntactFrame {
+			size_t index;
+			int64_t sequence;
+		};
+		std::vector<IntactFrame> intact_frames{ { header_index, -1 } }; // the last header frame comes just before frame 0
+		std::vector<size_t> damaged_frames{};
+		int64_t last_sequence = -1;
+		uint32_t num_received = 0;
+		for (size_t i = header_index + 1; i < num_frames && num_received < header->num_data_frames; ++i) {
+			const uint8_t* bits = frame(i);
+			const uint32_t crc = static_cast<uint32_t>(readBits(bits + FrameFormat::SEQUENCE_BITS + payload_bits_per_frame, FrameFormat::CRC_BITS));
+			if (crc32(packBits(bits, FrameFormat::SEQUENCE_BITS + payload_bits_per_frame)) != crc) {
+				++result.crc_failures;
+				damaged_frames.push_back(i);
+				continue;
+			}
+			const uint16_t sequence_low = static_cast<uint16_t>(readBits(bits, FrameFormat::SEQUENCE_BITS));
+			const int16_t delta = static_cast<int16_t>(static_cast<uint16_t>(sequence_low - static_cast<uint16_t>(last_sequence + 1)));
+			const int64_t sequence = last_sequence + 1 + delta;
+			if (sequence < 0 || sequence >= header->num_data_frames) {
+				break; // not part of this transmission
+			}
+			last_sequence = std::max(last_sequence, sequence);
+			intact_frames.push_back({ i, sequence });
+			if (!result.frame_lost[sequence]) {
+				++result.duplicates;
+				continue;
+			}
+			result.frame_lost[sequence] = 0;
+			++num_received;
+			std::copy(bits + FrameFormat::SEQUENCE_BITS, bits + FrameFormat::SEQUENCE_BITS + payload_bits_per_frame,
+				result.payload_bits.begin() + static_cast<size_t>(sequence) * payload_bits_per_frame);
+		}
+
+		// A frame that failed its CRC usually has only a bit or two wrong, so its payload still goes to the Reed-Solomon
+		// code to correct, in any slot no intact copy filled. One frame in the wrong slot is more errors than a codeword can
+		// correct, and its own sequence number may be one of the damaged bits, so it is placed by where it was received.
+		// Between two intact frames whose sequence numbers are as far apart as the frames are, every frame is accounted
+		// for. Otherwise a skipped or repeated frame lies between them somewhere, and the sequence number the frame carries
+		// must be the one counted forward from the intact frame before or back from the one after.
+		// Only frames that never show up are left marked lost.
+		size_t next_intact = 0;
+		for (const size_t i : damaged_frames) {
+			while (next_intact < intact_frames.size() && intact_frames[next_intact].index < i) {
+				++next_intact;
+			}
+			const uint8_t* bits = frame(i);
+			const IntactFrame& before = intact_frames[next_intact - 1];
+			int64_t sequence = before.sequence + static_cast<int64_t>(i - before.index);
+			if (next_intact < intact_frames.size()) {
+				const IntactFrame& after = intact_frames[next_intact];
+				const int64_t from_after = after.sequence - static_cast<int64_t>(after.index - i);
+				if (from_after != sequence) {
+					const uint16_t sequence_low = static_cast<uint16_t>(readBits(bits, FrameFormat::SEQUENCE_BITS));
+					if (sequence_low == static_cast<uint16_t>(from_after)) {
+						sequence = from_after;
+					}
+					else if (sequence_low != static_cast<uint16_t>(sequence)) {
+						continue;
+					}
+				}
+			}
+			else if (readBits(bits, FrameFormat::SEQUENCE_BITS) != (static_cast<uint64_t>(sequence) & 0xFFFF)) {
+				continue;
+			}
+			if (sequence < 0 || sequence >= header->num_data_frames || !result.frame_lost[sequence]) {
+				continue;
+			}
+			result.frame_lost[sequence] = 0;
+			std::copy(bits + FrameFormat::SEQUENCE_BITS, bits + FrameFormat::SEQUENCE_BITS + payload_bits_per_frame,
+				result.payload_bits.begin() + static_cast<size_t>(sequence) * payload_bits_per_frame);
+		}
+		return result;
+	}
+	return std::nullopt;
+}
+
+void showFrameBits(Leds& leds, std::span<const uint32_t> keys, const uint8_t* bits)
+{
+	for (size_t i = 0; i < keys.size(); ++i) {
+		leds.setLed(keys[i], bits[i * 3 + 0] * 255, bits[i * 3 + 1] * 255, bits[i * 3 + 2] * 255);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+
+#include <array>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "leds.h"
+
+// Barker-13, shown as every data key fully on (1) or off (0) for a frame each. Its autocorrelation sidelobes are at most
+// 1/13 of the peak, so a receiver watching overall brightness can find the start of a transmission without any pause.
+constexpr std::array<uint8_t, 13> FRAME_PREAMBLE{ 1, 1, 1, 1, 1, 0, 0, 1, 1, 0, 1, 0, 1 };
+
+enum class PayloadType : uint8_t {
+	Bytes,
+	Text,
+	Image, // data frames are the pixels themselves (one per data key, 8 bits per channel), not bits
+	CodedImage, // encodeProgressiveImage() stream sent as bytes, width and height are set
+	PaletteImage, // like Image, but the first data frame shows the palette and bits_per_channel is the bits per palette index
+};
+
+// Everything a receiver needs to decode the transmission that follows, sent as the frame after the sync frame
+struct FrameHeader {
+	PayloadType payload_type = PayloadType::Bytes;
+	uint32_t payload_length = 0; // bytes, or pixels for images
+	uint16_t width = 0; // images only
+	uint16_t height = 0;
+	uint8_t bits_per_channel = 1; // each channel shows 2^bits_per_channel levels
+	uint16_t symbol_rate_centihertz = 0;
+	uint8_t rs_block_length = 0; // 0 if there is no Reed-Solomon code
+	uint8_t rs_data_length = 0;
+	uint8_t interleaver_type = 0; // InterleaverType
+	uint16_t interleaver_depth = 0;
+	uint8_t interleaver_delay = 0;
+	uint16_t transmission_number = 0; // tells repeated transmissions apart
+	uint32_t num_data_frames = 0;
+	uint8_t compression = 0; // PayloadCompression, payload_length is the compressed length
+};
+
+// CRC-32 (IEEE 802.3, as used by zlib). Pass the CRC of the bytes before to continue it over more bytes.
+uint32_t crc32(std::span<const uint8_t> bytes, uint32_t crc = 0);
+
+// Frame layout for a given number of bits per frame (one per channel of each data key, see showFrameBits()).
+// A transmission is the preamble, one sync frame (a fixed pseudo-random pattern that confirms alignment and which bit is
+// which), HEADER_REPEATS copies of the header frame, then the data frames. Header and data frames end in a CRC-32 of the rest of the frame, and
+// data frames start with their 16-bit sequence number so repeated or skipped device refreshes show up as such.
+class FrameFormat {
+public:
+	static constexpr uint32_t SEQUENCE_BITS = 16;
+	static constexpr uint32_t CRC_BITS = 32;
+	static constexpr uint32_t HEADER_BYTES = 30;
+	static constexpr uint32_t HEADER_REPEATS = 3; // losing the header loses everything, so it is sent more than once
+	static constexpr uint32_t NUM_LEAD_IN_FRAMES = static_cast<uint32_t>(FRAME_PREAMBLE.size()) + 1 + HEADER_REPEATS;
+
+private:
+	uint32_t m_bits_per_frame;
+	std::vector<uint8_t> m_sync_pattern{};
+
+public:
+	explicit FrameFormat(uint32_t bits_per_frame);
+
+	uint32_t getBitsPerFrame() const { return m_bits_per_frame; }
+
+	uint32_t getPayloadBitsPerFrame() const { return m_bits_per_frame - SEQUENCE_BITS - CRC_BITS; }
+
+	std::span<const uint8_t> getSyncPattern() const { return m_sync_pattern; }
+
+	// Preamble, sync and header frames, NUM_LEAD_IN_FRAMES * bits_per_frame bits
+	std::vector<uint8_t> buildLeadIn(const FrameHeader& header) const;
+
+	// The lead-in followed by data frames carrying payload_bits (padded with zeros), header.num_data_frames is filled in
+	std::vector<uint8_t> build(FrameHeader header, std::span<const uint8_t> payload_bits) const;
+
+	uint32_t getNumDataFrames(size_t num_payload_bits) const;
+};
+
+struct ParsedTransmission {
+	FrameHeader header;
+	std::vector<uint8_t> payload_bits; // num_data_frames * payload bits per frame, zeros where frames were lost
+	std::vector<uint8_t> frame_lost; // per data frame, 1 if it never arrived at all (frames that failed the CRC are kept as read)
+	uint32_t crc_failures;
+	uint32_t duplicates; // intact frames seen again, e.g. because the device skipped a refresh and the receiver saw a frame twice
+};
+
+// Finds and decodes a transmission in a stream of frames as read by a receiver (one bit per byte, one entry per sampled frame)
+class FrameParser {
+	FrameFormat m_format;
+
+public:
+	explicit FrameParser(uint32_t bits_per_frame) : m_format(bits_per_frame) {}
+
+	// The first transmission in received_bits whose preamble, sync frame and header check out.
+	// The header copies are majority voted bit by bit before the CRC check, a single wrong bit left after the vote is
+	// corrected, and the copies are tried one by one if that fails.
+	// Data frames that fail their CRC are still passed on where they can be placed, see ParsedTransmission::frame_lost.
+	std::optional<ParsedTransmission> parse(std::span<const uint8_t> received_bits) const;
+};
+
+// Shows one frame of bits on keys, bits 3i, 3i + 1 and 3i + 2 on the R, G and B channels of keys[i]
+void showFrameBits(Leds& leds, std::span<const uint32_t> keys, const uint8_t* bits);
\ No newline at end of file
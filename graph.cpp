@@ -6,7 +6,7 @@
 #include <numbers>
 #include <thread>
 
-#include "fixed_update_loop.h"
+#include "frame_pipeline.h"
 #include "set_colors.h"
 #include "my_print.h"
 
@@ -45,7 +45,7 @@ void liveGraph(const CorsairDeviceId* device_id, Leds& leds)
 	std::this_thread::sleep_for(std::chrono::seconds(1));
 
 	auto start = std::chrono::high_resolution_clock::now();
-	startFixedUpdateLoop(iters, static_cast<int64_t>(1'000'000.0 / FREQUENCY), [&](int iteration) {
+	startFramePipeline(device_id, leds, iters, static_cast<int64_t>(1'000'000.0 / FREQUENCY), [&](int iteration) {
 		const double t = static_cast<double>(iteration) / FREQUENCY;
 		uint32_t i = 0;
 		const auto bounds = leds.getBounds();
@@ -56,8 +56,5 @@ void liveGraph(const CorsairDeviceId* device_id, Leds& leds)
 			leds.setLed(i, static_cast<uint8_t>(c.r * 255.0), static_cast<uint8_t>(c.g * 255.0), static_cast<uint8_t>(c.b * 255.0));
 			++i;
 		}
-		waitForColors();
-		setColors(device_id, leds);
 		});
-	waitForColors();
 }
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "icue_backend.h"
+
+// The iCUE SDK is only shipped for Windows, other platforms use SimulatedK70Backend
+#ifdef _WIN32
+
+#include <cassert>
+
+#include <limits>
+
+#include "corsair_helpers.h"
+#include "my_print.h"
+
+// Runs on a separate thread
+static void onStateChanged(void* context, const CorsairSessionStateChanged* event_data)
+{
+	assert(context);
+	assert(event_data);
+
+	IcueBackend::StateChangedContext& state_changed_context = *reinterpret_cast<IcueBackend::StateChangedContext*>(context);
+
+	switch (event_data->state) {
+	case CSS_Invalid:
+		assert(false);
+		break;
+	case CSS_Closed:
+		// not connected yet or just disconnected
+		break;
+	case CSS_Connecting:
+		myPrint("Connecting...");
+		break;
+	case CSS_Timeout:
+		myPrint("Connection timeout. Retrying. Is iCUE running?");
+		break;
+	case CSS_ConnectionRefused:
+		die("Server did not allow connection");
+		break;
+	case CSS_ConnectionLost:
+		die("Server closed connection");
+		break;
+	case CSS_Connected: {
+		myPrint("Connected!");
+		myPrint("iCUE version: {}", event_data->details.serverHostVersion);
+		myPrint("SDK version: {}", event_data->details.serverVersion);
+		{
+			std::lock_guard lock(state_changed_context.mutex);
+			state_changed_context.connected = true;
+		}
+		state_changed_context.cv.notify_one(); // wait up main thread
+	} break;
+	default:
+		assert(false);
+		break;
+	}
+}
+
+CorsairError IcueBackend::connect()
+{
+	const CorsairError err = CorsairConnect(onStateChanged, reinterpret_cast<void*>(&m_state_changed_context));
+	if (err != CE_Success) {
+		return err;
+	}
+	std::unique_lock lock(m_state_changed_context.mutex);
+	m_state_changed_context.cv.wait(lock, [&]() {return m_state_changed_context.connected; });
+	return CE_Success;
+}
+
+CorsairError IcueBackend::disconnect()
+{
+	return CorsairDisconnect();
+}
+
+const CorsairDeviceId* IcueBackend::findKeyboard()
+{
+	const CorsairDeviceId* device_id{};
+	int best_led_count = 0;
+	const CorsairDeviceFilter filter{ CDT_Keyboard };
+	int num_devices{};
+	CHECKCORSAIR(CorsairGetDevices(&filter, static_cast<int>(m_found_devices.capacity()), m_found_devices.data(), &num_devices));
+	myPrint("Found {} devices:", num_devices);
+	m_found_devices.resize_uninitialized(static_cast<uint32_t>(num_devices));
+	for (int i = 0; i < num_devices; ++i) {
+		const auto& dev = m_found_devices[i];
+		myPrint("[{}]:", i);
+		myPrint("    model: {}", dev.model);
+		myPrint("    serial: {}", dev.serial);
+		myPrint("    id: {}", dev.id);
+		myPrint("    LED count: {}", dev.ledCount);
+		myPrint("    channel count: {}", dev.channelCount);
+		// a 112 LED board is the K70 this was developed on, otherwise take the keyboard with the most LEDs
+		if (dev.ledCount == 112) {
+			device_id = &dev.id;
+			best_led_count = std::numeric_limits<int>::max();
+		}
+		else if (dev.ledCount > best_led_count) {
+			device_id = &dev.id;
+			best_led_count = dev.ledCount;
+		}
+	}
+	return device_id;
+}
+
+CorsairError IcueBackend::requestControl(const CorsairDeviceId* device_id)
+{
+	// Request exclusive control over the keyboard's lighting and key events
+	return CorsairRequestControl(*device_id, CAL_ExclusiveLightingControlAndKeyEventsListening);
+}
+
+CorsairError IcueBackend::releaseControl(const CorsairDeviceId* device_id)
+{
+	return CorsairReleaseControl(*device_id);
+}
+
+CorsairError IcueBackend::getLedPositions(const CorsairDeviceId* device_id, int size_max, CorsairLedPosition* led_positions, int* size)
+{
+	return CorsairGetLedPositions(*device_id, size_max, led_positions, size);
+}
+
+CorsairError IcueBackend::setLedColorsBuffer(const CorsairDeviceId* device_id, int size, const CorsairLedColor* led_colors)
+{
+	return CorsairSetLedColorsBuffer(*device_id, size, led_colors);
+}
+
+CorsairError IcueBackend::setLedColorsFlushBufferAsync(CorsairAsyncCallback callback, void* context)
+{
+	return CorsairSetLedColorsFlushBufferAsync(callback, context);
+}
+
+#endif
\ No newline at end of file
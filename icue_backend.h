@@ -0,0 +1,33 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+
+#include <iCUESDK/iCUESDK.h>
+
+#include "lighting_backend.h"
+#include "static_vector.h"
+
+// Talks to a real device through iCUE. Only available on Windows.
+class IcueBackend : public LightingBackend {
+public:
+	struct StateChangedContext {
+		std::mutex mutex{}; // accessed by main thread and onStateChanged thread
+		std::condition_variable cv{}; // for waking up main thread once connected
+		bool connected = false;
+	};
+
+private:
+	StateChangedContext m_state_changed_context{}; // must be valid until CorsairDisconnect()
+	static_vector<CorsairDeviceInfo, CORSAIR_DEVICE_COUNT_MAX> m_found_devices{};
+
+public:
+	CorsairError connect() override;
+	CorsairError disconnect() override;
+	const CorsairDeviceId* findKeyboard() override;
+	CorsairError requestControl(const CorsairDeviceId* device_id) override;
+	CorsairError releaseControl(const CorsairDeviceId* device_id) override;
+	CorsairError getLedPositions(const CorsairDeviceId* device_id, int size_max, CorsairLedPosition* led_positions, int* size) override;
+	CorsairError setLedColorsBuffer(const CorsairDeviceId* device_id, int size, const CorsairLedColor* led_colors) override;
+	CorsairError setLedColorsFlushBufferAsync(CorsairAsyncCallback callback, void* context) override;
+};
\ No newline at end of file
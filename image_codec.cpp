@@ -0,0 +1,464 @@
+#include "image_codec.h"
+
+#include <cassert>
+#include <cmath>
+
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <numbers>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+static constexpr uint32_t BLOCK_SIZE = 8;
+static constexpr size_t HEADER_SIZE = 5;
+static constexpr size_t SCAN_LENGTH_SIZE = 4;
+
+static constexpr std::array<uint8_t, 64> ZIGZAG{
+	0, 1, 8, 16, 9, 2, 3, 10,
+	17, 24, 32, 25, 18, 11, 4, 5,
+	12, 19, 26, 33, 40, 48, 41, 34,
+	27, 20, 13, 6, 7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36,
+	29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46,
+	53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+// JPEG (ITU T.81 Annex K) tables at quality 50, row major
+static constexpr std::array<uint8_t, 64> LUMA_QUANTIZATION{
+	16, 11, 10, 16, 24, 40, 51, 61,
+	12, 12, 14, 19, 26, 58, 60, 55,
+	14, 13, 16, 24, 40, 57, 69, 56,
+	14, 17, 22, 29, 51, 87, 80, 62,
+	18, 22, 37, 56, 68, 109, 103, 77,
+	24, 35, 55, 64, 81, 104, 113, 92,
+	49, 64, 78, 87, 103, 121, 120, 101,
+	72, 92, 95, 98, 112, 100, 103, 99,
+};
+
+static constexpr std::array<uint8_t, 64> CHROMA_QUANTIZATION{
+	17, 18, 24, 47, 99, 99, 99, 99,
+	18, 21, 26, 66, 99, 99, 99, 99,
+	24, 26, 56, 99, 99, 99, 99, 99,
+	47, 66, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+};
+
+static std::array<uint16_t, 64> scaleQuantization(const std::array<uint8_t, 64>& table, uint32_t quality)
+{
+	quality = std::clamp<uint32_t>(quality, 1, 100);
+	const uint32_t scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+	std::array<uint16_t, 64> scaled{};
+	for (size_t i = 0; i < 64; ++i) {
+		scaled[i] = static_cast<uint16_t>(std::clamp<uint32_t>((table[i] * scale + 50) / 100, 1, 255));
+	}
+	return scaled;
+}
+
+// cos((2x + 1) u pi / 16) with the orthonormal scale factor of u folded in
+static const std::array<float, 64>& getDctBasis()
+{
+	static const std::array<float, 64> basis = [] {
+		std::array<float, 64> b{};
+		for (uint32_t u = 0; u < BLOCK_SIZE; ++u) {
+			const double scale = u == 0 ? std::sqrt(1.0 / BLOCK_SIZE) : std::sqrt(2.0 / BLOCK_SIZE);
+			for (uint32_t x = 0; x < BLOCK_SIZE; ++x) {
+				b[u * BLOCK_SIZE + x] = static_cast<float>(scale * std::cos((2.0 * x + 1.0) * u * std::numbers::pi / 16.0));
+			}
+		}
+		return b;
+		}();
+	return basis;
+}
+
+static void forwardDct(const std::array<float, 64>& in, std::array<float, 64>& out)
+{
+	const auto& basis = getDctBasis();
+	std::array<float, 64> rows{};
+	for (uint32_t y = 0; y < BLOCK_SIZE; ++y) {
+		for (uint32_t u = 0; u < BLOCK_SIZE; ++u) {
+			float sum = 0.0f;
+			for (uint32_t x = 0; x < BLOCK_SIZE; ++x) {
+				sum += basis[u * BLOCK_SIZE + x] * in[y * BLOCK_SIZE + x];
+			}
+			rows[y * BLOCK_SIZE + u] = sum;
+		}
+	}
+	for (uint32_t v = 0; v < BLOCK_SIZE; ++v) {
+		for (uint32_t u = 0; u < BLOCK_SIZE; ++u) {
+			float sum = 0.0f;
+			for (uint32_t y = 0; y < BLOCK_SIZE; ++y) {
+				sum += basis[v * BLOCK_SIZE + y] * rows[y * BLOCK_SIZE + u];
+			}
+			out[v * BLOCK_SIZE + u] = sum;
+		}
+	}
+}
+
+static void inverseDct(const std::array<float, 64>& in, std::array<float, 64>& out)
+{
+	const auto& basis = getDctBasis();
+	std::array<float, 64> columns{};
+	for (uint32_t y = 0; y < BLOCK_SIZE; ++y) {
+		for (uint32_t u = 0; u < BLOCK_SIZE; ++u) {
+			float sum = 0.0f;
+			for (uint32_t v = 0; v < BLOCK_SIZE; ++v) {
+				sum += basis[v * BLOCK_SIZE + y] * in[v * BLOCK_SIZE + u];
+			}
+			columns[y * BLOCK_SIZE + u] = sum;
+		}
+	}
+	for (uint32_t y = 0; y < BLOCK_SIZE; ++y) {
+		for (uint32_t x = 0; x < BLOCK_SIZE; ++x) {
+			float sum = 0.0f;
+			for (uint32_t u = 0; u < BLOCK_SIZE; ++u) {
+				sum += basis[u * BLOCK_SIZE + x] * columns[y * BLOCK_SIZE + u];
+			}
+			out[y * BLOCK_SIZE + x] = sum;
+		}
+	}
+}
+
+namespace {
+
+struct Plane {
+	uint32_t width;
+	uint32_t height;
+	uint32_t blocks_x;
+	uint32_t blocks_y;
+	const std::array<uint8_t, 64>* quantization;
+};
+
+// Y at full resolution, then Cb and Cr at half resolution (4:2:0)
+std::array<Plane, 3> getPlanes(uint32_t width, uint32_t height)
+{
+	const uint32_t chroma_width = (width + 1) / 2;
+	const uint32_t chroma_height = (height + 1) / 2;
+	const auto blocks = [](uint32_t size) { return (size + BLOCK_SIZE - 1) / BLOCK_SIZE; };
+	return { {
+		{ width, height, blocks(width), blocks(height), &LUMA_QUANTIZATION },
+		{ chroma_width, chroma_height, blocks(chroma_width), blocks(chroma_height), &CHROMA_QUANTIZATION },
+		{ chroma_width, chroma_height, blocks(chroma_width), blocks(chroma_height), &CHROMA_QUANTIZATION },
+	} };
+}
+
+class BitWriter {
+	std::vector<uint8_t> m_bytes{};
+	uint32_t m_bit = 0;
+
+public:
+	void put(uint32_t value, uint32_t num_bits)
+	{
+		for (uint32_t b = num_bits; b-- > 0;) {
+			if (m_bit == 0) {
+				m_bytes.push_back(0);
+			}
+			m_bytes.back() |= static_cast<uint8_t>(((value >> b) & 1) << (7 - m_bit));
+			m_bit = (m_bit + 1) & 7;
+		}
+	}
+
+	// order 0 Exp-Golomb
+	void putUnsigned(uint32_t value)
+	{
+		const uint32_t coded = value + 1;
+		const uint32_t num_bits = static_cast<uint32_t>(std::bit_width(coded));
+		put(0, num_bits - 1);
+		put(coded, num_bits);
+	}
+
+	// zigzag mapped: 0, 1, -1, 2, -2...
+	void putSigned(int32_t value)
+	{
+		putUnsigned(value > 0 ? static_cast<uint32_t>(value) * 2 - 1 : static_cast<uint32_t>(-value) * 2);
+	}
+
+	std::vector<uint8_t>& getBytes() { return m_bytes; }
+};
+
+class BitReader {
+	std::span<const uint8_t> m_bytes;
+	size_t m_position = 0;
+
+public:
+	explicit BitReader(std::span<const uint8_t> bytes) : m_bytes(bytes) {}
+
+	bool overrun() const { return m_position > m_bytes.size() * 8; }
+
+	uint32_t get(uint32_t num_bits)
+	{
+		uint32_t value = 0;
+		for (uint32_t b = 0; b < num_bits; ++b, ++m_position) {
+			const uint32_t bit = m_position < m_bytes.size() * 8 ? (m_bytes[m_position / 8] >> (7 - m_position % 8)) & 1 : 0;
+			value = (value << 1) | bit;
+		}
+		return value;
+	}
+
+	uint32_t getUnsigned()
+	{
+		uint32_t leading_zeros = 0;
+		while (get(1) == 0) {
+			if (++leading_zeros > 24 || overrun()) {
+				m_position = m_bytes.size() * 8 + 1;
+				return 0;
+			}
+		}
+		return ((1U << leading_zeros) | get(leading_zeros)) - 1;
+	}
+
+	int32_t getSigned()
+	{
+		const uint32_t mapped = getUnsigned();
+		return (mapped & 1) ? static_cast<int32_t>((mapped + 1) / 2) : -static_cast<int32_t>(mapped / 2);
+	}
+};
+
+}
+
+std::vector<uint8_t> encodeProgressiveImage(std::span<const uint8_t> pixels, uint32_t width, uint32_t height, uint32_t pixel_stride,
+	const ImageCodecOptions& options)
+{
+	assert(width > 0 && width <= 0xFFFF && height > 0 && height <= 0xFFFF && pixel_stride >= 3);
+	assert(pixels.size() >= static_cast<size_t>(width) * height * pixel_stride);
+
+	const auto planes = getPlanes(width, height);
+
+	// colour conversion (JFIF), chroma averaged over 2x2 pixels
+	std::array<std::vector<float>, 3> samples{};
+	samples[0].resize(static_cast<size_t>(width) * height);
+	samples[1].assign(static_cast<size_t>(planes[1].width) * planes[1].height, 0.0f);
+	samples[2].assign(samples[1].size(), 0.0f);
+	std::vector<uint8_t> chroma_count(samples[1].size(), 0);
+	for (uint32_t y = 0; y < height; ++y) {
+		for (uint32_t x = 0; x < width; ++x) {
+			const uint8_t* p = pixels.data() + (static_cast<size_t>(y) * width + x) * pixel_stride;
+			const float r = p[0], g = p[1], b = p[2];
+			samples[0][static_cast<size_t>(y) * width + x] = 0.299f * r + 0.587f * g + 0.114f * b;
+			const size_t c = static_cast<size_t>(y / 2) * planes[1].width + x / 2;
+			samples[1][c] += -0.168736f * r - 0.331264f * g + 0.5f * b + 128.0f;
+			samples[2][c] += 0.5f * r - 0.418688f * g - 0.081312f * b + 128.0f;
+			++chroma_count[c];
+		}
+	}
+	for (size_t c = 0; c < chroma_count.size(); ++c) {
+		samples[1][c] /= chroma_count[c];
+		samples[2][c] /= chroma_count[c];
+	}
+
+	// quantized coefficients of every block of every plane, in zigzag order
+	std::array<std::vector<std::array<int32_t, 64>>, 3> coefficients{};
+	for (uint32_t p = 0; p < 3; ++p) {
+		const Plane& plane = planes[p];
+		const auto quantization = scaleQuantization(*plane.quantization, options.quality);
+		coefficients[p].resize(static_cast<size_t>(plane.blocks_x) * plane.blocks_y);
+		for (uint32_t by = 0; by < plane.blocks_y; ++by) {
+			for (uint32_t bx = 0; bx < plane.blocks_x; ++bx) {
+				// blocks over the edge repeat the last row and column
+				std::array<float, 64> block{};
+				for (uint32_t y = 0; y < BLOCK_SIZE; ++y) {
+					const uint32_t sy = std::min(by * BLOCK_SIZE + y, plane.height - 1);
+					for (uint32_t x = 0; x < BLOCK_SIZE; ++x) {
+						const uint32_t sx = std::min(bx * BLOCK_SIZE + x, plane.width - 1);
+						block[y * BLOCK_SIZE + x] = samples[p][static_cast<size_t>(sy) * plane.width + sx] - 128.0f;
+					}
+				}
+				std::array<float, 64> transformed{};
+				forwardDct(block, transformed);
+				auto& out = coefficients[p][static_cast<size_t>(by) * plane.blocks_x + bx];
+				for (uint32_t k = 0; k < 64; ++k) {
+					out[k] = static_cast<int32_t>(std::lround(transformed[ZIGZAG[k]] / quantization[ZIGZAG[k]]));
+				}
+			}
+		}
+	}
+
+	std::vector<uint8_t> encoded{
+		static_cast<uint8_t>(width), static_cast<uint8_t>(width >> 8),
+		static_cast<uint8_t>(height), static_cast<uint8_t>(height >> 8),
+		static_cast<uint8_t>(std::clamp<uint32_t>(options.quality, 1, 100)),
+	};
+	for (const auto& [first, last] : PROGRESSIVE_SCAN_BANDS) {
+		BitWriter writer{};
+		for (uint32_t p = 0; p < 3; ++p) {
+			int32_t previous_dc = 0;
+			for (const auto& block : coefficients[p]) {
+				if (first == 0) {
+					writer.putSigned(block[0] - previous_dc);
+					previous_dc = block[0];
+					continue;
+				}
+				// zero run to the next nonzero level, a run reaching the end of the band ends the block
+				uint32_t k = first;
+				while (k <= last) {
+					uint32_t run = 0;
+					while (k + run <= last && block[k + run] == 0) {
+						++run;
+					}
+					writer.putUnsigned(run);
+					k += run;
+					if (k > last) {
+						break;
+					}
+					writer.putSigned(block[k]);
+					++k;
+				}
+			}
+		}
+		const auto& bytes = writer.getBytes();
+		for (size_t i = 0; i < SCAN_LENGTH_SIZE; ++i) {
+			encoded.push_back(static_cast<uint8_t>(bytes.size() >> (i * 8)));
+		}
+		encoded.insert(encoded.end(), bytes.begin(), bytes.end());
+	}
+	return encoded;
+}
+
+std::vector<size_t> getProgressiveScanEnds(std::span<const uint8_t> encoded)
+{
+	std::vector<size_t> ends{};
+	size_t position = HEADER_SIZE;
+	while (ends.size() < PROGRESSIVE_SCAN_BANDS.size() && position + SCAN_LENGTH_SIZE <= encoded.size()) {
+		size_t length = 0;
+		for (size_t i = 0; i < SCAN_LENGTH_SIZE; ++i) {
+			length |= static_cast<size_t>(encoded[position + i]) << (i * 8);
+		}
+		position += SCAN_LENGTH_SIZE + length;
+		ends.push_back(position);
+	}
+	return ends;
+}
+
+// Bilinear, each chroma sample sits in the middle of the 2x2 pixels it was averaged from
+static float sampleChroma(const std::vector<float>& samples, const Plane& plane, uint32_t x, uint32_t y)
+{
+	const float fx = std::clamp((static_cast<float>(x) - 0.5f) * 0.5f, 0.0f, static_cast<float>(plane.width - 1));
+	const float fy = std::clamp((static_cast<float>(y) - 0.5f) * 0.5f, 0.0f, static_cast<float>(plane.height - 1));
+	const uint32_t x0 = static_cast<uint32_t>(fx), y0 = static_cast<uint32_t>(fy);
+	const uint32_t x1 = std::min(x0 + 1, plane.width - 1), y1 = std::min(y0 + 1, plane.height - 1);
+	const float ax = fx - x0, ay = fy - y0;
+	const auto at = [&](uint32_t sx, uint32_t sy) { return samples[static_cast<size_t>(sy) * plane.width + sx]; };
+	return (at(x0, y0) * (1.0f - ax) + at(x1, y0) * ax) * (1.0f - ay) + (at(x0, y1) * (1.0f - ax) + at(x1, y1) * ax) * ay;
+}
+
+std::optional<RgbImage> decodeProgressiveImage(std::span<const uint8_t> encoded, uint32_t* num_scans_decoded)
+{
+	if (num_scans_decoded) {
+		*num_scans_decoded = 0;
+	}
+	if (encoded.size() < HEADER_SIZE) {
+		return std::nullopt;
+	}
+	const uint32_t width = encoded[0] | (static_cast<uint32_t>(encoded[1]) << 8);
+	const uint32_t height = encoded[2] | (static_cast<uint32_t>(encoded[3]) << 8);
+	const uint32_t quality = encoded[4];
+	if (width == 0 || height == 0 || quality == 0 || quality > 100) {
+		return std::nullopt;
+	}
+
+	const auto planes = getPlanes(width, height);
+	std::array<std::vector<std::array<int32_t, 64>>, 3> coefficients{};
+	for (uint32_t p = 0; p < 3; ++p) {
+		coefficients[p].assign(static_cast<size_t>(planes[p].blocks_x) * planes[p].blocks_y, {});
+	}
+
+	const auto ends = getProgressiveScanEnds(encoded);
+	size_t start = HEADER_SIZE;
+	uint32_t scans = 0;
+	for (; scans < ends.size() && ends[scans] <= encoded.size(); ++scans) {
+		const auto [first, last] = PROGRESSIVE_SCAN_BANDS[scans];
+		BitReader reader(encoded.subspan(start + SCAN_LENGTH_SIZE, ends[scans] - start - SCAN_LENGTH_SIZE));
+		start = ends[scans];
+		auto decoded = coefficients;
+		for (uint32_t p = 0; p < 3 && !reader.overrun(); ++p) {
+			int32_t previous_dc = 0;
+			for (auto& block : decoded[p]) {
+				if (first == 0) {
+					previous_dc += reader.getSigned();
+					block[0] = previous_dc;
+					continue;
+				}
+				uint32_t k = first;
+				while (k <= last && !reader.overrun()) {
+					k += reader.getUnsigned();
+					if (k > last) {
+						break;
+					}
+					block[k++] = reader.getSigned();
+				}
+			}
+		}
+		// a scan that doesn't parse is corrupt, the image stays as it was before it
+		if (reader.overrun()) {
+			break;
+		}
+		coefficients = std::move(decoded);
+	}
+	if (num_scans_decoded) {
+		*num_scans_decoded = scans;
+	}
+
+	std::array<std::vector<float>, 3> samples{};
+	for (uint32_t p = 0; p < 3; ++p) {
+		const Plane& plane = planes[p];
+		const auto quantization = scaleQuantization(*plane.quantization, quality);
+		samples[p].resize(static_cast<size_t>(plane.width) * plane.height);
+		for (uint32_t by = 0; by < plane.blocks_y; ++by) {
+			for (uint32_t bx = 0; bx < plane.blocks_x; ++bx) {
+				const auto& block = coefficients[p][static_cast<size_t>(by) * plane.blocks_x + bx];
+				std::array<float, 64> transformed{};
+				for (uint32_t k = 0; k < 64; ++k) {
+					transformed[ZIGZAG[k]] = static_cast<float>(block[k] * quantization[ZIGZAG[k]]);
+				}
+				std::array<float, 64> values{};
+				inverseDct(transformed, values);
+				for (uint32_t y = 0; y < BLOCK_SIZE && by * BLOCK_SIZE + y < plane.height; ++y) {
+					for (uint32_t x = 0; x < BLOCK_SIZE && bx * BLOCK_SIZE + x < plane.width; ++x) {
+						samples[p][static_cast<size_t>(by * BLOCK_SIZE + y) * plane.width + bx * BLOCK_SIZE + x] = values[y * BLOCK_SIZE + x] + 128.0f;
+					}
+				}
+			}
+		}
+	}
+
+	RgbImage image{};
+	image.width = width;
+	image.height = height;
+	image.pixels.resize(static_cast<size_t>(width) * height * 3);
+	const auto toByte = [](float value) { return static_cast<uint8_t>(std::clamp(std::lround(value), 0L, 255L)); };
+	for (uint32_t y = 0; y < height; ++y) {
+		for (uint32_t x = 0; x < width; ++x) {
+			const float luma = samples[0][static_cast<size_t>(y) * width + x];
+			const float cb = sampleChroma(samples[1], planes[1], x, y) - 128.0f;
+			const float cr = sampleChroma(samples[2], planes[2], x, y) - 128.0f;
+			uint8_t* out = image.pixels.data() + (static_cast<size_t>(y) * width + x) * 3;
+			out[0] = toByte(luma + 1.402f * cr);
+			out[1] = toByte(luma - 0.344136f * cb - 0.714136f * cr);
+			out[2] = toByte(luma + 1.772f * cb);
+		}
+	}
+	return image;
+}
+
+bool writePng(const RgbImage& image, const std::filesystem::path& path)
+{
+	return stbi_write_png(path.string().c_str(), static_cast<int>(image.width), static_cast<int>(image.height), 3,
+		image.pixels.data(), static_cast<int>(image.width * 3)) != 0;
+}
+
+bool writeProgressivePreviews(std::span<const uint8_t> encoded, const std::filesystem::path& prefix)
+{
+	const auto ends = getProgressiveScanEnds(encoded);
+	for (size_t i = 0; i < ends.size(); ++i) {
+		const auto image = decodeProgressiveImage(encoded.first(std::min(ends[i], encoded.size())));
+		if (!image || !writePng(*image, std::format("{}{}.png", prefix.string(), i + 1))) {
+			return false;
+		}
+	}
+	return !ends.empty();
+}
\ No newline at end of file
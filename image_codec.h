@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+#include <array>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+struct ImageCodecOptions {
+	uint32_t quality = 50; // 1 to 100, scales the JPEG quantization tables the same way libjpeg does
+};
+
+struct RgbImage {
+	std::vector<uint8_t> pixels; // R8G8B8, rows top to bottom
+	uint32_t width;
+	uint32_t height;
+};
+
+// Zigzag coefficient ranges sent by each scan, in order. The first is the DC of every block, a full 1/8 scale image.
+constexpr std::array<std::array<uint8_t, 2>, 7> PROGRESSIVE_SCAN_BANDS{ { { 0, 0 }, { 1, 2 }, { 3, 5 }, { 6, 9 }, { 10, 20 }, { 21, 35 }, { 36, 63 } } };
+
+// Progressive block DCT codec. The image is converted to YCbCr with chroma at half resolution, cut into 8x8 blocks,
+// transformed and quantized like baseline JPEG, and then sent by spectral selection: each scan holds one band of
+// coefficients of every block of every plane, so any prefix of whole scans decodes to the full image at lower detail.
+// Scans are Exp-Golomb coded (DC as differences between neighbouring blocks, AC as zero runs and levels).
+// Layout: width and height (2 bytes each, little endian), quality, then each scan as its length (4 bytes) and its bits.
+std::vector<uint8_t> encodeProgressiveImage(std::span<const uint8_t> pixels, uint32_t width, uint32_t height, uint32_t pixel_stride,
+	const ImageCodecOptions& options = {});
+
+// Byte offset in encoded at which each scan is complete
+std::vector<size_t> getProgressiveScanEnds(std::span<const uint8_t> encoded);
+
+// Decodes every scan that is complete in encoded, which can be just the start of a stream. Coefficients of the scans
+// that are missing are taken as 0. Empty if even the first few bytes aren't there or are corrupt.
+std::optional<RgbImage> decodeProgressiveImage(std::span<const uint8_t> encoded, uint32_t* num_scans_decoded = nullptr);
+
+bool writePng(const RgbImage& image, const std::filesystem::path& path);
+
+// Writes the image the way a receiver sees it after each scan arrives, to <prefix><scans>.png
+bool writeProgressivePreviews(std::span<const uint8_t> encoded, const std::filesystem::path& prefix);
\ No newline at end of file
@@ -0,0 +1,68 @@
+#include "interleaver.h"
+
+#include <cassert>
+
+#include <algorithm>
+
+Interleaver::Interleaver(const InterleaverOptions& options) : m_options(options)
+{
+	assert(options.depth >= 1);
+	assert(options.symbol_size >= 1);
+}
+
+size_t Interleaver::getInterleavedLength(size_t length) const
+{
+	assert(length % m_options.symbol_size == 0);
+	if (m_options.type != InterleaverType::Convolutional || length == 0) {
+		return length;
+	}
+	const size_t padding_symbols = static_cast<size_t>(m_options.depth - 1) * m_options.delay * m_options.depth;
+	return length + padding_symbols * m_options.symbol_size;
+}
+
+size_t Interleaver::getPosition(size_t index, size_t length) const
+{
+	const size_t symbol_size = m_options.symbol_size;
+	const size_t symbol = index / symbol_size;
+	const size_t num_symbols = length / symbol_size;
+	const size_t depth = m_options.depth;
+
+	size_t position = symbol;
+	switch (m_options.type) {
+	case InterleaverType::None:
+		break;
+	case InterleaverType::Block: {
+		const size_t columns = (num_symbols + depth - 1) / depth;
+		const size_t row = symbol / columns;
+		const size_t column = symbol % columns;
+		// every column before this one is full_rows long, plus one if it reaches into the short last row
+		const size_t full_rows = num_symbols / columns;
+		const size_t long_columns = num_symbols % columns;
+		position = column * full_rows + std::min(column, long_columns) + row;
+		break;
+	}
+	case InterleaverType::Convolutional:
+		position = symbol + (symbol % depth) * m_options.delay * depth;
+		break;
+	}
+	return position * symbol_size + index % symbol_size;
+}
+
+void Interleaver::interleave(std::span<const uint8_t> in, std::span<uint8_t> out, uint8_t fill) const
+{
+	assert(out.size() == getInterleavedLength(in.size()));
+	if (m_options.type == InterleaverType::Convolutional) {
+		std::fill(out.begin(), out.end(), fill);
+	}
+	for (size_t i = 0; i < in.size(); ++i) {
+		out[getPosition(i, in.size())] = in[i];
+	}
+}
+
+void Interleaver::deinterleave(std::span<const uint8_t> in, std::span<uint8_t> out) const
+{
+	assert(in.size() >= getInterleavedLength(out.size()));
+	for (size_t i = 0; i < out.size(); ++i) {
+		out[i] = in[getPosition(i, out.size())];
+	}
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+#include <span>
+
+enum class InterleaverType {
+	None,
+	// Symbols are written into depth rows and read out column by column, adjacent symbols end up depth apart.
+	// The last row may be short, the read-out skips the missing cells so nothing is added.
+	Block,
+	// Symbol i is delayed by (i % depth) * delay * depth, like depth FIFOs of increasing length on a commutator.
+	// Spreads as well as a block interleaver with far less latency for a receiver decoding as it goes,
+	// at the cost of (depth - 1) * delay * depth padding symbols at the end. Make depth * delay at least a codeword long.
+	Convolutional,
+};
+
+struct InterleaverOptions {
+	InterleaverType type = InterleaverType::Block;
+	uint32_t depth = 16; // rows or branches
+	uint32_t delay = 1; // convolutional only
+	uint32_t symbol_size = 1; // elements that stay together, e.g. 8 to keep the bits of a Reed-Solomon byte in one frame
+};
+
+// Reorders a stream so a burst of consecutive lost elements (a skipped frame, a blocked key) lands as isolated errors
+// spread over the original stream. Elements are bytes of any meaning: bits, soft values or erasure flags all go through
+// the same mapping, so a receiver can deinterleave what it read and which parts it knows to be missing alike.
+class Interleaver {
+	InterleaverOptions m_options;
+
+public:
+	explicit Interleaver(const InterleaverOptions& options = {});
+
+	const InterleaverOptions& getOptions() const { return m_options; }
+
+	// length must be a multiple of symbol_size
+	size_t getInterleavedLength(size_t length) const;
+
+	// Where element index of a stream of length elements ends up
+	size_t getPosition(size_t index, size_t length) const;
+
+	// out holds getInterleavedLength(in.size()) elements, positions nothing maps to are set to fill
+	void interleave(std::span<const uint8_t> in, std::span<uint8_t> out, uint8_t fill = 0) const;
+
+	// out holds the original length
+	void deinterleave(std::span<const uint8_t> in, std::span<uint8_t> out) const;
+};
\ No newline at end of file
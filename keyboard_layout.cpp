@@ -0,0 +1,209 @@
+#include "keyboard_layout.h"
+
+#include <cmath>
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+#include "my_print.h"
+
+// LEDs whose y positions are within this many mm of each other are candidates for the same row
+constexpr double ROW_TOLERANCE_MM = 3.0;
+// A y cluster needs this many LEDs to be a row rather than a stray tall key or logo LED
+constexpr size_t MIN_KEYS_PER_ROW = 4;
+// A horizontal gap this many key pitches wide separates two blocks
+constexpr double BLOCK_GAP_PITCHES = 1.1;
+// Where the main block is cut into left and right, as a fraction of its width.
+// On staggered ANSI and ISO layouts this falls between the T/G/V and Y/H/B columns, with the space bar on the left.
+constexpr double MAIN_BLOCK_SPLIT = 0.39;
+
+static double median(std::vector<double> values)
+{
+	if (values.empty()) {
+		return 0.0;
+	}
+	const auto middle = values.begin() + values.size() / 2;
+	std::nth_element(values.begin(), middle, values.end());
+	return *middle;
+}
+
+KeyboardLayout::KeyboardLayout(std::span<const CorsairLedPosition> positions)
+{
+	if (positions.empty()) {
+		return;
+	}
+
+	// cluster y positions, the centre of a cluster is its median
+	std::vector<uint32_t> by_y(positions.size());
+	std::iota(by_y.begin(), by_y.end(), 0);
+	std::stable_sort(by_y.begin(), by_y.end(), [&](uint32_t a, uint32_t b) { return positions[a].cy < positions[b].cy; });
+
+	std::vector<double> cluster{};
+	std::vector<double> row_centres{};
+	std::vector<double> all_centres{};
+	const auto endCluster = [&]() {
+		const double centre = median(cluster);
+		all_centres.push_back(centre);
+		if (cluster.size() >= MIN_KEYS_PER_ROW) {
+			row_centres.push_back(centre);
+		}
+		cluster.clear();
+		};
+	for (const uint32_t led_index : by_y) {
+		if (!cluster.empty() && positions[led_index].cy - cluster.back() > ROW_TOLERANCE_MM) {
+			endCluster();
+		}
+		cluster.push_back(positions[led_index].cy);
+	}
+	endCluster();
+	if (row_centres.empty()) {
+		// nothing looks like a keyboard row, fall back to every cluster being one
+		row_centres = all_centres;
+	}
+
+	std::vector<double> row_gaps{};
+	for (size_t i = 1; i < row_centres.size(); ++i) {
+		row_gaps.push_back(row_centres[i] - row_centres[i - 1]);
+	}
+
+	// each row owns everything up to halfway to its neighbours
+	for (const double centre : row_centres) {
+		m_rows.push_back(Row{ .y = centre, .keys = {} });
+	}
+	const double outer_reach = row_gaps.empty() ? ROW_TOLERANCE_MM : median(row_gaps) * 0.5;
+	for (uint32_t led_index = 0; led_index < positions.size(); ++led_index) {
+		const double y = positions[led_index].cy;
+		if (y < m_rows.front().y - outer_reach || y > m_rows.back().y + outer_reach) {
+			m_extra_leds.push_back(led_index);
+			continue;
+		}
+		size_t row = 0;
+		while (row + 1 < m_rows.size() && y > (m_rows[row].y + m_rows[row + 1].y) * 0.5) {
+			++row;
+		}
+		m_rows[row].keys.push_back(led_index);
+	}
+
+	std::vector<double> key_gaps{};
+	for (auto& row : m_rows) {
+		std::stable_sort(row.keys.begin(), row.keys.end(), [&](uint32_t a, uint32_t b) { return positions[a].cx < positions[b].cx; });
+		for (size_t i = 1; i < row.keys.size(); ++i) {
+			key_gaps.push_back(positions[row.keys[i]].cx - positions[row.keys[i - 1]].cx);
+		}
+	}
+	m_key_pitch = key_gaps.empty() ? 19.05 : median(key_gaps); // 19.05 mm is the standard key pitch
+	m_row_pitch = row_gaps.empty() ? m_key_pitch : median(row_gaps);
+
+	// blocks are runs of key x positions (over all rows) without a key-sized hole
+	std::vector<double> key_xs{};
+	for (const auto& row : m_rows) {
+		for (const uint32_t led_index : row.keys) {
+			key_xs.push_back(positions[led_index].cx);
+		}
+	}
+	std::sort(key_xs.begin(), key_xs.end());
+	std::vector<double> block_starts{ key_xs.front() };
+	for (size_t i = 1; i < key_xs.size(); ++i) {
+		if (key_xs[i] - key_xs[i - 1] > m_key_pitch * BLOCK_GAP_PITCHES) {
+			block_starts.push_back(key_xs[i]);
+		}
+	}
+	m_num_blocks = static_cast<uint32_t>(block_starts.size());
+	const auto blockOf = [&](uint32_t led_index) {
+		return static_cast<uint32_t>(std::upper_bound(block_starts.begin(), block_starts.end(), positions[led_index].cx) - block_starts.begin()) - 1;
+		};
+
+	for (size_t row = 0; row < m_rows.size(); ++row) {
+		for (const uint32_t led_index : m_rows[row].keys) {
+			m_ordered_keys.push_back(led_index);
+			// the top row above the numpad holds media keys on full size boards
+			if (row == 0 && m_num_blocks >= 3 && blockOf(led_index) >= 2) {
+				continue;
+			}
+			m_data_keys.push_back(led_index);
+		}
+	}
+
+	// key edges are estimated halfway to the neighbouring key in the same row and block, so wide keys like space reach far
+	const auto leftEdge = [&](const Row& row, size_t i) {
+		const uint32_t key = row.keys[i];
+		if (i > 0 && blockOf(row.keys[i - 1]) == blockOf(key)) {
+			return (positions[row.keys[i - 1]].cx + positions[key].cx) * 0.5;
+		}
+		return positions[key].cx - m_key_pitch * 0.5;
+		};
+	const auto rightEdge = [&](const Row& row, size_t i) {
+		const uint32_t key = row.keys[i];
+		if (i + 1 < row.keys.size() && blockOf(row.keys[i + 1]) == blockOf(key)) {
+			return (positions[key].cx + positions[row.keys[i + 1]].cx) * 0.5;
+		}
+		return positions[key].cx + m_key_pitch * 0.5;
+		};
+
+	double main_left = std::numeric_limits<double>::max();
+	double main_right = std::numeric_limits<double>::lowest();
+	for (const auto& row : m_rows) {
+		for (size_t i = 0; i < row.keys.size(); ++i) {
+			if (blockOf(row.keys[i]) == 0) {
+				main_left = std::min(main_left, leftEdge(row, i));
+				main_right = std::max(main_right, rightEdge(row, i));
+			}
+		}
+	}
+	const double main_split = main_left + (main_right - main_left) * MAIN_BLOCK_SPLIT;
+
+	// keys spanning the middle two rows count as the top half
+	const double half_split = m_rows.size() >= 2 ? m_rows[m_rows.size() / 2].y - m_row_pitch * 0.25 : std::numeric_limits<double>::max();
+
+	for (const auto& row : m_rows) {
+		for (size_t i = 0; i < row.keys.size(); ++i) {
+			const uint32_t key = row.keys[i];
+			const uint32_t block = blockOf(key);
+			uint32_t column{};
+			if (block == 0) {
+				column = leftEdge(row, i) < main_split ? 0 : 1;
+			}
+			else {
+				column = std::min(block + 1, 3U);
+			}
+			const uint32_t half = positions[key].cy < half_split ? 0 : 1;
+			m_sections[half * 4 + column].push_back(key);
+		}
+	}
+
+	// smaller boards lack the navigation cluster or numpad, give those sections half of the largest one instead
+	for (auto& empty : m_sections) {
+		if (!empty.empty()) {
+			continue;
+		}
+		auto& largest = *std::max_element(m_sections.begin(), m_sections.end(), [](const auto& a, const auto& b) { return a.size() < b.size(); });
+		if (largest.size() < 2) {
+			break;
+		}
+		std::vector<double> xs{};
+		for (const uint32_t key : largest) {
+			xs.push_back(positions[key].cx);
+		}
+		const double split_x = median(xs);
+		std::vector<uint32_t> left{};
+		for (const uint32_t key : largest) {
+			(positions[key].cx < split_x ? left : empty).push_back(key);
+		}
+		if (left.empty()) {
+			// every key at the same x, split by order instead
+			left.assign(largest.begin(), largest.begin() + largest.size() / 2);
+			empty.assign(largest.begin() + largest.size() / 2, largest.end());
+		}
+		largest = std::move(left);
+	}
+}
+
+void KeyboardLayout::report() const
+{
+	myPrint("Keyboard layout: {} rows, {} blocks, {} keys ({} data keys), {} other LEDs, key pitch {:.1f} mm",
+		m_rows.size(), m_num_blocks, m_ordered_keys.size(), m_data_keys.size(), m_extra_leds.size(), m_key_pitch);
+	myPrint("Sections: {} {} {} {} / {} {} {} {}",
+		m_sections[0].size(), m_sections[1].size(), m_sections[2].size(), m_sections[3].size(),
+		m_sections[4].size(), m_sections[5].size(), m_sections[6].size(), m_sections[7].size());
+}
\ No newline at end of file
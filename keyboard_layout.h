@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+#include <array>
+#include <span>
+#include <vector>
+
+#include <iCUESDK/iCUESDK.h>
+
+// Rows, key blocks and key orderings of a keyboard, worked out from its LED positions alone.
+// Rows are the y positions shared by several LEDs, keys that span two rows (ISO enter, keypad plus/enter) go to whichever
+// row centre they are nearer. LEDs too far above or below every row (logo, mute, indicators) aren't keys.
+// Blocks are the horizontal groups separated by a gap wider than a key (main block, navigation cluster, numpad).
+class KeyboardLayout {
+public:
+	static constexpr uint32_t NUM_SECTIONS = 8;
+
+	struct Row {
+		double y;
+		std::vector<uint32_t> keys; // left to right
+	};
+
+private:
+	std::vector<Row> m_rows{};
+	std::vector<uint32_t> m_ordered_keys{};
+	std::vector<uint32_t> m_data_keys{};
+	std::vector<uint32_t> m_extra_leds{};
+	std::array<std::vector<uint32_t>, NUM_SECTIONS> m_sections{};
+	double m_key_pitch = 0.0;
+	double m_row_pitch = 0.0;
+	uint32_t m_num_blocks = 0;
+
+public:
+	KeyboardLayout() = default;
+
+	explicit KeyboardLayout(std::span<const CorsairLedPosition> positions);
+
+	// Top to bottom
+	std::span<const Row> getRows() const { return m_rows; }
+
+	// Every key, row by row from the top, left to right within a row
+	std::span<const uint32_t> getOrderedKeys() const { return m_ordered_keys; }
+
+	// getOrderedKeys() without the media keys above the numpad, these are the 105 keys used for data on a K70
+	std::span<const uint32_t> getDataKeys() const { return m_data_keys; }
+
+	// LEDs that aren't part of any row
+	std::span<const uint32_t> getExtraLeds() const { return m_extra_leds; }
+
+	// The keyboard split into top and bottom halves, each cut into 4 column groups:
+	// left and right of the main block, the navigation cluster and the numpad.
+	// Sections 0-3 are the top half left to right, 4-7 the bottom half. Within a section keys are in getOrderedKeys() order.
+	// Boards missing a block have their largest sections split so no section is empty.
+	const std::array<std::vector<uint32_t>, NUM_SECTIONS>& getSections() const { return m_sections; }
+
+	// Typical distance between neighbouring key centres in a row, in mm
+	double getKeyPitch() const { return m_key_pitch; }
+
+	void report() const;
+};
\ No newline at end of file
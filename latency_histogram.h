@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+
+// Lock-free log-linear histogram of durations in nanoseconds.
+// record() may be called from any number of threads at once, reading and reset() should happen while nothing is recording.
+// Values below 32 ns are exact, above that every power of two is split into 32 buckets (about 3% resolution).
+class LatencyHistogram {
+	static constexpr uint32_t SUB_BUCKET_BITS = 5;
+	static constexpr uint32_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	static constexpr uint32_t NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+	std::array<std::atomic<uint64_t>, NUM_BUCKETS> m_buckets{};
+	std::atomic<uint64_t> m_count{};
+	std::atomic<uint64_t> m_max{};
+
+	static uint32_t bucketIndex(uint64_t value)
+	{
+		if (value < SUB_BUCKETS) {
+			return static_cast<uint32_t>(value);
+		}
+		const uint32_t shift = static_cast<uint32_t>(std::bit_width(value)) - 1 - SUB_BUCKET_BITS;
+		return (shift + 1) * SUB_BUCKETS + static_cast<uint32_t>((value >> shift) & (SUB_BUCKETS - 1));
+	}
+
+	static uint64_t bucketUpperBound(uint32_t index)
+	{
+		if (index < SUB_BUCKETS) {
+			return index;
+		}
+		const uint32_t shift = index / SUB_BUCKETS - 1;
+		const uint64_t lower = static_cast<uint64_t>(SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+		return lower + ((1ULL << shift) - 1);
+	}
+
+public:
+	void record(uint64_t value_ns)
+	{
+		m_buckets[bucketIndex(value_ns)].fetch_add(1, std::memory_order_relaxed);
+		m_count.fetch_add(1, std::memory_order_relaxed);
+		uint64_t max = m_max.load(std::memory_order_relaxed);
+		while (value_ns > max && !m_max.compare_exchange_weak(max, value_ns, std::memory_order_relaxed)) {
+		}
+	}
+
+	void reset()
+	{
+		for (auto& bucket : m_buckets) {
+			bucket.store(0, std::memory_order_relaxed);
+		}
+		m_count.store(0, std::memory_order_relaxed);
+		m_max.store(0, std::memory_order_relaxed);
+	}
+
+	uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+
+	uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+
+	// p from 0 to 1, returns 0 if nothing was recorded
+	uint64_t percentile(double p) const
+	{
+		const uint64_t total = count();
+		if (total == 0) {
+			return 0;
+		}
+		const uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * static_cast<double>(total))));
+		uint64_t seen = 0;
+		for (uint32_t i = 0; i < NUM_BUCKETS; ++i) {
+			seen += m_buckets[i].load(std::memory_order_relaxed);
+			if (seen >= target) {
+				return std::min(bucketUpperBound(i), max());
+			}
+		}
+		return max();
+	}
+};
\ No newline at end of file
@@ -0,0 +1,303 @@
+#include "led_color_store.h"
+
+#include <cassert>
+#include <cstring>
+
+#include <algorithm>
+#include <bit>
+
+#include <immintrin.h>
+
+void LedColorStore::init(std::span<const CorsairLedPosition> positions)
+{
+	assert(positions.size() <= CAPACITY);
+	m_count = static_cast<uint32_t>(positions.size());
+	m_r.fill(0);
+	m_g.fill(0);
+	m_b.fill(0);
+	m_dirty.fill(0);
+	m_ids.fill(0);
+	for (uint32_t i = 0; i < m_count; ++i) {
+		m_ids[i] = positions[i].id;
+	}
+}
+
+// Stores new_r/g/b at i and returns 0xFF for every lane that changed
+static __m128i storeChanged(uint8_t* r, uint8_t* g, uint8_t* b, __m128i new_r, __m128i new_g, __m128i new_b)
+{
+	const __m128i old_r = _mm_load_si128(reinterpret_cast<const __m128i*>(r));
+	const __m128i old_g = _mm_load_si128(reinterpret_cast<const __m128i*>(g));
+	const __m128i old_b = _mm_load_si128(reinterpret_cast<const __m128i*>(b));
+	const __m128i same = _mm_and_si128(_mm_cmpeq_epi8(old_r, new_r), _mm_and_si128(_mm_cmpeq_epi8(old_g, new_g), _mm_cmpeq_epi8(old_b, new_b)));
+	_mm_store_si128(reinterpret_cast<__m128i*>(r), new_r);
+	_mm_store_si128(reinterpret_cast<__m128i*>(g), new_g);
+	_mm_store_si128(reinterpret_cast<__m128i*>(b), new_b);
+	return _mm_andnot_si128(same, _mm_set1_epi8(-1));
+}
+
+static void orDirty(uint8_t* dirty, __m128i changed)
+{
+	__m128i* p = reinterpret_cast<__m128i*>(dirty);
+	_mm_store_si128(p, _mm_or_si128(_mm_load_si128(p), changed));
+}
+
+// Mask of the lanes in the block starting at i that are real LEDs
+static __m128i validLanes(uint32_t i, uint32_t count)
+{
+	const __m128i lane = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const int remaining = static_cast<int>(std::min<uint32_t>(count - i, LedColorStore::LANES));
+	return _mm_cmplt_epi8(lane, _mm_set1_epi8(static_cast<char>(remaining)));
+}
+
+void LedColorStore::fill(uint8_t r, uint8_t g, uint8_t b)
+{
+	const __m128i fill_r = _mm_set1_epi8(static_cast<char>(r));
+	const __m128i fill_g = _mm_set1_epi8(static_cast<char>(g));
+	const __m128i fill_b = _mm_set1_epi8(static_cast<char>(b));
+	for (uint32_t i = 0; i < m_count; i += LANES) {
+		const __m128i valid = validLanes(i, m_count);
+		const __m128i old_r = _mm_load_si128(reinterpret_cast<const __m128i*>(&m_r[i]));
+		const __m128i old_g = _mm_load_si128(reinterpret_cast<const __m128i*>(&m_g[i]));
+		const __m128i old_b = _mm_load_si128(reinterpret_cast<const __m128i*>(&m_b[i]));
+		// padding lanes keep their (zero) value
+		const __m128i changed = storeChanged(&m_r[i], &m_g[i], &m_b[i],
+			_mm_or_si128(_mm_and_si128(valid, fill_r), _mm_andnot_si128(valid, old_r)),
+			_mm_or_si128(_mm_and_si128(valid, fill_g), _mm_andnot_si128(valid, old_g)),
+			_mm_or_si128(_mm_and_si128(valid, fill_b), _mm_andnot_si128(valid, old_b)));
+		orDirty(&m_dirty[i], changed);
+	}
+}
+
+void LedColorStore::fillMasked(std::span<const uint8_t> mask, uint8_t r, uint8_t g, uint8_t b)
+{
+	assert(mask.size() >= m_count);
+
+	const __m128i fill_r = _mm_set1_epi8(static_cast<char>(r));
+	const __m128i fill_g = _mm_set1_epi8(static_cast<char>(g));
+	const __m128i fill_b = _mm_set1_epi8(static_cast<char>(b));
+	const uint32_t whole_blocks_end = m_count / LANES * LANES;
+	for (uint32_t i = 0; i < whole_blocks_end; i += LANES) {
+		const __m128i select = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&mask[i])), _mm_setzero_si128()), _mm_set1_epi8(-1));
+		const __m128i old_r = _mm_load_si128(reinterpret_cast<const __m128i*>(&m_r[i]));
+		const __m128i old_g = _mm_load_si128(reinterpret_cast<const __m128i*>(&m_g[i]));
+		const __m128i old_b = _mm_load_si128(reinterpret_cast<const __m128i*>(&m_b[i]));
+		const __m128i changed = storeChanged(&m_r[i], &m_g[i], &m_b[i],
+			_mm_or_si128(_mm_and_si128(select, fill_r), _mm_andnot_si128(select, old_r)),
+			_mm_or_si128(_mm_and_si128(select, fill_g), _mm_andnot_si128(select, old_g)),
+			_mm_or_si128(_mm_and_si128(select, fill_b), _mm_andnot_si128(select, old_b)));
+		orDirty(&m_dirty[i], changed);
+	}
+	// the mask doesn't have to be padded so the last partial block is done one LED at a time
+	for (uint32_t i = whole_blocks_end; i < m_count; ++i) {
+		if (mask[i]) {
+			set(i, r, g, b);
+		}
+	}
+}
+
+// R, G and B planes of 16 RGBX pixels held as 4 blocks of 4
+static void splitPixels(const __m128i* pixels, __m128i& r, __m128i& g, __m128i& b)
+{
+	// each round of unpacking halves the distance between bytes of the same channel
+	const __m128i t0 = _mm_unpacklo_epi8(pixels[0], pixels[1]);
+	const __m128i t1 = _mm_unpackhi_epi8(pixels[0], pixels[1]);
+	const __m128i t2 = _mm_unpacklo_epi8(pixels[2], pixels[3]);
+	const __m128i t3 = _mm_unpackhi_epi8(pixels[2], pixels[3]);
+	const __m128i u0 = _mm_unpacklo_epi8(t0, t1);
+	const __m128i u1 = _mm_unpackhi_epi8(t0, t1);
+	const __m128i u2 = _mm_unpacklo_epi8(t2, t3);
+	const __m128i u3 = _mm_unpackhi_epi8(t2, t3);
+	// R and G of pixels 0-7, B and X of pixels 0-7, then the same for 8-15
+	const __m128i rg_lo = _mm_unpacklo_epi8(u0, u1);
+	const __m128i bx_lo = _mm_unpackhi_epi8(u0, u1);
+	const __m128i rg_hi = _mm_unpacklo_epi8(u2, u3);
+	const __m128i bx_hi = _mm_unpackhi_epi8(u2, u3);
+	r = _mm_unpacklo_epi64(rg_lo, rg_hi);
+	g = _mm_unpackhi_epi64(rg_lo, rg_hi);
+	b = _mm_unpacklo_epi64(bx_lo, bx_hi);
+}
+
+void LedColorStore::gather(std::span<const uint8_t> pixels, uint32_t pixel_stride, std::span<const int32_t> source_for_led)
+{
+	assert(pixel_stride == 3 || pixel_stride == 4);
+	assert(source_for_led.size() >= m_count);
+
+	// 16 LEDs at a time. SSE2 has no gather, so each pixel is fetched as one 32-bit load (with stride 3 the top byte is
+	// the next pixel's red and is dropped), then the block is split into planes and compared and stored like fill().
+	const uint32_t whole_blocks_end = m_count / LANES * LANES;
+	const __m128i no_source = _mm_set1_epi32(-1);
+	for (uint32_t i = 0; i < whole_blocks_end; i += LANES) {
+		alignas(16) std::array<uint32_t, LANES> fetched;
+		for (uint32_t lane = 0; lane < LANES; ++lane) {
+			const int32_t source = source_for_led[i + lane];
+			uint32_t pixel = 0;
+			if (source >= 0) {
+				const size_t offset = static_cast<size_t>(source) * pixel_stride;
+				assert(offset + 2 < pixels.size());
+				if (offset + 4 <= pixels.size()) {
+					std::memcpy(&pixel, &pixels[offset], 4);
+				}
+				else {
+					// the last pixel of an RGB image, a 32-bit load would read past the end
+					pixel = pixels[offset] | (pixels[offset + 1] << 8) | (pixels[offset + 2] << 16);
+				}
+			}
+			fetched[lane] = pixel;
+		}
+		const __m128i* blocks = reinterpret_cast<const __m128i*>(fetched.data());
+		__m128i new_r, new_g, new_b;
+		splitPixels(blocks, new_r, new_g, new_b);
+
+		// LEDs without a source keep their color
+		const __m128i* sources = reinterpret_cast<const __m128i*>(&source_for_led[i]);
+		const __m128i use = _mm_packs_epi16(
+			_mm_packs_epi32(_mm_cmpgt_epi32(_mm_loadu_si128(sources + 0), no_source), _mm_cmpgt_epi32(_mm_loadu_si128(sources + 1), no_source)),
+			_mm_packs_epi32(_mm_cmpgt_epi32(_mm_loadu_si128(sources + 2), no_source), _mm_cmpgt_epi32(_mm_loadu_si128(sources + 3), no_source)));
+		const __m128i old_r = _mm_load_si128(reinterpret_cast<const __m128i*>(&m_r[i]));
+		const __m128i old_g = _mm_load_si128(reinterpret_cast<const __m128i*>(&m_g[i]));
+		const __m128i old_b = _mm_load_si128(reinterpret_cast<const __m128i*>(&m_b[i]));
+		const __m128i changed = storeChanged(&m_r[i], &m_g[i], &m_b[i],
+			_mm_or_si128(_mm_and_si128(use, new_r), _mm_andnot_si128(use, old_r)),
+			_mm_or_si128(_mm_and_si128(use, new_g), _mm_andnot_si128(use, old_g)),
+			_mm_or_si128(_mm_and_si128(use, new_b), _mm_andnot_si128(use, old_b)));
+		orDirty(&m_dirty[i], changed);
+	}
+	// source_for_led doesn't have to be padded so the last partial block is done one LED at a time
+	for (uint32_t i = whole_blocks_end; i < m_count; ++i) {
+		const int32_t source = source_for_led[i];
+		if (source >= 0) {
+			const size_t offset = static_cast<size_t>(source) * pixel_stride;
+			assert(offset + 2 < pixels.size());
+			set(i, pixels[offset + 0], pixels[offset + 1], pixels[offset + 2]);
+		}
+	}
+}
+
+// x / 255 rounded, exact for x up to 255 * 255
+static __m128i div255(__m128i x)
+{
+	const __m128i t = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// (old * (255 - alpha) + target * alpha) / 255 for 16 bytes
+static __m128i blendChannel(__m128i old, __m128i target_times_alpha, __m128i inv_alpha)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lo = div255(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(old, zero), inv_alpha), target_times_alpha));
+	const __m128i hi = div255(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(old, zero), inv_alpha), target_times_alpha));
+	return _mm_packus_epi16(lo, hi);
+}
+
+void LedColorStore::blend(uint8_t r, uint8_t g, uint8_t b, uint8_t alpha)
+{
+	const __m128i inv_alpha = _mm_set1_epi16(static_cast<short>(255 - alpha));
+	const __m128i r_times_alpha = _mm_set1_epi16(static_cast<short>(r * alpha));
+	const __m128i g_times_alpha = _mm_set1_epi16(static_cast<short>(g * alpha));
+	const __m128i b_times_alpha = _mm_set1_epi16(static_cast<short>(b * alpha));
+	for (uint32_t i = 0; i < m_count; i += LANES) {
+		const __m128i valid = validLanes(i, m_count);
+		const __m128i old_r = _mm_load_si128(reinterpret_cast<const __m128i*>(&m_r[i]));
+		const __m128i old_g = _mm_load_si128(reinterpret_cast<const __m128i*>(&m_g[i]));
+		const __m128i old_b = _mm_load_si128(reinterpret_cast<const __m128i*>(&m_b[i]));
+		const __m128i changed = storeChanged(&m_r[i], &m_g[i], &m_b[i],
+			_mm_or_si128(_mm_and_si128(valid, blendChannel(old_r, r_times_alpha, inv_alpha)), _mm_andnot_si128(valid, old_r)),
+			_mm_or_si128(_mm_and_si128(valid, blendChannel(old_g, g_times_alpha, inv_alpha)), _mm_andnot_si128(valid, old_g)),
+			_mm_or_si128(_mm_and_si128(valid, blendChannel(old_b, b_times_alpha, inv_alpha)), _mm_andnot_si128(valid, old_b)));
+		orDirty(&m_dirty[i], changed);
+	}
+}
+
+void LedColorStore::markAllDirty()
+{
+	std::fill(m_dirty.begin(), m_dirty.begin() + m_count, static_cast<uint8_t>(0xFF));
+}
+
+void LedColorStore::clearDirty()
+{
+	std::fill(m_dirty.begin(), m_dirty.begin() + paddedCount(), static_cast<uint8_t>(0));
+}
+
+// Interleaves count LEDs from separate R, G and B arrays (16-byte aligned) into out
+static void interleave(const uint8_t* r_plane, const uint8_t* g_plane, const uint8_t* b_plane, const CorsairLedLuid* ids, uint32_t count, CorsairLedColor* out)
+{
+	static_assert(sizeof(CorsairLedColor) == 8);
+
+	const __m128i alpha = _mm_set1_epi8(-1);
+	uint32_t i = 0;
+	for (; i + LedColorStore::LANES <= count; i += LedColorStore::LANES) {
+		const __m128i r = _mm_load_si128(reinterpret_cast<const __m128i*>(r_plane + i));
+		const __m128i g = _mm_load_si128(reinterpret_cast<const __m128i*>(g_plane + i));
+		const __m128i b = _mm_load_si128(reinterpret_cast<const __m128i*>(b_plane + i));
+
+		// interleave into 16 RGBA dwords, then pair each with its id
+		const __m128i rg_lo = _mm_unpacklo_epi8(r, g);
+		const __m128i rg_hi = _mm_unpackhi_epi8(r, g);
+		const __m128i ba_lo = _mm_unpacklo_epi8(b, alpha);
+		const __m128i ba_hi = _mm_unpackhi_epi8(b, alpha);
+		const __m128i rgba[4]{
+			_mm_unpacklo_epi16(rg_lo, ba_lo), _mm_unpackhi_epi16(rg_lo, ba_lo),
+			_mm_unpacklo_epi16(rg_hi, ba_hi), _mm_unpackhi_epi16(rg_hi, ba_hi),
+		};
+		__m128i* dst = reinterpret_cast<__m128i*>(out + i);
+		for (int quarter = 0; quarter < 4; ++quarter) {
+			const __m128i id_block = _mm_load_si128(reinterpret_cast<const __m128i*>(ids + i + quarter * 4));
+			_mm_storeu_si128(dst + quarter * 2 + 0, _mm_unpacklo_epi32(id_block, rgba[quarter]));
+			_mm_storeu_si128(dst + quarter * 2 + 1, _mm_unpackhi_epi32(id_block, rgba[quarter]));
+		}
+	}
+	for (; i < count; ++i) {
+		out[i] = CorsairLedColor{ .id = ids[i], .r = r_plane[i], .g = g_plane[i], .b = b_plane[i], .a = 255 };
+	}
+}
+
+void LedColorStore::packAll(CorsairLedColor* out, const TransferFunction* transfer, const CalibrationProfile* calibration) const
+{
+	if (!transfer && !calibration) {
+		interleave(m_r.data(), m_g.data(), m_b.data(), m_ids.data(), m_count, out);
+		return;
+	}
+
+	// the stored colors stay as they were set, only what gets sent is corrected
+	alignas(16) std::array<std::array<uint8_t, CAPACITY>, 3> corrected;
+	const std::array<const uint8_t*, 3> planes{ m_r.data(), m_g.data(), m_b.data() };
+	for (uint32_t channel = 0; channel < 3; ++channel) {
+		if (transfer) {
+			applyTransferCurve(transfer->getCurve(channel), transfer->getWideCurve(channel), planes[channel], corrected[channel].data(), m_count);
+		}
+		else {
+			std::memcpy(corrected[channel].data(), planes[channel], m_count);
+		}
+		if (calibration) {
+			calibration->apply(channel, corrected[channel].data(), m_count);
+		}
+	}
+	interleave(corrected[0].data(), corrected[1].data(), corrected[2].data(), m_ids.data(), m_count, out);
+}
+
+uint32_t LedColorStore::packDirty(CorsairLedColor* out, const TransferFunction* transfer, const CalibrationProfile* calibration) const
+{
+	uint32_t num_written = 0;
+	for (uint32_t i = 0; i < m_count; i += LANES) {
+		// padding lanes are never dirty
+		uint32_t bits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(&m_dirty[i]))));
+		while (bits != 0) {
+			const uint32_t lane = static_cast<uint32_t>(std::countr_zero(bits));
+			const uint32_t led_index = i + lane;
+			CorsairLedColor color = get(led_index);
+			if (transfer) {
+				color.r = transfer->getCurve(0)[color.r];
+				color.g = transfer->getCurve(1)[color.g];
+				color.b = transfer->getCurve(2)[color.b];
+			}
+			if (calibration) {
+				color.r = calibration->applyOne(0, led_index, color.r);
+				color.g = calibration->applyOne(1, led_index, color.g);
+				color.b = calibration->applyOne(2, led_index, color.b);
+			}
+			out[num_written++] = color;
+			bits &= bits - 1;
+		}
+	}
+	return num_written;
+}
\ No newline at end of file
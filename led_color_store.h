@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+
+#include <array>
+#include <span>
+
+#include <iCUESDK/iCUESDK.h>
+
+#include "calibration_profile.h"
+#include "transfer_function.h"
+
+// LED colors of one device as separate R, G and B arrays so bulk operations work on 16 LEDs per SSE2 instruction.
+// Every write compares against the current color and marks LEDs whose color changed as dirty.
+// The CorsairLedColor array the SDK wants is only produced when packing for submission.
+class LedColorStore {
+public:
+	static constexpr uint32_t CAPACITY = CORSAIR_DEVICE_LEDCOUNT_MAX;
+	static constexpr uint32_t LANES = 16;
+	static_assert(CAPACITY % LANES == 0);
+
+private:
+	alignas(16) std::array<uint8_t, CAPACITY> m_r{};
+	alignas(16) std::array<uint8_t, CAPACITY> m_g{};
+	alignas(16) std::array<uint8_t, CAPACITY> m_b{};
+	alignas(16) std::array<uint8_t, CAPACITY> m_dirty{}; // 0xFF if changed since clearDirty(), always 0 past m_count
+	alignas(16) std::array<CorsairLedLuid, CAPACITY> m_ids{};
+	uint32_t m_count = 0;
+
+	// LEDs past m_count are processed too (and never change), bulk loops just run over whole blocks of 16
+	uint32_t paddedCount() const { return (m_count + LANES - 1) / LANES * LANES; }
+
+public:
+	// All LEDs start black
+	void init(std::span<const CorsairLedPosition> positions);
+
+	uint32_t size() const { return m_count; }
+
+	void set(uint32_t led_index, uint8_t r, uint8_t g, uint8_t b)
+	{
+		if (m_r[led_index] != r || m_g[led_index] != g || m_b[led_index] != b) {
+			m_r[led_index] = r;
+			m_g[led_index] = g;
+			m_b[led_index] = b;
+			m_dirty[led_index] = 0xFF;
+		}
+	}
+
+	CorsairLedColor get(uint32_t led_index) const
+	{
+		return CorsairLedColor{ .id = m_ids[led_index], .r = m_r[led_index], .g = m_g[led_index], .b = m_b[led_index], .a = 255 };
+	}
+
+	void fill(uint8_t r, uint8_t g, uint8_t b);
+
+	// Sets every LED whose mask byte is non-zero, mask has one byte per LED
+	void fillMasked(std::span<const uint8_t> mask, uint8_t r, uint8_t g, uint8_t b);
+
+	// LED i takes the pixel at pixels[source_for_led[i] * pixel_stride] (R, G, B in that order), or keeps its color if that is negative.
+	// pixel_stride is 3 for RGB or 4 for RGBA, source_for_led has one entry per LED.
+	void gather(std::span<const uint8_t> pixels, uint32_t pixel_stride, std::span<const int32_t> source_for_led);
+
+	// Moves every LED towards (r, g, b) by alpha / 255
+	void blend(uint8_t r, uint8_t g, uint8_t b, uint8_t alpha);
+
+	void markAllDirty();
+
+	void clearDirty();
+
+	// Writes every LED to out, which must hold size() colors.
+	// If transfer isn't null each channel is passed through its curve on the way out, then through calibration if that isn't null.
+	void packAll(CorsairLedColor* out, const TransferFunction* transfer = nullptr, const CalibrationProfile* calibration = nullptr) const;
+
+	// Writes only the dirty LEDs to out in index order and returns how many
+	uint32_t packDirty(CorsairLedColor* out, const TransferFunction* transfer = nullptr, const CalibrationProfile* calibration = nullptr) const;
+};
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include "led_color_store_test.h"
+
+#include <array>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "corsair_helpers.h"
+#include "led_color_store.h"
+#include "my_print.h"
+
+void ledColorStoreGatherTest(int rounds)
+{
+	std::array<CorsairLedPosition, LedColorStore::CAPACITY> positions{};
+	for (uint32_t i = 0; i < positions.size(); ++i) {
+		positions[i].id = i + 1;
+	}
+
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<int> channel(0, 255);
+	const auto store = std::make_unique<LedColorStore>();
+	const auto reference = std::make_unique<LedColorStore>();
+	std::vector<CorsairLedColor> store_dirty(LedColorStore::CAPACITY);
+	std::vector<CorsairLedColor> reference_dirty(LedColorStore::CAPACITY);
+	for (int round = 0; round < rounds; ++round) {
+		const uint32_t count = std::uniform_int_distribution<uint32_t>(1, LedColorStore::CAPACITY)(rng);
+		const uint32_t pixel_stride = round % 2 == 0 ? 3 : 4;
+		const uint32_t num_pixels = std::uniform_int_distribution<uint32_t>(1, 64)(rng);
+
+		std::vector<uint8_t> pixels(static_cast<size_t>(num_pixels) * pixel_stride);
+		for (uint8_t& value : pixels) {
+			value = static_cast<uint8_t>(channel(rng));
+		}
+		// a quarter without a source, and plenty that want the last pixel, which can't be read as 32 bits with RGB
+		std::vector<int32_t> source_for_led(count);
+		for (int32_t& source : source_for_led) {
+			const uint32_t pick = rng() % 8;
+			source = pick < 2 ? -1 : (pick == 2 ? static_cast<int32_t>(num_pixels) - 1 : static_cast<int32_t>(rng() % num_pixels));
+		}
+
+		// both start from the same colors, some of which already match their pixel so aren't marked dirty
+		store->init(std::span(positions).first(count));
+		reference->init(std::span(positions).first(count));
+		for (uint32_t i = 0; i < count; ++i) {
+			uint8_t r = static_cast<uint8_t>(channel(rng)), g = static_cast<uint8_t>(channel(rng)), b = static_cast<uint8_t>(channel(rng));
+			if (source_for_led[i] >= 0 && rng() % 2 == 0) {
+				const size_t offset = static_cast<size_t>(source_for_led[i]) * pixel_stride;
+				r = pixels[offset + 0];
+				g = pixels[offset + 1];
+				b = pixels[offset + 2];
+			}
+			store->set(i, r, g, b);
+			reference->set(i, r, g, b);
+		}
+		store->clearDirty();
+		reference->clearDirty();
+
+		store->gather(pixels, pixel_stride, source_for_led);
+		for (uint32_t i = 0; i < count; ++i) {
+			if (source_for_led[i] >= 0) {
+				const size_t offset = static_cast<size_t>(source_for_led[i]) * pixel_stride;
+				reference->set(i, pixels[offset + 0], pixels[offset + 1], pixels[offset + 2]);
+			}
+		}
+
+		const uint32_t num_dirty = store->packDirty(store_dirty.data());
+		if (num_dirty != reference->packDirty(reference_dirty.data())) {
+			die("gather() marked {} LEDs dirty instead of {} (round {}, {} LEDs, stride {})", num_dirty,
+				reference->packDirty(reference_dirty.data()), round, count, pixel_stride);
+		}
+		for (uint32_t i = 0; i < num_dirty; ++i) {
+			const CorsairLedColor& got = store_dirty[i];
+			const CorsairLedColor& wanted = reference_dirty[i];
+			if (got.id != wanted.id || got.r != wanted.r || got.g != wanted.g || got.b != wanted.b) {
+				die("gather() set LED {} to {} {} {}, set() gives LED {} {} {} {} (round {}, {} LEDs, stride {})", got.id, got.r, got.g, got.b,
+					wanted.id, wanted.r, wanted.g, wanted.b, round, count, pixel_stride);
+			}
+		}
+		for (uint32_t i = 0; i < count; ++i) {
+			const CorsairLedColor got = store->get(i);
+			const CorsairLedColor wanted = reference->get(i);
+			if (got.r != wanted.r || got.g != wanted.g || got.b != wanted.b) {
+				die("gather() left LED {} at {} {} {} instead of {} {} {} (round {}, {} LEDs, stride {})", i, got.r, got.g, got.b,
+					wanted.r, wanted.g, wanted.b, round, count, pixel_stride);
+			}
+		}
+	}
+	myPrint("LedColorStore::gather() matches set() in all {} rounds", rounds);
+}
\ No newline at end of file
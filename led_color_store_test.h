@@ -0,0 +1,6 @@
+#pragma once
+
+// Checks LedColorStore::gather(), which works on 16 LEDs at a time, against setting each LED on its own. Random LED
+// counts (so whole and partial blocks), RGB and RGBA pixels and LEDs without a source, no device needed.
+// Dies on the first LED that differs.
+void ledColorStoreGatherTest(int rounds = 2000);
\ No newline at end of file
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+#include <algorithm>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include <iCUESDK/iCUESDK.h>
+
+#include "static_vector.h"
+
+// LED indices returned by geometry queries, always in ascending order
+using LedIndexList = static_vector<uint32_t, CORSAIR_DEVICE_LEDCOUNT_MAX>;
+
+// Uniform grid over the LED positions of a device, built once.
+// Cells are sized for about one LED each and stored CSR-style (one offset per cell into a single array),
+// so a query only looks at the LEDs in cells that overlap it and never allocates.
+class LedSpatialIndex {
+	struct Point {
+		double x, y; // same precision as CorsairLedPosition so queries match a linear scan exactly
+		uint32_t led_index;
+	};
+
+	double m_min_x = 0.0;
+	double m_min_y = 0.0;
+	double m_inv_cell_size = 1.0;
+	double m_cell_size = 1.0;
+	int m_cells_x = 1;
+	int m_cells_y = 1;
+	std::vector<uint32_t> m_cell_start{}; // LEDs of cell c are m_points[m_cell_start[c]] up to m_points[m_cell_start[c + 1]]
+	std::vector<Point> m_points{};
+
+	int cellX(double x) const { return std::clamp(static_cast<int>(std::floor((x - m_min_x) * m_inv_cell_size)), 0, m_cells_x - 1); }
+	int cellY(double y) const { return std::clamp(static_cast<int>(std::floor((y - m_min_y) * m_inv_cell_size)), 0, m_cells_y - 1); }
+
+	std::span<const Point> cellPoints(int x, int y) const
+	{
+		const uint32_t cell = static_cast<uint32_t>(y * m_cells_x + x);
+		return std::span<const Point>(m_points).subspan(m_cell_start[cell], m_cell_start[cell + 1] - m_cell_start[cell]);
+	}
+
+public:
+	LedSpatialIndex() = default;
+
+	explicit LedSpatialIndex(std::span<const CorsairLedPosition> positions)
+	{
+		if (positions.empty()) {
+			m_cell_start.assign(2, 0);
+			return;
+		}
+
+		double max_x = std::numeric_limits<double>::lowest();
+		double max_y = std::numeric_limits<double>::lowest();
+		m_min_x = std::numeric_limits<double>::max();
+		m_min_y = std::numeric_limits<double>::max();
+		for (const auto& position : positions) {
+			m_min_x = std::min(m_min_x, position.cx);
+			m_min_y = std::min(m_min_y, position.cy);
+			max_x = std::max(max_x, position.cx);
+			max_y = std::max(max_y, position.cy);
+		}
+
+		// about one LED per cell, positions are in millimetres so clamp to something sensible for degenerate layouts
+		const double width = std::max(max_x - m_min_x, 1.0);
+		const double height = std::max(max_y - m_min_y, 1.0);
+		m_cell_size = std::max(std::sqrt(width * height / static_cast<double>(positions.size())), 1.0);
+		m_inv_cell_size = 1.0 / m_cell_size;
+		m_cells_x = static_cast<int>(width * m_inv_cell_size) + 1;
+		m_cells_y = static_cast<int>(height * m_inv_cell_size) + 1;
+
+		// counting sort into cells, LEDs keep ascending index order within a cell
+		const uint32_t num_cells = static_cast<uint32_t>(m_cells_x * m_cells_y);
+		m_cell_start.assign(num_cells + 1, 0);
+		for (const auto& position : positions) {
+			++m_cell_start[cellY(position.cy) * m_cells_x + cellX(position.cx) + 1];
+		}
+		for (uint32_t cell = 0; cell < num_cells; ++cell) {
+			m_cell_start[cell + 1] += m_cell_start[cell];
+		}
+		std::vector<uint32_t> fill(m_cell_start.begin(), m_cell_start.end() - 1);
+		m_points.resize(positions.size());
+		for (uint32_t i = 0; i < positions.size(); ++i) {
+			const double x = positions[i].cx;
+			const double y = positions[i].cy;
+			m_points[fill[cellY(y) * m_cells_x + cellX(x)]++] = Point{ x, y, i };
+		}
+	}
+
+	// LEDs with left <= x < left + width and top <= y < top + height
+	void queryRect(float left, float top, float width, float height, LedIndexList& out) const
+	{
+		out.clear();
+		const float right = left + width;
+		const float bottom = top + height;
+		if (m_points.empty() || right <= left || bottom <= top) {
+			return;
+		}
+
+		for (int y = cellY(top); y <= cellY(bottom); ++y) {
+			for (int x = cellX(left); x <= cellX(right); ++x) {
+				for (const Point& point : cellPoints(x, y)) {
+					if (point.x >= left && point.x < right && point.y >= top && point.y < bottom) {
+						out.push_back(point.led_index);
+					}
+				}
+			}
+		}
+		std::sort(out.begin(), out.end());
+	}
+
+	// LEDs within radius of (x, y), inclusive
+	void queryRadius(float center_x, float center_y, float radius, LedIndexList& out) const
+	{
+		out.clear();
+		if (m_points.empty() || radius < 0.0f) {
+			return;
+		}
+
+		const double radius_sq = static_cast<double>(radius) * radius;
+		for (int y = cellY(center_y - radius); y <= cellY(center_y + radius); ++y) {
+			for (int x = cellX(center_x - radius); x <= cellX(center_x + radius); ++x) {
+				for (const Point& point : cellPoints(x, y)) {
+					const double dx = point.x - center_x;
+					const double dy = point.y - center_y;
+					if (dx * dx + dy * dy <= radius_sq) {
+						out.push_back(point.led_index);
+					}
+				}
+			}
+		}
+		std::sort(out.begin(), out.end());
+	}
+
+	// Index of the LED closest to (x, y), the lowest index wins ties. There must be at least one LED.
+	uint32_t queryNearest(float x, float y) const
+	{
+		assert(!m_points.empty());
+
+		const int start_x = cellX(x);
+		const int start_y = cellY(y);
+		const int max_ring = std::max(m_cells_x, m_cells_y);
+
+		uint32_t best_index = std::numeric_limits<uint32_t>::max();
+		double best_dist_sq = std::numeric_limits<double>::max();
+		const auto consider = [&](int cell_x, int cell_y) {
+			if (cell_x < 0 || cell_x >= m_cells_x || cell_y < 0 || cell_y >= m_cells_y) {
+				return;
+			}
+			for (const Point& point : cellPoints(cell_x, cell_y)) {
+				const double dx = point.x - x;
+				const double dy = point.y - y;
+				const double dist_sq = dx * dx + dy * dy;
+				if (dist_sq < best_dist_sq || (dist_sq == best_dist_sq && point.led_index < best_index)) {
+					best_dist_sq = dist_sq;
+					best_index = point.led_index;
+				}
+			}
+			};
+
+		// search rings of cells outwards, everything beyond ring r is at least r cells away
+		for (int ring = 0; ring <= max_ring; ++ring) {
+			if (ring == 0) {
+				consider(start_x, start_y);
+			}
+			else {
+				for (int i = -ring; i <= ring; ++i) {
+					consider(start_x + i, start_y - ring);
+					consider(start_x + i, start_y + ring);
+				}
+				for (int i = -ring + 1; i <= ring - 1; ++i) {
+					consider(start_x - ring, start_y + i);
+					consider(start_x + ring, start_y + i);
+				}
+			}
+			const double reach = ring * m_cell_size;
+			if (best_index != std::numeric_limits<uint32_t>::max() && best_dist_sq < reach * reach) {
+				break;
+			}
+		}
+
+		return best_index;
+	}
+};
\ No newline at end of file
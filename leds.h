@@ -1,13 +1,26 @@
 #pragma once
 
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+
+#include <algorithm>
 #include <vector>
 #include <limits>
+#include <optional>
 #include <span>
 
 #include <iCUESDK/iCUESDK.h>
 
+#include "calibration_profile.h"
 #include "corsair_helpers.h"
+#include "flush_tracker.h"
+#include "keyboard_layout.h"
+#include "led_color_store.h"
+#include "led_spatial_index.h"
+#include "lighting_backend.h"
 #include "static_vector.h"
+#include "transfer_function.h"
 
 /*
 
@@ -25,33 +38,59 @@ struct LedBounds {
 	float max_y_pos{ std::numeric_limits<float>::min() };
 };
 
+// A list of LED colors ready to be passed to CorsairSetLedColorsBuffer(), either a whole device or just the LEDs that changed
+using FrameColors = static_vector<CorsairLedColor, CORSAIR_DEVICE_LEDCOUNT_MAX>;
+
 class Leds {
+	LightingBackend* m_backend;
 	static_vector<CorsairLedPosition, CORSAIR_DEVICE_LEDCOUNT_MAX> m_led_positions{};
-	static_vector<CorsairLedColor, CORSAIR_DEVICE_LEDCOUNT_MAX> m_led_colors{};
+	LedColorStore m_colors{};
 	LedBounds m_bounds{};
+	LedSpatialIndex m_spatial_index{};
+	KeyboardLayout m_layout{};
+	FlushTracker m_flush_tracker{};
+	std::optional<TransferFunction> m_transfer{}; // applied to everything submitted, empty means colors are sent as set
+	std::optional<CalibrationProfile> m_calibration{}; // applied after m_transfer
+
+	bool m_delta_submission = true;
+	uint32_t m_full_refresh_interval = 0; // 0 means never force a full refresh
+	uint32_t m_frames_since_full_refresh = 0;
 
 public:
-	Leds(const CorsairDeviceId* device_id)
+	Leds(LightingBackend& backend, const CorsairDeviceId* device_id) : m_backend(&backend)
 	{
 		int num_positions{};
-		CHECKCORSAIR(CorsairGetLedPositions(*device_id, m_led_positions.capacity(), m_led_positions.data(), &num_positions));
+		CHECKCORSAIR(m_backend->getLedPositions(device_id, m_led_positions.capacity(), m_led_positions.data(), &num_positions));
 		m_led_positions.resize_uninitialized(num_positions);
 
 		for (const auto& position : m_led_positions) {
-			m_led_colors.emplace_back(CorsairLedColor{ .id = position.id, .r = 0, .g = 0, .b = 0, .a = 255 });
 			m_bounds.min_x_pos = fminf(position.cx, m_bounds.min_x_pos);
 			m_bounds.max_x_pos = fmaxf(position.cx, m_bounds.max_x_pos);
 			m_bounds.min_y_pos = fminf(position.cy, m_bounds.min_y_pos);
 			m_bounds.max_y_pos = fmaxf(position.cy, m_bounds.max_y_pos);
 		}
+		m_colors.init(m_led_positions);
+		m_spatial_index = LedSpatialIndex(m_led_positions);
+		m_layout = KeyboardLayout(m_led_positions);
+
+		// the device state is unknown so the first submission has to be complete
+		invalidate();
 	}
 
-	const CorsairLedColor* getColorsBuffer() const {
-		return m_led_colors.data();
+	LightingBackend& getBackend() const {
+		return *m_backend;
+	}
+
+	FlushTracker& getFlushTracker() { return m_flush_tracker; }
+	const FlushTracker& getFlushTracker() const { return m_flush_tracker; }
+
+	// Writes every LED's color as it would be submitted (after the transfer function and calibration) to out, which must hold getCount() colors
+	void getColors(CorsairLedColor* out) const {
+		m_colors.packAll(out, getTransferFunction(), getCalibration());
 	}
 
 	uint32_t getCount() const {
-		return m_led_colors.size();
+		return m_colors.size();
 	}
 
 	const std::span<const CorsairLedPosition> getAllLedPositions() const {
@@ -60,36 +99,126 @@ public:
 
 	const LedBounds& getBounds() const { return m_bounds; }
 
-	std::vector<uint32_t> getLedsInBounds(float left, float top, float width, float height) const
-	{
-		const float right = left + width;
-		const float bottom = top + height;
+	const KeyboardLayout& getLayout() const { return m_layout; }
 
-		std::vector<uint32_t> leds_in_bounds{};
+	// LEDs with left <= x < left + width and top <= y < top + height, in ascending order
+	void getLedsInBounds(float left, float top, float width, float height, LedIndexList& out) const
+	{
+		m_spatial_index.queryRect(left, top, width, height, out);
+	}
 
-		uint32_t i = 0;
-		for (const auto& position : m_led_positions) {
-			if (position.cx >= left && position.cx < right && position.cy >= top && position.cy < bottom) {
-				leds_in_bounds.push_back(i);
-			}
-			++i;
-		}
+	// LEDs within radius of (x, y), in ascending order
+	void getLedsInRadius(float x, float y, float radius, LedIndexList& out) const
+	{
+		m_spatial_index.queryRadius(x, y, radius, out);
+	}
 
-		return leds_in_bounds;
+	uint32_t getNearestLed(float x, float y) const
+	{
+		return m_spatial_index.queryNearest(x, y);
 	}
 
 	void setLed(uint32_t led_index, uint8_t r, uint8_t g, uint8_t b)
 	{
-		assert(led_index < m_led_colors.size());
-		m_led_colors[led_index].r = r;
-		m_led_colors[led_index].g = g;
-		m_led_colors[led_index].b = b;
+		assert(led_index < m_colors.size());
+		m_colors.set(led_index, r, g, b);
+	}
+
+	CorsairLedColor getLed(uint32_t led_index) const
+	{
+		assert(led_index < m_colors.size());
+		return m_colors.get(led_index);
 	}
 
 	void setAll(uint8_t r, uint8_t g, uint8_t b)
 	{
-		for (uint32_t i = 0; i < m_led_colors.size(); ++i) {
-			setLed(i, r, g, b);
+		m_colors.fill(r, g, b);
+	}
+
+	// Sets the LEDs whose byte in mask (one per LED) is non-zero
+	void setMasked(std::span<const uint8_t> mask, uint8_t r, uint8_t g, uint8_t b)
+	{
+		assert(mask.size() >= m_colors.size());
+		m_colors.fillMasked(mask, r, g, b);
+	}
+
+	// LED i takes the pixel numbered source_for_led[i] from pixels (3 or 4 bytes each, RGB first), negative sources are left alone.
+	// Build source_for_led once per mapping, e.g. from getLayout().getDataKeys().
+	void setFromPixels(std::span<const uint8_t> pixels, uint32_t pixel_stride, std::span<const int32_t> source_for_led)
+	{
+		assert(source_for_led.size() >= m_colors.size());
+		m_colors.gather(pixels, pixel_stride, source_for_led);
+	}
+
+	// Fades every LED towards (r, g, b) by alpha / 255
+	void blendAll(uint8_t r, uint8_t g, uint8_t b, uint8_t alpha)
+	{
+		m_colors.blend(r, g, b, alpha);
+	}
+
+	// Call after the device was written without going through takeChangedColors(), the next submission will be complete
+	void invalidate()
+	{
+		m_colors.markAllDirty();
+	}
+
+	// Every channel of every submitted color goes through its curve from now on.
+	// Colors set and read through Leds stay as they were set, the whole device is resent so the change shows at once.
+	void setTransferFunction(const TransferFunction& transfer)
+	{
+		m_transfer = transfer;
+		invalidate();
+	}
+
+	void clearTransferFunction()
+	{
+		m_transfer.reset();
+		invalidate();
+	}
+
+	const TransferFunction* getTransferFunction() const { return m_transfer ? &*m_transfer : nullptr; }
+
+	// Per-LED correction applied to every submitted frame, see CalibrationProfile
+	void setCalibration(const CalibrationProfile& calibration)
+	{
+		assert(calibration.size() == m_colors.size());
+		m_calibration = calibration;
+		invalidate();
+	}
+
+	void clearCalibration()
+	{
+		m_calibration.reset();
+		invalidate();
+	}
+
+	const CalibrationProfile* getCalibration() const { return m_calibration ? &*m_calibration : nullptr; }
+
+	// When enabled, only LEDs that changed since the previous submission are sent.
+	// A non-zero full_refresh_interval still sends every LED once every that many frames.
+	void setDeltaSubmission(bool enabled, uint32_t full_refresh_interval = 0)
+	{
+		m_delta_submission = enabled;
+		m_full_refresh_interval = full_refresh_interval;
+		m_frames_since_full_refresh = 0;
+	}
+
+	// Fills out with whatever has to be submitted for the current frame and resets change tracking
+	void takeChangedColors(FrameColors& out)
+	{
+		++m_frames_since_full_refresh;
+		const bool full_refresh = !m_delta_submission || (m_full_refresh_interval != 0 && m_frames_since_full_refresh >= m_full_refresh_interval);
+
+		// colors are only turned into what the SDK takes here
+		out.clear();
+		if (full_refresh) {
+			out.resize_uninitialized(m_colors.size());
+			m_colors.packAll(out.data(), getTransferFunction(), getCalibration());
+			m_frames_since_full_refresh = 0;
+		}
+		else {
+			out.resize_uninitialized(m_colors.packDirty(out.data(), getTransferFunction(), getCalibration()));
 		}
+		m_colors.clearDirty();
 	}
 };
\ No newline at end of file
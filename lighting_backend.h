@@ -0,0 +1,31 @@
+#pragma once
+
+#include <iCUESDK/iCUESDK.h>
+
+// Everything the test programs need from a lighting device.
+// Mirrors the subset of the iCUE SDK that is actually used so that the real SDK and the simulated device are interchangeable.
+// All functions returning CorsairError are meant to be wrapped in CHECKCORSAIR() just like the raw SDK calls.
+class LightingBackend {
+public:
+	virtual ~LightingBackend() = default;
+
+	// Blocks until the backend is ready to be used
+	virtual CorsairError connect() = 0;
+
+	virtual CorsairError disconnect() = 0;
+
+	// returns nullptr if keyboard not found
+	virtual const CorsairDeviceId* findKeyboard() = 0;
+
+	virtual CorsairError requestControl(const CorsairDeviceId* device_id) = 0;
+
+	virtual CorsairError releaseControl(const CorsairDeviceId* device_id) = 0;
+
+	virtual CorsairError getLedPositions(const CorsairDeviceId* device_id, int size_max, CorsairLedPosition* led_positions, int* size) = 0;
+
+	// Same semantics as CorsairSetLedColorsBuffer()
+	virtual CorsairError setLedColorsBuffer(const CorsairDeviceId* device_id, int size, const CorsairLedColor* led_colors) = 0;
+
+	// Same semantics as CorsairSetLedColorsFlushBufferAsync(). callback may run on any thread.
+	virtual CorsairError setLedColorsFlushBufferAsync(CorsairAsyncCallback callback, void* context) = 0;
+};
\ No newline at end of file
@@ -1,20 +1,29 @@
 #include <cassert>
 
 #include <array>
-#include <condition_variable>
+#include <charconv>
 #include <format>
 #include <iostream>
-#include <mutex>
+#include <memory>
 #include <span>
+#include <string_view>
 #include <fstream>
 
+#ifdef _WIN32
 #include <Windows.h>
 #include <Lmcons.h>
+#endif
 
 #include <iCUESDK/iCUESDK.h>
 
 #include "corsair_helpers.h"
+#include "lighting_backend.h"
+#include "simulated_k70.h"
+#ifdef _WIN32
+#include "icue_backend.h"
+#endif
 #include "leds.h"
+#include "led_color_store_test.h"
 #include "morse_code.h"
 #include "parallel_eight.h"
 #include "my_print.h"
@@ -27,81 +36,87 @@
 #include "set_colors.h"
 #include "bitrate_test.h"
 #include "crosstalk.h"
+#include "rs_transport.h"
+#include "wait_benchmark.h"
 
-struct StateChangedContext {
-	std::mutex mutex{}; // accessed by main thread and onStateChanged thread
-	std::condition_variable cv{}; // for waking up main thread once connected
-	bool connected = false;
-};
-
-// Runs on a separate thread
-static void onStateChanged(void* context, const CorsairSessionStateChanged* event_data)
-{
-	assert(context);
-	assert(event_data);
-
-	StateChangedContext& state_changed_context = *reinterpret_cast<StateChangedContext*>(context);
-
-	switch (event_data->state) {
-	case CSS_Invalid:
-		assert(false);
-		break;
-	case CSS_Closed:
-		// not connected yet or just disconnected
-		break;
-	case CSS_Connecting:
-		myPrint("Connecting...");
-		break;
-	case CSS_Timeout:
-		myPrint("Connection timeout. Retrying. Is iCUE running?");
-		break;
-	case CSS_ConnectionRefused:
-		die("Server did not allow connection");
-		break;
-	case CSS_ConnectionLost:
-		die("Server closed connection");
-		break;
-	case CSS_Connected: {
-		myPrint("Connected!");
-		myPrint("iCUE version: {}", event_data->details.serverHostVersion);
-		myPrint("SDK version: {}", event_data->details.serverVersion);
-		{
-			std::lock_guard lock(state_changed_context.mutex);
-			state_changed_context.connected = true;
-		}
-		state_changed_context.cv.notify_one(); // wait up main thread
-	} break;
-	default:
-		assert(false);
-		break;
-	}
-}
-
-int main()
+int main(int argc, char* argv[])
 {
 
 	/////////////////////
 	// INITIALISATIOON //
 	/////////////////////
 
-	StateChangedContext state_changed_context{}; // must be valid until CorsairDisconnect()
-	{
-		CHECKCORSAIR(CorsairConnect(onStateChanged, reinterpret_cast<void*>(&state_changed_context)));
-		{
-			std::unique_lock lock(state_changed_context.mutex);
-			state_changed_context.cv.wait(lock, [&]() {return state_changed_context.connected; });
+	// --simulated runs everything against an in-process K70 instead of iCUE (always the case without iCUE)
+	// --flush-wait=spin|block|hybrid picks how threads wait for flush completions (default hybrid)
+	// --calibration=<path> corrects every frame with a profile made by buildCalibrationProfile()
+	// --max-outstanding=<n> lets up to n flushes be in flight at once (1 to FlushTracker::MAX_OUTSTANDING, default 1)
+	bool use_simulated = false;
+	FlushWaitStrategy flush_wait_strategy = FlushWaitStrategy::SpinThenBlock;
+	uint32_t max_outstanding = 1;
+	std::filesystem::path calibration_path{};
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg(argv[i]);
+		if (arg == "--simulated") {
+			use_simulated = true;
+		}
+		else if (arg == "--flush-wait=spin") {
+			flush_wait_strategy = FlushWaitStrategy::Spin;
+		}
+		else if (arg == "--flush-wait=block") {
+			flush_wait_strategy = FlushWaitStrategy::Block;
+		}
+		else if (arg == "--flush-wait=hybrid") {
+			flush_wait_strategy = FlushWaitStrategy::SpinThenBlock;
+		}
+		else if (arg.starts_with("--calibration=")) {
+			calibration_path = arg.substr(std::string_view("--calibration=").size());
+		}
+		else if (arg.starts_with("--max-outstanding=")) {
+			const std::string_view value = arg.substr(std::string_view("--max-outstanding=").size());
+			const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), max_outstanding);
+			if (error != std::errc{} || end != value.data() + value.size() || max_outstanding < 1 || max_outstanding > FlushTracker::MAX_OUTSTANDING) {
+				die("--max-outstanding must be between 1 and {}, got {}", FlushTracker::MAX_OUTSTANDING, value);
+			}
+		}
+		else {
+			die("Unknown argument: {}", arg);
 		}
 	}
+#ifndef _WIN32
+	use_simulated = true;
+#endif
 
-	const CorsairDeviceId* device_id = findKeyboard();
+	std::unique_ptr<LightingBackend> backend{};
+	if (use_simulated) {
+		backend = std::make_unique<SimulatedK70Backend>();
+	}
+#ifdef _WIN32
+	else {
+		backend = std::make_unique<IcueBackend>();
+	}
+#endif
+
+	CHECKCORSAIR(backend->connect());
+
+	const CorsairDeviceId* device_id = backend->findKeyboard();
 	if (!device_id) {
 		die("Couldn't find a Corsair keyboard!");
 	}
 
-	// Request exclusive control over the keyboard's lighting and key events
-	CHECKCORSAIR(CorsairRequestControl(*device_id, CAL_ExclusiveLightingControlAndKeyEventsListening));
+	CHECKCORSAIR(backend->requestControl(device_id));
 
-	static Leds leds(device_id);
+	static Leds leds(*backend, device_id);
+	leds.getFlushTracker().setWaitStrategy(flush_wait_strategy);
+	leds.getFlushTracker().setMaxOutstanding(max_outstanding);
+	leds.getLayout().report();
+	if (!calibration_path.empty()) {
+		const auto calibration = CalibrationProfile::load(calibration_path, leds.getAllLedPositions());
+		if (!calibration) {
+			die("Failed to load calibration profile {}", calibration_path.string());
+		}
+		leds.setCalibration(*calibration);
+		myPrint("Loaded calibration profile {}", calibration_path.string());
+	}
 
 	/////////
 	// RUN //
@@ -114,7 +129,11 @@ int main()
 	//idealTransmit(device_id, leds);
 	//samplingTest(device_id, leds, 10.0, 1000);
 	//transmitImage(device_id, leds, std::filesystem::path(PROJECT_DIR) / "images" / "woman128x174.png");
+	//transmitImageQuantized(device_id, leds, std::filesystem::path(PROJECT_DIR) / "images" / "woman128x174.png", PaletteOptions{ .bits_per_symbol = 4, .dither = DitherMethod::FloydSteinberg });
+	//transmitImageProgressive(device_id, leds, std::filesystem::path(PROJECT_DIR) / "images" / "woman128x174.png", ImageCodecOptions{ .quality = 50 });
 	//calibrationTransmit(device_id, leds);
+	//calibrationSweep(device_id, leds);
+	//buildCalibrationProfile(leds, "calibration_measurements.txt", "calibration.txt");
 
 	//calibrationTransmitForText(device_id, leds);
 
@@ -144,11 +163,13 @@ int main()
 
 
 	//transmitText(device_id, leds, text_data_vec);
+	//transmitBytes(device_id, leds, std::span(reinterpret_cast<const uint8_t*>(text_data_vec.data()), text_data_vec.size()));
+	//transmitBytes(device_id, leds, std::span(reinterpret_cast<const uint8_t*>(text_data_vec.data()), text_data_vec.size()), RsTransportOptions{ .compress = true });
 //#if 0
 //	for (int i = 0; i < leds.getCount(); ++i) {
 //		auto pos = leds.getAllLedPositions()[i];
 //		myPrint("index: {}, x: {}, y; {}", i, pos.cx, pos.cy);
-//		waitForColors();
+//		waitForColors(leds);
 //		leds.setAll(0, 0, 0);
 //		leds.setLed(i, 255, 0, 0);
 //		setColors(device_id, leds);
@@ -158,9 +179,15 @@ int main()
 //#endif
 
 	//bitrateTest(device_id, leds);
+	//bitrateTest(device_id, leds, nullptr, LineCode::FourBFiveB);
 	//bitrateTestFreqSweep(device_id, leds);
 	//bitrateTestCellSize(device_id, leds);
 	//bitrateTestColors(device_id, leds);
+	//bitrateTestDifferential(device_id, leds);
+	//bitrateTestConstellation(device_id, leds, Constellation::design(ReceiverColorModel::modelled(), 4));
+	//bitrateTestAdaptive(device_id, leds);
+	//flushWaitBenchmark(device_id, leds);
+	//ledColorStoreGatherTest();
 
 	crosstalkTransmit(device_id, leds);
 
@@ -168,6 +195,6 @@ int main()
 	// CLEANUP //
 	/////////////
 
-	CHECKCORSAIR(CorsairReleaseControl(*device_id));
-	CHECKCORSAIR(CorsairDisconnect());
+	CHECKCORSAIR(backend->releaseControl(device_id));
+	CHECKCORSAIR(backend->disconnect());
 }
\ No newline at end of file
@@ -0,0 +1,255 @@
+#include "line_code.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <string>
+
+#include "my_print.h"
+
+static constexpr std::array<LineCodeInfo, 4> LINE_CODE_INFO{ {
+	{ "none", 1, 1, 0 },
+	{ "Manchester", 1, 2, 2 },
+	{ "4B5B NRZI", 4, 5, 4 },
+	{ "8b/10b", 8, 10, 5 },
+} };
+
+// 4B5B data groups, first line bit is the most significant. Never more than one leading or two trailing zeros.
+static constexpr std::array<uint8_t, 16> FOUR_B_FIVE_B{
+	0b11110, 0b01001, 0b10100, 0b10101, 0b01010, 0b01011, 0b01110, 0b01111,
+	0b10010, 0b10011, 0b10110, 0b10111, 0b11010, 0b11011, 0b11100, 0b11101,
+};
+
+// 8b/10b sub-blocks as sent with negative running disparity (abcdei and fghj, first line bit most significant).
+// With positive disparity the ones with an alternative are complemented.
+static constexpr std::array<uint8_t, 32> FIVE_B_SIX_B{
+	0b100111, 0b011101, 0b101101, 0b110001, 0b110101, 0b101001, 0b011001, 0b111000,
+	0b111001, 0b100101, 0b010101, 0b110100, 0b001101, 0b101100, 0b011100, 0b010111,
+	0b011011, 0b100011, 0b010011, 0b110010, 0b001011, 0b101010, 0b011010, 0b111010,
+	0b110011, 0b100110, 0b010110, 0b110110, 0b001110, 0b101110, 0b011110, 0b101011,
+};
+static constexpr std::array<uint8_t, 8> THREE_B_FOUR_B{ 0b1011, 0b1001, 0b0101, 0b1100, 0b1101, 0b1010, 0b0110, 0b1110 };
+static constexpr uint8_t THREE_B_FOUR_B_A7 = 0b0111; // replaces D.x.7 where the primary code would make a run of 5 with abcdei
+
+static bool hasAlternative(uint8_t code, uint32_t bits)
+{
+	// unbalanced codes, plus the balanced D.07 and D.x.3 whose complements keep runs short
+	return std::popcount(code) * 2 != static_cast<int>(bits) || code == 0b111000 || (bits == 4 && code == 0b1100);
+}
+
+static uint8_t complement(uint8_t code, uint32_t bits)
+{
+	return static_cast<uint8_t>(~code & ((1U << bits) - 1));
+}
+
+static uint16_t encode8b10b(uint8_t byte, bool& positive_disparity)
+{
+	const uint32_t x = byte & 31;
+	const uint32_t y = byte >> 5;
+
+	uint8_t six = FIVE_B_SIX_B[x];
+	if (positive_disparity && hasAlternative(six, 6)) {
+		six = complement(six, 6);
+	}
+	if (std::popcount(six) != 3) {
+		positive_disparity = std::popcount(six) > 3;
+	}
+
+	uint8_t four = THREE_B_FOUR_B[y];
+	if (y == 7 && ((!positive_disparity && (x == 17 || x == 18 || x == 20)) || (positive_disparity && (x == 11 || x == 13 || x == 14)))) {
+		four = THREE_B_FOUR_B_A7;
+	}
+	if (positive_disparity && hasAlternative(four, 4)) {
+		four = complement(four, 4);
+	}
+	if (std::popcount(four) != 2) {
+		positive_disparity = std::popcount(four) > 2;
+	}
+
+	return static_cast<uint16_t>((six << 4) | four);
+}
+
+// Data byte of every valid 10-bit code word under either disparity, -1 for the rest
+static const std::array<int16_t, 1024>& getDecode8b10bTable()
+{
+	static const std::array<int16_t, 1024> table = [] {
+		std::array<int16_t, 1024> t{};
+		t.fill(-1);
+		for (uint32_t byte = 0; byte < 256; ++byte) {
+			for (const bool start_positive : { false, true }) {
+				bool disparity = start_positive;
+				t[encode8b10b(static_cast<uint8_t>(byte), disparity)] = static_cast<int16_t>(byte);
+			}
+		}
+		return t;
+		}();
+	return table;
+}
+
+static const std::array<int8_t, 32>& getDecode4b5bTable()
+{
+	static const std::array<int8_t, 32> table = [] {
+		std::array<int8_t, 32> t{};
+		t.fill(-1);
+		for (uint32_t nibble = 0; nibble < 16; ++nibble) {
+			t[FOUR_B_FIVE_B[nibble]] = static_cast<int8_t>(nibble);
+		}
+		return t;
+		}();
+	return table;
+}
+
+const LineCodeInfo& getLineCodeInfo(LineCode code)
+{
+	return LINE_CODE_INFO[static_cast<size_t>(code)];
+}
+
+size_t lineEncodedLength(LineCode code, size_t num_data_bits)
+{
+	const LineCodeInfo& info = getLineCodeInfo(code);
+	return (num_data_bits + info.data_bits - 1) / info.data_bits * info.line_bits;
+}
+
+static void appendBits(std::vector<uint8_t>& out, uint32_t value, uint32_t num_bits)
+{
+	for (uint32_t i = num_bits; i-- > 0;) {
+		out.push_back((value >> i) & 1);
+	}
+}
+
+void LineEncoder::encodeBlock(uint32_t block, std::vector<uint8_t>& out)
+{
+	switch (m_code) {
+	case LineCode::None:
+		out.push_back(static_cast<uint8_t>(block));
+		break;
+	case LineCode::Manchester:
+		appendBits(out, block ? 0b01 : 0b10, 2);
+		break;
+	case LineCode::FourBFiveB:
+		for (uint32_t i = 5; i-- > 0;) {
+			m_level ^= (FOUR_B_FIVE_B[block] >> i) & 1;
+			out.push_back(m_level);
+		}
+		break;
+	case LineCode::EightBTenB:
+		appendBits(out, encode8b10b(static_cast<uint8_t>(block), m_positive_disparity), 10);
+		break;
+	}
+}
+
+void LineEncoder::encode(std::span<const uint8_t> data_bits, std::vector<uint8_t>& out)
+{
+	const LineCodeInfo& info = getLineCodeInfo(m_code);
+	out.reserve(out.size() + lineEncodedLength(m_code, m_partial.size() + data_bits.size()));
+
+	const auto toBlock = [&](const uint8_t* bits) {
+		uint32_t block = 0;
+		for (uint32_t i = 0; i < info.data_bits; ++i) {
+			block = (block << 1) | (bits[i] & 1);
+		}
+		return block;
+		};
+
+	size_t start = 0;
+	if (!m_partial.empty()) {
+		start = std::min<size_t>(info.data_bits - m_partial.size(), data_bits.size());
+		m_partial.insert(m_partial.end(), data_bits.begin(), data_bits.begin() + start);
+		if (m_partial.size() < info.data_bits) {
+			return;
+		}
+		encodeBlock(toBlock(m_partial.data()), out);
+		m_partial.clear();
+	}
+	for (; start + info.data_bits <= data_bits.size(); start += info.data_bits) {
+		encodeBlock(toBlock(data_bits.data() + start), out);
+	}
+	m_partial.assign(data_bits.begin() + start, data_bits.end());
+}
+
+void LineEncoder::flush(std::vector<uint8_t>& out)
+{
+	if (m_partial.empty()) {
+		return;
+	}
+	m_partial.resize(getLineCodeInfo(m_code).data_bits, 0);
+	uint32_t block = 0;
+	for (const uint8_t bit : m_partial) {
+		block = (block << 1) | (bit & 1);
+	}
+	encodeBlock(block, out);
+	m_partial.clear();
+}
+
+void LineDecoder::decodeBlock(const uint8_t* line_bits, std::vector<uint8_t>& out)
+{
+	const LineCodeInfo& info = getLineCodeInfo(m_code);
+
+	uint32_t word = 0;
+	for (uint32_t i = 0; i < info.line_bits; ++i) {
+		uint8_t bit = line_bits[i] & 1;
+		if (m_code == LineCode::FourBFiveB) {
+			// NRZI, a change of level is a 1
+			const uint8_t level = bit;
+			bit = level ^ m_level;
+			m_level = level;
+		}
+		word = (word << 1) | bit;
+	}
+
+	int32_t block = 0;
+	switch (m_code) {
+	case LineCode::None:
+		block = static_cast<int32_t>(word);
+		break;
+	case LineCode::Manchester:
+		block = word == 0b01 ? 1 : word == 0b10 ? 0 : -1;
+		break;
+	case LineCode::FourBFiveB:
+		block = getDecode4b5bTable()[word];
+		break;
+	case LineCode::EightBTenB:
+		block = getDecode8b10bTable()[word];
+		break;
+	}
+	if (block < 0) {
+		++m_invalid_blocks;
+		block = 0;
+	}
+	appendBits(out, static_cast<uint32_t>(block), info.data_bits);
+}
+
+void LineDecoder::decode(std::span<const uint8_t> line_bits, std::vector<uint8_t>& out)
+{
+	const uint32_t line_bits_per_block = getLineCodeInfo(m_code).line_bits;
+
+	size_t start = 0;
+	if (!m_partial.empty()) {
+		start = std::min<size_t>(line_bits_per_block - m_partial.size(), line_bits.size());
+		m_partial.insert(m_partial.end(), line_bits.begin(), line_bits.begin() + start);
+		if (m_partial.size() < line_bits_per_block) {
+			return;
+		}
+		decodeBlock(m_partial.data(), out);
+		m_partial.clear();
+	}
+	for (; start + line_bits_per_block <= line_bits.size(); start += line_bits_per_block) {
+		decodeBlock(line_bits.data() + start, out);
+	}
+	m_partial.assign(line_bits.begin() + start, line_bits.end());
+}
+
+void reportLineCodeGoodput(std::span<const double> symbol_rates, uint32_t num_keys, double code_rate)
+{
+	myPrint("Goodput with {} keys and a code of rate {:.2f} (payload bit/s, symbol rate needed to match uncoded):", num_keys, code_rate);
+	for (const LineCodeInfo& info : LINE_CODE_INFO) {
+		const double line_rate = static_cast<double>(info.data_bits) / static_cast<double>(info.line_bits);
+		const double rate = line_rate * code_rate;
+		myPrint("{} (rate {:.2f}, {:.2f} with the code, {}):", info.name, line_rate, rate,
+			info.max_run_length ? std::format("runs of at most {}", info.max_run_length) : std::string("unbounded runs"));
+		for (const double symbol_rate : symbol_rates) {
+			myPrint("  {:5.1f} Hz: {:7.1f} bit/s, matches uncoded {:.1f} Hz at {:.1f} Hz",
+				symbol_rate, symbol_rate * rate * num_keys, symbol_rate, symbol_rate / rate);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Line codes for on/off keyed streams, bounding how long a key can go without changing so the receiver always has
+// transitions to track symbol timing with
+enum class LineCode {
+	None,
+	Manchester, // each bit becomes a transition, 1 is off then on (IEEE 802.3), rate 1/2, at most 2 equal symbols in a row
+	FourBFiveB, // 4B5B groups sent NRZI (a 1 toggles the key), rate 4/5, at most 4 in a row
+	EightBTenB, // IEEE 8b/10b with running disparity, rate 4/5, at most 5 in a row and never more than 2 on or off more than the other
+};
+
+struct LineCodeInfo {
+	std::string_view name;
+	uint32_t data_bits; // per block
+	uint32_t line_bits;
+	uint32_t max_run_length; // longest possible run of equal line bits, 0 if unbounded
+};
+
+const LineCodeInfo& getLineCodeInfo(LineCode code);
+
+// Line bits needed for num_data_bits, which are padded with zeros to whole blocks
+size_t lineEncodedLength(LineCode code, size_t num_data_bits);
+
+// Encodes one key's stream. Bits are one per byte (0 or 1) and data bits are taken in blocks, most significant first.
+// State (NRZI level, running disparity, a partial block) carries over between calls, so a stream can be encoded piece
+// by piece; flush() ends it.
+class LineEncoder {
+	LineCode m_code;
+	uint8_t m_level = 0;
+	bool m_positive_disparity = false;
+	std::vector<uint8_t> m_partial{}; // data bits of a block split between calls
+
+	void encodeBlock(uint32_t block, std::vector<uint8_t>& out);
+
+public:
+	explicit LineEncoder(LineCode code) : m_code(code) {}
+
+	// Appends the line bits of every block completed by data_bits to out, a trailing partial block waits for the next call
+	void encode(std::span<const uint8_t> data_bits, std::vector<uint8_t>& out);
+
+	// Pads a waiting partial block with zeros and appends it, after this the stream took lineEncodedLength() bits in all
+	void flush(std::vector<uint8_t>& out);
+};
+
+// Decodes what a receiver read of one key's stream, invalid code words decode to zeros and are counted
+class LineDecoder {
+	LineCode m_code;
+	uint8_t m_level = 0;
+	uint32_t m_invalid_blocks = 0;
+	std::vector<uint8_t> m_partial{}; // line bits of a block split between calls
+
+	void decodeBlock(const uint8_t* line_bits, std::vector<uint8_t>& out);
+
+public:
+	explicit LineDecoder(LineCode code) : m_code(code) {}
+
+	// Appends the data bits of every block completed by line_bits to out, a trailing partial block waits for the next call
+	void decode(std::span<const uint8_t> line_bits, std::vector<uint8_t>& out);
+
+	uint32_t getInvalidBlocks() const { return m_invalid_blocks; }
+};
+
+// Goodput of each line code against symbol rate, for num_keys keys carrying one stream each. code_rate is the rate of an
+// error correcting code applied ahead of the line code, if any.
+// Also shows the symbol rate a code needs to match the uncoded goodput at each rate.
+void reportLineCodeGoodput(std::span<const double> symbol_rates, uint32_t num_keys, double code_rate = 1.0);
\ No newline at end of file
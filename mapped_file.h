@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+
+#include <filesystem>
+
+// Read-only view of a whole file in memory, pages are loaded by the OS on first access
+class MappedFile {
+	const std::byte* m_data = nullptr;
+	size_t m_size = 0;
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#else
+	int m_fd = -1;
+#endif
+
+	void close();
+
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	~MappedFile();
+
+	// Returns false if the file can't be opened or is empty
+	bool open(const std::filesystem::path& path);
+
+	const std::byte* data() const { return m_data; }
+
+	size_t size() const { return m_size; }
+};
\ No newline at end of file
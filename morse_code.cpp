@@ -9,7 +9,7 @@
 #include <iCUESDK/iCUESDK.h>
 
 #include "my_print.h"
-#include "fixed_update_loop.h"
+#include "frame_pipeline.h"
 #include "set_colors.h"
 
 void transmitMorseCode(const CorsairDeviceId* device_id, Leds& leds, std::string_view text)
@@ -165,7 +165,7 @@ void transmitMorseCode(const CorsairDeviceId* device_id, Leds& leds, std::string
 	std::this_thread::sleep_for(std::chrono::seconds(1));
 
 	auto start = std::chrono::high_resolution_clock::now();
-	startFixedUpdateLoop(iters, static_cast<int64_t>(1'000'000.0 / FREQUENCY), [&](int iteration) {
+	startFramePipeline(device_id, leds, iters, static_cast<int64_t>(1'000'000.0 / FREQUENCY), [&](int iteration) {
 		// This code runs 20 times per second
 		if (message[iteration] == true) {
 			leds.setAll(0, 255, 0);
@@ -173,10 +173,7 @@ void transmitMorseCode(const CorsairDeviceId* device_id, Leds& leds, std::string
 		else {
 			leds.setAll(255, 0, 0);
 		}
-		waitForColors();
-		setColors(device_id, leds);
 		});
-	waitForColors();
 
 	auto end = std::chrono::high_resolution_clock::now();
 
@@ -0,0 +1,382 @@
+#include "palette_quantizer.h"
+
+#include <cassert>
+#include <cmath>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <numeric>
+
+#include <immintrin.h>
+
+std::vector<PaletteColor> getRgb232Alphabet()
+{
+	std::vector<PaletteColor> alphabet{};
+	alphabet.reserve(128);
+	for (uint32_t i = 0; i < 128; ++i) {
+		const uint32_t b2 = i % 4;
+		const uint32_t g3 = (i / 4) % 8;
+		const uint32_t r2 = i / 32;
+		alphabet.push_back({ static_cast<uint8_t>(r2 * 255 / 3), static_cast<uint8_t>(g3 * 255 / 7), static_cast<uint8_t>(b2 * 255 / 3) });
+	}
+	return alphabet;
+}
+
+namespace {
+
+// Nearest palette entry by squared RGB distance
+class PaletteSearch {
+	// padded to a multiple of 4 with entries too far away to ever be nearest
+	std::vector<float> m_r{}, m_g{}, m_b{};
+
+public:
+	explicit PaletteSearch(std::span<const PaletteColor> palette)
+	{
+		assert(!palette.empty());
+		const size_t padded = (palette.size() + 3) / 4 * 4;
+		m_r.assign(padded, 1e9f);
+		m_g.assign(padded, 1e9f);
+		m_b.assign(padded, 1e9f);
+		for (size_t i = 0; i < palette.size(); ++i) {
+			m_r[i] = palette[i].r;
+			m_g[i] = palette[i].g;
+			m_b[i] = palette[i].b;
+		}
+	}
+
+	uint32_t nearest(float r, float g, float b) const
+	{
+		// SSE2 is always there on x64, 4 entries per step
+		const __m128 vr = _mm_set1_ps(r), vg = _mm_set1_ps(g), vb = _mm_set1_ps(b);
+		__m128 best_distances = _mm_set1_ps(std::numeric_limits<float>::max());
+		__m128i best_indices = _mm_setzero_si128();
+		__m128i indices = _mm_setr_epi32(0, 1, 2, 3);
+		for (size_t i = 0; i < m_r.size(); i += 4) {
+			const __m128 dr = _mm_sub_ps(vr, _mm_loadu_ps(&m_r[i]));
+			const __m128 dg = _mm_sub_ps(vg, _mm_loadu_ps(&m_g[i]));
+			const __m128 db = _mm_sub_ps(vb, _mm_loadu_ps(&m_b[i]));
+			const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+			const __m128 closer = _mm_cmplt_ps(distance, best_distances);
+			best_distances = _mm_or_ps(_mm_and_ps(closer, distance), _mm_andnot_ps(closer, best_distances));
+			const __m128i closer_mask = _mm_castps_si128(closer);
+			best_indices = _mm_or_si128(_mm_and_si128(closer_mask, indices), _mm_andnot_si128(closer_mask, best_indices));
+			indices = _mm_add_epi32(indices, _mm_set1_epi32(4));
+		}
+		alignas(16) float lane_distances[4];
+		alignas(16) uint32_t lane_indices[4];
+		_mm_store_ps(lane_distances, best_distances);
+		_mm_store_si128(reinterpret_cast<__m128i*>(lane_indices), best_indices);
+		uint32_t best = lane_indices[0];
+		float best_distance = lane_distances[0];
+		for (uint32_t lane = 1; lane < 4; ++lane) {
+			if (lane_distances[lane] < best_distance || (lane_distances[lane] == best_distance && lane_indices[lane] < best)) {
+				best_distance = lane_distances[lane];
+				best = lane_indices[lane];
+			}
+		}
+		return best;
+	}
+};
+
+constexpr uint32_t BLUE_NOISE_SIZE = 32;
+
+// Ulichney's void-and-cluster: ranks of every cell, each one placed in the biggest gap left by the ones before it
+const std::array<uint16_t, BLUE_NOISE_SIZE * BLUE_NOISE_SIZE>& getBlueNoise()
+{
+	static const std::array<uint16_t, BLUE_NOISE_SIZE * BLUE_NOISE_SIZE> ranks = [] {
+		constexpr uint32_t n = BLUE_NOISE_SIZE * BLUE_NOISE_SIZE;
+		constexpr double sigma = 1.5;
+
+		// gaussian of the wrapped distance between every pair of cells, by offset
+		std::array<float, n> kernel{};
+		for (uint32_t y = 0; y < BLUE_NOISE_SIZE; ++y) {
+			for (uint32_t x = 0; x < BLUE_NOISE_SIZE; ++x) {
+				const double dx = std::min(x, BLUE_NOISE_SIZE - x), dy = std::min(y, BLUE_NOISE_SIZE - y);
+				kernel[y * BLUE_NOISE_SIZE + x] = static_cast<float>(std::exp(-(dx * dx + dy * dy) / (2.0 * sigma * sigma)));
+			}
+		}
+		const auto offset = [](uint32_t a, uint32_t b) {
+			const uint32_t dx = (a % BLUE_NOISE_SIZE + BLUE_NOISE_SIZE - b % BLUE_NOISE_SIZE) % BLUE_NOISE_SIZE;
+			const uint32_t dy = (a / BLUE_NOISE_SIZE + BLUE_NOISE_SIZE - b / BLUE_NOISE_SIZE) % BLUE_NOISE_SIZE;
+			return dy * BLUE_NOISE_SIZE + dx;
+			};
+
+		std::vector<uint8_t> pattern(n, 0);
+		std::vector<float> energy(n, 0.0f);
+		const auto toggle = [&](uint32_t cell) {
+			pattern[cell] ^= 1;
+			const float sign = pattern[cell] ? 1.0f : -1.0f;
+			for (uint32_t i = 0; i < n; ++i) {
+				energy[i] += sign * kernel[offset(i, cell)];
+			}
+			};
+		// tightest cluster among the set cells, or the largest void among the clear ones
+		const auto find = [&](uint8_t value, bool highest) {
+			uint32_t best = 0;
+			float best_energy = highest ? -1.0f : std::numeric_limits<float>::max();
+			for (uint32_t i = 0; i < n; ++i) {
+				if (pattern[i] == value && (highest ? energy[i] > best_energy : energy[i] < best_energy)) {
+					best_energy = energy[i];
+					best = i;
+				}
+			}
+			return best;
+			};
+
+		// initial pattern: a tenth of the cells (fixed LCG so the map is always the same), then relaxed until stable
+		uint32_t seed = 12345;
+		uint32_t num_ones = 0;
+		while (num_ones < n / 10) {
+			seed = seed * 1664525 + 1013904223;
+			const uint32_t cell = (seed >> 8) % n;
+			if (!pattern[cell]) {
+				toggle(cell);
+				++num_ones;
+			}
+		}
+		for (uint32_t step = 0; step < n; ++step) {
+			const uint32_t cluster = find(1, true);
+			toggle(cluster);
+			const uint32_t gap = find(0, false);
+			toggle(gap);
+			if (gap == cluster) {
+				break;
+			}
+		}
+		const std::vector<uint8_t> initial = pattern;
+		const std::vector<float> initial_energy = energy;
+
+		std::array<uint16_t, n> r{};
+		for (uint32_t rank = num_ones; rank-- > 0;) {
+			const uint32_t cluster = find(1, true);
+			toggle(cluster);
+			r[cluster] = static_cast<uint16_t>(rank);
+		}
+		pattern = initial;
+		energy = initial_energy;
+		for (uint32_t rank = num_ones; rank < n; ++rank) {
+			const uint32_t gap = find(0, false);
+			toggle(gap);
+			r[gap] = static_cast<uint16_t>(rank);
+		}
+		return r;
+		}();
+	return ranks;
+}
+
+}
+
+std::vector<PaletteColor> choosePalette(std::span<const uint8_t> pixels, uint32_t pixel_stride, std::span<const PaletteColor> alphabet,
+	uint32_t num_colors, uint32_t kmeans_iterations)
+{
+	assert(pixel_stride >= 3 && !alphabet.empty());
+	const size_t num_pixels = pixels.size() / pixel_stride;
+	num_colors = std::min<uint32_t>(num_colors, static_cast<uint32_t>(alphabet.size()));
+	if (num_pixels == 0 || num_colors == 0) {
+		return {};
+	}
+	const auto channel = [&](size_t pixel, uint32_t c) { return pixels[pixel * pixel_stride + c]; };
+
+	// median cut: keep splitting the box with the widest channel range at its median
+	struct Box {
+		size_t begin, end;
+		uint32_t channel;
+		uint32_t range;
+	};
+	std::vector<uint32_t> order(num_pixels);
+	std::iota(order.begin(), order.end(), 0);
+	const auto measure = [&](size_t begin, size_t end) {
+		Box box{ begin, end, 0, 0 };
+		for (uint32_t c = 0; c < 3; ++c) {
+			const auto [lo, hi] = std::minmax_element(order.begin() + begin, order.begin() + end,
+				[&](uint32_t a, uint32_t b) { return channel(a, c) < channel(b, c); });
+			const uint32_t range = channel(*hi, c) - channel(*lo, c);
+			if (range >= box.range) {
+				box.range = range;
+				box.channel = c;
+			}
+		}
+		return box;
+		};
+	std::vector<Box> boxes{ measure(0, num_pixels) };
+	while (boxes.size() < num_colors) {
+		const auto widest = std::max_element(boxes.begin(), boxes.end(), [](const Box& a, const Box& b) { return a.range < b.range; });
+		if (widest->range == 0) {
+			break;
+		}
+		const Box box = *widest;
+		const size_t middle = box.begin + (box.end - box.begin) / 2;
+		std::nth_element(order.begin() + box.begin, order.begin() + middle, order.begin() + box.end,
+			[&](uint32_t a, uint32_t b) { return channel(a, box.channel) < channel(b, box.channel); });
+		*widest = measure(box.begin, middle);
+		boxes.push_back(measure(middle, box.end));
+	}
+
+	struct Centre {
+		double r, g, b;
+		size_t count;
+	};
+	std::vector<Centre> centres{};
+	for (const Box& box : boxes) {
+		Centre centre{ 0.0, 0.0, 0.0, box.end - box.begin };
+		for (size_t i = box.begin; i < box.end; ++i) {
+			centre.r += channel(order[i], 0);
+			centre.g += channel(order[i], 1);
+			centre.b += channel(order[i], 2);
+		}
+		centre.r /= centre.count;
+		centre.g /= centre.count;
+		centre.b /= centre.count;
+		centres.push_back(centre);
+	}
+
+	// biggest clusters get first pick of the alphabet
+	const PaletteSearch alphabet_search(alphabet);
+	const auto snap = [&](std::vector<Centre> sorted) {
+		std::stable_sort(sorted.begin(), sorted.end(), [](const Centre& a, const Centre& b) { return a.count > b.count; });
+		std::vector<PaletteColor> palette{};
+		std::vector<uint8_t> taken(alphabet.size(), 0);
+		for (const Centre& centre : sorted) {
+			uint32_t pick = alphabet_search.nearest(static_cast<float>(centre.r), static_cast<float>(centre.g), static_cast<float>(centre.b));
+			if (taken[pick]) {
+				// next nearest free one
+				double best_distance = std::numeric_limits<double>::max();
+				for (uint32_t i = 0; i < alphabet.size(); ++i) {
+					const double dr = centre.r - alphabet[i].r, dg = centre.g - alphabet[i].g, db = centre.b - alphabet[i].b;
+					const double distance = dr * dr + dg * dg + db * db;
+					if (!taken[i] && distance < best_distance) {
+						best_distance = distance;
+						pick = i;
+					}
+				}
+			}
+			taken[pick] = 1;
+			palette.push_back(alphabet[pick]);
+		}
+		return palette;
+		};
+
+	std::vector<PaletteColor> palette = snap(centres);
+	for (uint32_t iteration = 0; iteration < kmeans_iterations; ++iteration) {
+		const PaletteSearch search(palette);
+		std::vector<Centre> sums(palette.size(), Centre{ 0.0, 0.0, 0.0, 0 });
+		for (size_t i = 0; i < num_pixels; ++i) {
+			Centre& sum = sums[search.nearest(channel(i, 0), channel(i, 1), channel(i, 2))];
+			sum.r += channel(i, 0);
+			sum.g += channel(i, 1);
+			sum.b += channel(i, 2);
+			++sum.count;
+		}
+		for (size_t j = 0; j < sums.size(); ++j) {
+			if (sums[j].count == 0) {
+				// an entry nobody uses stays where it was
+				sums[j] = { static_cast<double>(palette[j].r), static_cast<double>(palette[j].g), static_cast<double>(palette[j].b), 0 };
+				continue;
+			}
+			sums[j].r /= sums[j].count;
+			sums[j].g /= sums[j].count;
+			sums[j].b /= sums[j].count;
+		}
+		std::vector<PaletteColor> next = snap(sums);
+		if (std::is_permutation(next.begin(), next.end(), palette.begin(), palette.end())) {
+			break;
+		}
+		palette = std::move(next);
+	}
+	return palette;
+}
+
+std::vector<uint8_t> ditherToPalette(std::span<const uint8_t> pixels, uint32_t width, uint32_t height, uint32_t pixel_stride,
+	std::span<const PaletteColor> palette, DitherMethod dither)
+{
+	assert(pixel_stride >= 3 && palette.size() <= 256);
+	assert(pixels.size() >= static_cast<size_t>(width) * height * pixel_stride);
+	const PaletteSearch search(palette);
+	std::vector<uint8_t> indices(static_cast<size_t>(width) * height);
+	const uint8_t* const source = pixels.data();
+
+	if (dither == DitherMethod::FloydSteinberg) {
+		// error carried into this row and the next, with a pixel of margin either side
+		std::vector<float> current(static_cast<size_t>(width + 2) * 3, 0.0f), next(current.size(), 0.0f);
+		for (uint32_t y = 0; y < height; ++y) {
+			const bool reverse = y & 1;
+			for (uint32_t step = 0; step < width; ++step) {
+				const uint32_t x = reverse ? width - 1 - step : step;
+				const uint8_t* p = source + (static_cast<size_t>(y) * width + x) * pixel_stride;
+				float* error = &current[(x + 1) * 3];
+				std::array<float, 3> wanted{};
+				for (uint32_t c = 0; c < 3; ++c) {
+					wanted[c] = std::clamp(p[c] + error[c], 0.0f, 255.0f);
+				}
+				const uint32_t index = search.nearest(wanted[0], wanted[1], wanted[2]);
+				indices[static_cast<size_t>(y) * width + x] = static_cast<uint8_t>(index);
+				const std::array<float, 3> got{ static_cast<float>(palette[index].r), static_cast<float>(palette[index].g), static_cast<float>(palette[index].b) };
+				const int32_t ahead = reverse ? -3 : 3;
+				float* below = &next[(x + 1) * 3];
+				for (int32_t c = 0; c < 3; ++c) {
+					const float e = wanted[c] - got[c];
+					error[ahead + c] += e * (7.0f / 16.0f);
+					below[-ahead + c] += e * (3.0f / 16.0f);
+					below[c] += e * (5.0f / 16.0f);
+					below[ahead + c] += e * (1.0f / 16.0f);
+				}
+			}
+			std::swap(current, next);
+			std::fill(next.begin(), next.end(), 0.0f);
+		}
+		return indices;
+	}
+
+	// blue noise offsets span about the distance between neighbouring palette entries
+	float spread = 0.0f;
+	if (dither == DitherMethod::BlueNoise && palette.size() > 1) {
+		for (size_t i = 0; i < palette.size(); ++i) {
+			float nearest = std::numeric_limits<float>::max();
+			for (size_t j = 0; j < palette.size(); ++j) {
+				if (i != j) {
+					const float dr = static_cast<float>(palette[i].r) - palette[j].r;
+					const float dg = static_cast<float>(palette[i].g) - palette[j].g;
+					const float db = static_cast<float>(palette[i].b) - palette[j].b;
+					nearest = std::min(nearest, std::sqrt(dr * dr + dg * dg + db * db));
+				}
+			}
+			spread += nearest;
+		}
+		spread /= static_cast<float>(palette.size());
+	}
+	const auto& noise = getBlueNoise();
+	const float noise_scale = spread / static_cast<float>(noise.size());
+	for (uint32_t y = 0; y < height; ++y) {
+		for (uint32_t x = 0; x < width; ++x) {
+			const uint8_t* p = source + (static_cast<size_t>(y) * width + x) * pixel_stride;
+			const float offset = (static_cast<float>(noise[(y % BLUE_NOISE_SIZE) * BLUE_NOISE_SIZE + x % BLUE_NOISE_SIZE]) + 0.5f) * noise_scale - spread * 0.5f;
+			indices[static_cast<size_t>(y) * width + x] = static_cast<uint8_t>(search.nearest(p[0] + offset, p[1] + offset, p[2] + offset));
+		}
+	}
+	return indices;
+}
+
+QuantizedImage quantizeImage(std::span<const uint8_t> pixels, uint32_t width, uint32_t height, uint32_t pixel_stride,
+	std::span<const PaletteColor> alphabet, const PaletteOptions& options)
+{
+	assert(options.bits_per_symbol >= 1 && options.bits_per_symbol <= 8);
+	QuantizedImage image{};
+	image.width = width;
+	image.height = height;
+	image.palette = choosePalette(pixels.first(static_cast<size_t>(width) * height * pixel_stride), pixel_stride, alphabet,
+		1U << options.bits_per_symbol, options.kmeans_iterations);
+	image.indices = ditherToPalette(pixels, width, height, pixel_stride, image.palette, options.dither);
+	return image;
+}
+
+std::vector<uint8_t> expandPalette(const QuantizedImage& image)
+{
+	std::vector<uint8_t> rgb{};
+	rgb.reserve(image.indices.size() * 3);
+	for (const uint8_t index : image.indices) {
+		const PaletteColor& color = image.palette[index];
+		rgb.insert(rgb.end(), { color.r, color.g, color.b });
+	}
+	return rgb;
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+#include <span>
+#include <vector>
+
+struct PaletteColor {
+	uint8_t r, g, b;
+
+	bool operator==(const PaletteColor&) const = default;
+};
+
+// Every combination of 2 bits of red, 3 of green and 2 of blue (128 colors), the alphabet getColor() in transmit_image
+// was written for. Colors are evenly spaced in drive value, apply a transfer curve on Leds if the LEDs aren't linear.
+std::vector<PaletteColor> getRgb232Alphabet();
+
+enum class DitherMethod {
+	None,
+	FloydSteinberg, // serpentine error diffusion, best looking but one pixel at a time
+	BlueNoise, // threshold offsets from a 32x32 void-and-cluster map, every pixel independent
+};
+
+struct PaletteOptions {
+	uint32_t bits_per_symbol = 4; // palette of 2^bits_per_symbol colors
+	uint32_t kmeans_iterations = 8;
+	DitherMethod dither = DitherMethod::FloydSteinberg;
+};
+
+struct QuantizedImage {
+	std::vector<PaletteColor> palette;
+	std::vector<uint8_t> indices; // palette entry of each pixel, rows top to bottom
+	uint32_t width;
+	uint32_t height;
+};
+
+// Median cut over the pixels for the starting palette, then k-means with every centre snapped to the nearest alphabet
+// color not already taken, so the result is the best palette of num_colors distinct colors the receiver can show.
+// Fewer colors come back if the alphabet is smaller than num_colors.
+std::vector<PaletteColor> choosePalette(std::span<const uint8_t> pixels, uint32_t pixel_stride, std::span<const PaletteColor> alphabet,
+	uint32_t num_colors, uint32_t kmeans_iterations = 8);
+
+// Palette index for every pixel. Nearest entry searches are done 4 palette entries at a time with SSE2.
+std::vector<uint8_t> ditherToPalette(std::span<const uint8_t> pixels, uint32_t width, uint32_t height, uint32_t pixel_stride,
+	std::span<const PaletteColor> palette, DitherMethod dither);
+
+QuantizedImage quantizeImage(std::span<const uint8_t> pixels, uint32_t width, uint32_t height, uint32_t pixel_stride,
+	std::span<const PaletteColor> alphabet, const PaletteOptions& options = {});
+
+// R8G8B8 pixels of the quantized image
+std::vector<uint8_t> expandPalette(const QuantizedImage& image);
\ No newline at end of file
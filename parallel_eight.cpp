@@ -14,9 +14,10 @@ void transmitParallelEight(const CorsairDeviceId* device_id, Leds& leds, std::sp
 	const float segment_width = (leds.getBounds().max_x_pos - left) / 4.0f;
 	const float top = leds.getBounds().min_y_pos;
 	const float segment_height = (leds.getBounds().max_y_pos - top) / 2.0f;
+	LedIndexList segment{};
 	for (int i = 0; i < 8; ++i) {
 		const float segment_top = (i % 2 == 0) ? top : top + segment_height;
-		auto segment = leds.getLedsInBounds(left, segment_top, segment_width, segment_height);
+		leds.getLedsInBounds(left, segment_top, segment_width, segment_height, segment);
 		for (auto led_index : segment) {
 			leds.setLed(led_index, colors[i][0], colors[i][1], colors[i][2]);
 		}
@@ -25,7 +26,7 @@ void transmitParallelEight(const CorsairDeviceId* device_id, Leds& leds, std::sp
 		}
 	}
 
-	waitForColors();
+	waitForColors(leds);
 	setColors(device_id, leds);
 
 	std::this_thread::sleep_for(std::chrono::seconds(5));
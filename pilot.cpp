@@ -0,0 +1,161 @@
+#include "pilot.h"
+
+#include <cassert>
+
+#include <algorithm>
+
+#include "corsair_helpers.h"
+
+// Captures whose best phase scores below this are taken to be mid-transition
+constexpr float MIN_PILOT_QUALITY = 0.5f;
+
+PilotLayout::PilotLayout(std::span<const uint32_t> keys, uint32_t num_pilots)
+{
+	if (num_pilots == 0) {
+		m_data_keys.assign(keys.begin(), keys.end());
+		return;
+	}
+	std::vector<uint32_t> indices{};
+	for (uint32_t i = 0; i < num_pilots; ++i) {
+		// the middle of each of num_pilots equal stretches, so pilots cover every part of the board
+		indices.push_back(static_cast<uint32_t>((static_cast<uint64_t>(i) * 2 + 1) * keys.size() / (static_cast<uint64_t>(num_pilots) * 2)));
+	}
+	*this = fromIndices(keys, indices);
+}
+
+PilotLayout PilotLayout::fromIndices(std::span<const uint32_t> keys, std::span<const uint32_t> pilot_indices)
+{
+	if (pilot_indices.size() < MIN_PILOT_KEYS || pilot_indices.size() >= keys.size()) {
+		die("Need between {} and {} pilot keys, got {}", MIN_PILOT_KEYS, keys.size() - 1, pilot_indices.size());
+	}
+
+	PilotLayout layout{};
+	std::vector<bool> is_pilot(keys.size(), false);
+	for (const uint32_t index : pilot_indices) {
+		assert(index < keys.size() && !is_pilot[index]);
+		is_pilot[index] = true;
+		layout.m_pilot_keys.push_back(keys[index]);
+	}
+	for (size_t i = 0; i < keys.size(); ++i) {
+		if (!is_pilot[i]) {
+			layout.m_data_keys.push_back(keys[i]);
+		}
+	}
+	return layout;
+}
+
+void PilotLayout::show(Leds& leds, uint64_t symbol) const
+{
+	for (size_t j = 0; j < m_pilot_keys.size(); ++j) {
+		const uint64_t channel = (symbol + j) % NUM_PILOT_PHASES;
+		leds.setLed(m_pilot_keys[j], channel == 0 ? 255 : 0, channel == 1 ? 255 : 0, channel == 2 ? 255 : 0);
+	}
+}
+
+// How well the pilots in one capture match each phase, between -1 and 1
+static std::array<float, NUM_PILOT_PHASES> scorePhases(const float* pilots, size_t num_pilots)
+{
+	std::array<float, NUM_PILOT_PHASES> contrast{};
+	float range = 0.0f;
+	for (size_t j = 0; j < num_pilots; ++j) {
+		const float* rgb = pilots + j * 3;
+		range += std::max({ rgb[0], rgb[1], rgb[2] }) - std::min({ rgb[0], rgb[1], rgb[2] });
+		for (uint32_t phase = 0; phase < NUM_PILOT_PHASES; ++phase) {
+			const uint32_t lit = static_cast<uint32_t>((phase + j) % NUM_PILOT_PHASES);
+			contrast[phase] += rgb[lit] - std::max(rgb[(lit + 1) % 3], rgb[(lit + 2) % 3]);
+		}
+	}
+	for (float& score : contrast) {
+		score = range > 0.0f ? score / range : 0.0f;
+	}
+	return contrast;
+}
+
+std::vector<PilotSymbol> recoverPilotSymbols(const PilotLayout& layout, std::span<const float> captures)
+{
+	const size_t num_pilots = layout.getPilotKeys().size();
+	const size_t num_data = layout.getDataKeys().size();
+	const size_t stride = (num_pilots + num_data) * 3;
+	assert(num_pilots >= MIN_PILOT_KEYS);
+	const size_t num_captures = captures.size() / stride;
+
+	struct Candidate {
+		size_t capture;
+		uint32_t phase;
+		float quality;
+	};
+
+	// one candidate per symbol: the cleanest capture of each run of captures showing the same phase
+	std::vector<Candidate> candidates{};
+	for (size_t c = 0; c < num_captures; ++c) {
+		const auto scores = scorePhases(captures.data() + c * stride, num_pilots);
+		const auto best = std::max_element(scores.begin(), scores.end());
+		if (*best < MIN_PILOT_QUALITY) {
+			continue;
+		}
+		const uint32_t phase = static_cast<uint32_t>(best - scores.begin());
+		if (!candidates.empty() && candidates.back().phase == phase) {
+			// same symbol, either held for longer or seen again after a blurred capture
+			if (*best > candidates.back().quality) {
+				candidates.back().capture = c;
+				candidates.back().quality = *best;
+			}
+			continue;
+		}
+		candidates.push_back(Candidate{ .capture = c, .phase = phase, .quality = *best });
+	}
+
+	std::vector<PilotSymbol> symbols{};
+	symbols.reserve(candidates.size());
+	for (size_t s = 0; s < candidates.size(); ++s) {
+		const Candidate& candidate = candidates[s];
+		const float* capture = captures.data() + candidate.capture * stride;
+
+		// per channel: mean of the pilots with it on, and of the pilots with it off
+		std::array<float, 3> on{}, off{};
+		std::array<uint32_t, 3> num_on{}, num_off{};
+		for (size_t j = 0; j < num_pilots; ++j) {
+			const uint32_t lit = static_cast<uint32_t>((candidate.phase + j) % NUM_PILOT_PHASES);
+			for (uint32_t ch = 0; ch < 3; ++ch) {
+				if (ch == lit) {
+					on[ch] += capture[j * 3 + ch];
+					++num_on[ch];
+				}
+				else {
+					off[ch] += capture[j * 3 + ch];
+					++num_off[ch];
+				}
+			}
+		}
+
+		PilotSymbol symbol{};
+		symbol.capture = static_cast<uint32_t>(candidate.capture);
+		symbol.phase = candidate.phase;
+		symbol.skipped_before = s == 0 ? 0 : (candidate.phase + NUM_PILOT_PHASES - candidates[s - 1].phase) % NUM_PILOT_PHASES - 1;
+		symbol.quality = candidate.quality;
+		symbol.levels.resize(num_data * 3);
+		std::array<float, 3> black{}, scale{};
+		for (uint32_t ch = 0; ch < 3; ++ch) {
+			black[ch] = num_off[ch] ? off[ch] / num_off[ch] : 0.0f;
+			const float white = num_on[ch] ? on[ch] / num_on[ch] : 1.0f;
+			scale[ch] = white > black[ch] ? 1.0f / (white - black[ch]) : 0.0f;
+		}
+		const float* data = capture + num_pilots * 3;
+		for (size_t i = 0; i < num_data * 3; ++i) {
+			symbol.levels[i] = std::clamp((data[i] - black[i % 3]) * scale[i % 3], 0.0f, 1.0f);
+		}
+		symbols.push_back(std::move(symbol));
+	}
+	return symbols;
+}
+
+std::vector<uint8_t> slicePilotSymbols(std::span<const PilotSymbol> symbols)
+{
+	std::vector<uint8_t> bits{};
+	for (const PilotSymbol& symbol : symbols) {
+		for (const float level : symbol.levels) {
+			bits.push_back(level >= 0.5f);
+		}
+	}
+	return bits;
+}
\ No newline at end of file
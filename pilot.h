@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+
+#include <array>
+#include <span>
+#include <vector>
+
+#include "leds.h"
+
+// Pilot keys show red, green and blue in turn, one step per symbol, and pilot j is j steps ahead of pilot 0.
+// Every pilot changes on every symbol so a receiver sampling faster than the symbol rate can see where symbols start and end,
+// and with at least 3 pilots each channel is fully on somewhere and off somewhere else in every frame, giving a per-frame
+// reference for both ends of each channel. The step pilot 0 is on is the symbol index mod 3, which unlike a parity bit also
+// tells a skipped symbol apart from a repeated one.
+constexpr uint32_t NUM_PILOT_PHASES = 3;
+constexpr uint32_t MIN_PILOT_KEYS = 3;
+
+// Splits a list of keys into pilots and the keys left over for data
+class PilotLayout {
+	std::vector<uint32_t> m_pilot_keys{};
+	std::vector<uint32_t> m_data_keys{};
+
+public:
+	PilotLayout() = default;
+
+	// num_pilots keys spread evenly through keys (0, or at least MIN_PILOT_KEYS), the others carry data in their original order
+	PilotLayout(std::span<const uint32_t> keys, uint32_t num_pilots);
+
+	// The keys at pilot_indices (indices into keys) become pilots, in that order
+	static PilotLayout fromIndices(std::span<const uint32_t> keys, std::span<const uint32_t> pilot_indices);
+
+	std::span<const uint32_t> getPilotKeys() const { return m_pilot_keys; }
+
+	std::span<const uint32_t> getDataKeys() const { return m_data_keys; }
+
+	// Sets the pilot keys for the given symbol, data keys are left alone
+	void show(Leds& leds, uint64_t symbol) const;
+};
+
+// One symbol recovered from the receiver's captures
+struct PilotSymbol {
+	uint32_t capture; // index of the capture the symbol was read from
+	uint32_t phase; // symbol index mod NUM_PILOT_PHASES
+	uint32_t skipped_before; // symbols the receiver never saw between the previous one and this one
+	float quality; // how cleanly the pilots showed this symbol's phase in that capture, 1 is perfect
+	std::vector<float> levels; // 3 per data key, scaled to 0-1 by this capture's pilot references
+};
+
+// Timing recovery and per-frame color reference for transmissions with pilot keys.
+// captures holds the receiver's brightness readings of every key, pilot keys then data keys in layout order, 3 channels per key,
+// one capture after another. Captures are expected to come faster than the symbol rate with no relation to its timing.
+// Captures where the pilots are mid-transition (two symbols blended) are dropped, the remaining ones are grouped into symbols
+// by pilot phase and each symbol is read from its cleanest capture.
+std::vector<PilotSymbol> recoverPilotSymbols(const PilotLayout& layout, std::span<const float> captures);
+
+// Hard decisions on the recovered levels, 3 bits per data key per symbol, ready for FrameParser
+std::vector<uint8_t> slicePilotSymbols(std::span<const PilotSymbol> symbols);
\ No newline at end of file
@@ -0,0 +1,269 @@
+#include "reed_solomon.h"
+
+#include <cassert>
+
+#include <algorithm>
+#include <array>
+
+// Polynomials are stored highest power first throughout
+
+namespace {
+
+struct GaloisTables {
+	std::array<uint8_t, 512> exp{}; // doubled so exp[log a + log b] never needs a modulo
+	std::array<uint8_t, 256> log{};
+};
+
+constexpr GaloisTables makeGaloisTables()
+{
+	GaloisTables tables{};
+	uint32_t x = 1;
+	for (uint32_t i = 0; i < 255; ++i) {
+		tables.exp[i] = static_cast<uint8_t>(x);
+		tables.log[x] = static_cast<uint8_t>(i);
+		x <<= 1;
+		if (x & 0x100) {
+			x ^= 0x11D;
+		}
+	}
+	for (uint32_t i = 255; i < 512; ++i) {
+		tables.exp[i] = tables.exp[i - 255];
+	}
+	return tables;
+}
+
+constexpr GaloisTables GF = makeGaloisTables();
+
+uint8_t gfMul(uint8_t a, uint8_t b)
+{
+	if (a == 0 || b == 0) {
+		return 0;
+	}
+	return GF.exp[GF.log[a] + GF.log[b]];
+}
+
+uint8_t gfDiv(uint8_t a, uint8_t b)
+{
+	assert(b != 0);
+	if (a == 0) {
+		return 0;
+	}
+	return GF.exp[GF.log[a] + 255 - GF.log[b]];
+}
+
+uint8_t gfInverse(uint8_t a)
+{
+	return gfDiv(1, a);
+}
+
+// 2^power
+uint8_t gfAlpha(uint32_t power)
+{
+	return GF.exp[power % 255];
+}
+
+std::vector<uint8_t> polyScale(const std::vector<uint8_t>& p, uint8_t x)
+{
+	std::vector<uint8_t> result(p.size());
+	for (size_t i = 0; i < p.size(); ++i) {
+		result[i] = gfMul(p[i], x);
+	}
+	return result;
+}
+
+std::vector<uint8_t> polyAdd(const std::vector<uint8_t>& p, const std::vector<uint8_t>& q)
+{
+	std::vector<uint8_t> result(std::max(p.size(), q.size()));
+	for (size_t i = 0; i < p.size(); ++i) {
+		result[i + result.size() - p.size()] = p[i];
+	}
+	for (size_t i = 0; i < q.size(); ++i) {
+		result[i + result.size() - q.size()] ^= q[i];
+	}
+	return result;
+}
+
+std::vector<uint8_t> polyMul(const std::vector<uint8_t>& p, const std::vector<uint8_t>& q)
+{
+	std::vector<uint8_t> result(p.size() + q.size() - 1);
+	for (size_t j = 0; j < q.size(); ++j) {
+		for (size_t i = 0; i < p.size(); ++i) {
+			result[i + j] ^= gfMul(p[i], q[j]);
+		}
+	}
+	return result;
+}
+
+uint8_t polyEval(std::span<const uint8_t> p, uint8_t x)
+{
+	uint8_t y = p[0];
+	for (size_t i = 1; i < p.size(); ++i) {
+		y = gfMul(y, x) ^ p[i];
+	}
+	return y;
+}
+
+// Product of (1 - x * 2^power) over every power
+std::vector<uint8_t> erasureLocator(std::span<const uint32_t> coefficient_powers)
+{
+	std::vector<uint8_t> locator{ 1 };
+	for (const uint32_t power : coefficient_powers) {
+		locator = polyMul(locator, { gfAlpha(power), 1 });
+	}
+	return locator;
+}
+
+}
+
+ReedSolomon::ReedSolomon(uint32_t block_length, uint32_t data_length) : m_block_length(block_length), m_data_length(data_length)
+{
+	assert(block_length <= 255);
+	assert(data_length > 0 && data_length < block_length);
+
+	m_generator = { 1 };
+	for (uint32_t i = 0; i < getParityLength(); ++i) {
+		m_generator = polyMul(m_generator, { 1, gfAlpha(i) });
+	}
+}
+
+void ReedSolomon::encode(std::span<const uint8_t> data, std::span<uint8_t> codeword) const
+{
+	assert(data.size() == m_data_length);
+	assert(codeword.size() == m_block_length);
+
+	// the remainder of data * x^parity divided by the generator, worked out in place
+	std::fill(codeword.begin(), codeword.end(), static_cast<uint8_t>(0));
+	std::copy(data.begin(), data.end(), codeword.begin());
+	for (uint32_t i = 0; i < m_data_length; ++i) {
+		const uint8_t coefficient = codeword[i];
+		if (coefficient != 0) {
+			for (size_t j = 1; j < m_generator.size(); ++j) {
+				codeword[i + j] ^= gfMul(m_generator[j], coefficient);
+			}
+		}
+	}
+	std::copy(data.begin(), data.end(), codeword.begin());
+}
+
+int ReedSolomon::decode(std::span<uint8_t> codeword, std::span<const uint32_t> erasures) const
+{
+	assert(codeword.size() == m_block_length);
+	const uint32_t parity = getParityLength();
+	if (erasures.size() > parity) {
+		return -1;
+	}
+
+	std::vector<uint8_t> message(codeword.begin(), codeword.end());
+	for (const uint32_t position : erasures) {
+		assert(position < m_block_length);
+		message[position] = 0;
+	}
+
+	const auto syndromes = [&](std::span<const uint8_t> poly) {
+		std::vector<uint8_t> result(parity);
+		for (uint32_t i = 0; i < parity; ++i) {
+			result[i] = polyEval(poly, gfAlpha(i));
+		}
+		return result;
+		};
+
+	const std::vector<uint8_t> syndrome = syndromes(message);
+	if (std::all_of(syndrome.begin(), syndrome.end(), [](uint8_t s) { return s == 0; })) {
+		int changed = 0;
+		for (const uint32_t position : erasures) {
+			changed += codeword[position] != 0;
+		}
+		std::copy(message.begin(), message.end(), codeword.begin());
+		return changed;
+	}
+
+	// Forney syndromes hide the erasures from Berlekamp-Massey so it only has to find the unknown errors
+	std::vector<uint8_t> forney_syndrome = syndrome;
+	for (const uint32_t position : erasures) {
+		const uint8_t x = gfAlpha(m_block_length - 1 - position);
+		for (size_t j = 0; j + 1 < forney_syndrome.size(); ++j) {
+			forney_syndrome[j] = gfMul(forney_syndrome[j], x) ^ forney_syndrome[j + 1];
+		}
+	}
+
+	// Berlekamp-Massey
+	std::vector<uint8_t> error_locator{ 1 };
+	std::vector<uint8_t> old_locator{ 1 };
+	const uint32_t num_erasures = static_cast<uint32_t>(erasures.size());
+	for (uint32_t i = 0; i < parity - num_erasures; ++i) {
+		uint8_t delta = forney_syndrome[i];
+		for (size_t j = 1; j < error_locator.size(); ++j) {
+			delta ^= gfMul(error_locator[error_locator.size() - 1 - j], forney_syndrome[i - j]);
+		}
+		old_locator.push_back(0);
+		if (delta != 0) {
+			if (old_locator.size() > error_locator.size()) {
+				std::vector<uint8_t> new_locator = polyScale(old_locator, delta);
+				old_locator = polyScale(error_locator, gfInverse(delta));
+				error_locator = std::move(new_locator);
+			}
+			error_locator = polyAdd(error_locator, polyScale(old_locator, delta));
+		}
+	}
+	while (!error_locator.empty() && error_locator[0] == 0) {
+		error_locator.erase(error_locator.begin());
+	}
+	const uint32_t num_errors = static_cast<uint32_t>(error_locator.size()) - 1;
+	if (num_errors * 2 + num_erasures > parity) {
+		return -1;
+	}
+
+	// Chien search, the locator's roots give the error positions
+	std::vector<uint8_t> reversed_locator(error_locator.rbegin(), error_locator.rend());
+	std::vector<uint32_t> errata_positions(erasures.begin(), erasures.end());
+	for (uint32_t i = 0; i < m_block_length; ++i) {
+		if (polyEval(reversed_locator, gfAlpha(i)) == 0) {
+			errata_positions.push_back(m_block_length - 1 - i);
+		}
+	}
+	if (errata_positions.size() != num_erasures + num_errors) {
+		return -1;
+	}
+
+	// Forney algorithm for the error values
+	std::vector<uint32_t> coefficient_powers(errata_positions.size());
+	for (size_t i = 0; i < errata_positions.size(); ++i) {
+		coefficient_powers[i] = m_block_length - 1 - errata_positions[i];
+	}
+	const std::vector<uint8_t> errata_locator = erasureLocator(coefficient_powers);
+
+	// evaluator = (syndrome * locator) mod x^(errata + 1), syndrome taken lowest power first with a leading 0 term
+	std::vector<uint8_t> syndrome_poly(syndrome.rbegin(), syndrome.rend());
+	syndrome_poly.push_back(0);
+	const std::vector<uint8_t> product = polyMul(syndrome_poly, errata_locator);
+	const size_t evaluator_size = errata_locator.size();
+	const std::vector<uint8_t> evaluator(product.end() - evaluator_size, product.end());
+
+	for (size_t i = 0; i < errata_positions.size(); ++i) {
+		const uint8_t x = gfAlpha(coefficient_powers[i]);
+		const uint8_t x_inverse = gfInverse(x);
+		uint8_t locator_derivative = 1;
+		for (size_t j = 0; j < errata_positions.size(); ++j) {
+			if (j != i) {
+				locator_derivative = gfMul(locator_derivative, 1 ^ gfMul(x_inverse, gfAlpha(coefficient_powers[j])));
+			}
+		}
+		if (locator_derivative == 0) {
+			return -1;
+		}
+		const uint8_t y = gfMul(x, polyEval(evaluator, x_inverse));
+		message[errata_positions[i]] ^= gfDiv(y, locator_derivative);
+	}
+
+	const std::vector<uint8_t> check = syndromes(message);
+	if (std::any_of(check.begin(), check.end(), [](uint8_t s) { return s != 0; })) {
+		return -1;
+	}
+
+	int changed = 0;
+	for (uint32_t i = 0; i < m_block_length; ++i) {
+		changed += message[i] != codeword[i];
+	}
+	std::copy(message.begin(), message.end(), codeword.begin());
+	return changed;
+}
\ No newline at end of file
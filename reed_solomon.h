@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+#include <span>
+#include <vector>
+
+// Reed-Solomon code over GF(256) (polynomial 0x11D, generator roots 2^0 to 2^(parity - 1)).
+// block_length is at most 255, shorter blocks are shortened codes so any data_length below block_length works.
+// Up to parity / 2 wrong bytes per block can be corrected, or up to parity bytes if their positions are known (erasures),
+// or any mix where 2 * errors + erasures <= parity.
+class ReedSolomon {
+	uint32_t m_block_length;
+	uint32_t m_data_length;
+	std::vector<uint8_t> m_generator{}; // highest power first
+
+public:
+	ReedSolomon(uint32_t block_length, uint32_t data_length);
+
+	uint32_t getBlockLength() const { return m_block_length; }
+
+	uint32_t getDataLength() const { return m_data_length; }
+
+	uint32_t getParityLength() const { return m_block_length - m_data_length; }
+
+	// codeword gets the data_length bytes of data followed by the parity bytes
+	void encode(std::span<const uint8_t> data, std::span<uint8_t> codeword) const;
+
+	// Corrects codeword (block_length bytes) in place. erasures are the indices of bytes known to be bad.
+	// Returns how many bytes were changed, or -1 if the block has too many errors (codeword is left as it was).
+	int decode(std::span<uint8_t> codeword, std::span<const uint32_t> erasures = {}) const;
+};
\ No newline at end of file
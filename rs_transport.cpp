@@ -0,0 +1,240 @@
+#include "rs_transport.h"
+
+#include <cassert>
+#include <cmath>
+
+#include <algorithm>
+
+#include "compression.h"
+#include "console.h"
+#include "framing.h"
+#include "my_print.h"
+#include "pilot.h"
+#include "set_colors.h"
+#include "transmission_plan.h"
+
+constexpr uint32_t LENGTH_HEADER_SIZE = 4;
+
+RsTransport::RsTransport(uint32_t bits_per_frame, const RsTransportOptions& options)
+	: m_code(options.block_length, options.data_length), m_interleaver_options(options.interleaver), m_bits_per_frame(bits_per_frame)
+{
+	assert(bits_per_frame > 0);
+	m_interleaver_options.symbol_size = 8;
+}
+
+Interleaver RsTransport::getInterleaver(size_t num_blocks) const
+{
+	InterleaverOptions options = m_interleaver_options;
+	if (options.depth == 0) {
+		options.depth = static_cast<uint32_t>(std::max<size_t>(num_blocks, 1));
+	}
+	return Interleaver(options);
+}
+
+size_t RsTransport::getNumBlocksForFrames(size_t num_frames) const
+{
+	const size_t num_bits = num_frames * m_bits_per_frame;
+	const size_t block_bits = static_cast<size_t>(m_code.getBlockLength()) * 8;
+	size_t num_blocks = num_bits / block_bits;
+	while (num_blocks > 0 && getInterleaver(num_blocks).getInterleavedLength(num_blocks * block_bits) > num_bits) {
+		--num_blocks;
+	}
+	return num_blocks;
+}
+
+uint32_t RsTransport::getNumFrames(size_t payload_size) const
+{
+	const size_t num_blocks = (payload_size + LENGTH_HEADER_SIZE + m_code.getDataLength() - 1) / m_code.getDataLength();
+	const size_t num_bits = getInterleaver(num_blocks).getInterleavedLength(num_blocks * m_code.getBlockLength() * 8);
+	return static_cast<uint32_t>((num_bits + m_bits_per_frame - 1) / m_bits_per_frame);
+}
+
+std::vector<uint8_t> RsTransport::encode(std::span<const uint8_t> payload) const
+{
+	std::vector<uint8_t> stream(LENGTH_HEADER_SIZE);
+	const uint32_t length = static_cast<uint32_t>(payload.size());
+	for (uint32_t i = 0; i < LENGTH_HEADER_SIZE; ++i) {
+		stream[i] = static_cast<uint8_t>(length >> (i * 8));
+	}
+	stream.insert(stream.end(), payload.begin(), payload.end());
+
+	const uint32_t data_length = m_code.getDataLength();
+	const uint32_t block_length = m_code.getBlockLength();
+	const uint32_t num_frames = getNumFrames(payload.size());
+	const size_t num_blocks = getNumBlocksForFrames(num_frames);
+	stream.resize(num_blocks * data_length);
+
+	std::vector<uint8_t> coded_bits(num_blocks * block_length * 8);
+	std::vector<uint8_t> codeword(block_length);
+	size_t bit = 0;
+	for (size_t block = 0; block < num_blocks; ++block) {
+		m_code.encode(std::span<const uint8_t>(stream).subspan(block * data_length, data_length), codeword);
+		for (const uint8_t byte : codeword) {
+			for (int i = 7; i >= 0; --i) {
+				coded_bits[bit++] = (byte >> i) & 1;
+			}
+		}
+	}
+
+	const Interleaver interleaver = getInterleaver(num_blocks);
+	std::vector<uint8_t> bits(static_cast<size_t>(num_frames) * m_bits_per_frame);
+	interleaver.interleave(coded_bits, std::span<uint8_t>(bits).first(interleaver.getInterleavedLength(coded_bits.size())));
+	return bits;
+}
+
+RsDecodeResult RsTransport::decode(std::span<const uint8_t> received_bits, std::span<const uint8_t> frame_lost) const
+{
+	const uint32_t data_length = m_code.getDataLength();
+	const uint32_t block_length = m_code.getBlockLength();
+	const size_t block_bits = static_cast<size_t>(block_length) * 8;
+	const size_t num_blocks = getNumBlocksForFrames(received_bits.size() / m_bits_per_frame);
+	const Interleaver interleaver = getInterleaver(num_blocks);
+
+	// lost frames go through the deinterleaver alongside the bits so it's known which bytes they carried
+	std::vector<uint8_t> received_lost(received_bits.size());
+	for (size_t frame = 0; frame < frame_lost.size(); ++frame) {
+		if (frame_lost[frame]) {
+			const size_t first = std::min(frame * m_bits_per_frame, received_lost.size());
+			const size_t last = std::min(first + m_bits_per_frame, received_lost.size());
+			std::fill(received_lost.begin() + first, received_lost.begin() + last, static_cast<uint8_t>(1));
+		}
+	}
+	std::vector<uint8_t> coded_bits(num_blocks * block_bits);
+	std::vector<uint8_t> coded_lost(num_blocks * block_bits);
+	interleaver.deinterleave(received_bits, coded_bits);
+	interleaver.deinterleave(received_lost, coded_lost);
+
+	RsDecodeResult result{};
+	std::vector<uint8_t> stream{};
+	stream.reserve(num_blocks * data_length);
+	std::vector<uint8_t> codeword(block_length);
+	std::vector<uint32_t> erasures{};
+	for (size_t block = 0; block < num_blocks; ++block) {
+		erasures.clear();
+		for (uint32_t i = 0; i < block_length; ++i) {
+			const size_t first_bit = block * block_bits + static_cast<size_t>(i) * 8;
+			uint8_t byte = 0;
+			bool lost = false;
+			for (size_t b = 0; b < 8; ++b) {
+				byte = static_cast<uint8_t>((byte << 1) | (coded_bits[first_bit + b] & 1));
+				lost |= coded_lost[first_bit + b] != 0;
+			}
+			codeword[i] = byte;
+			if (lost) {
+				erasures.push_back(i);
+			}
+		}
+
+		const int corrected = m_code.decode(codeword, erasures);
+		if (corrected < 0) {
+			++result.failed_blocks;
+		}
+		else {
+			result.corrected_bytes += static_cast<uint32_t>(corrected);
+		}
+		stream.insert(stream.end(), codeword.begin(), codeword.begin() + data_length);
+	}
+
+	if (stream.size() < LENGTH_HEADER_SIZE) {
+		return result;
+	}
+	uint32_t length = 0;
+	for (uint32_t i = 0; i < LENGTH_HEADER_SIZE; ++i) {
+		length |= static_cast<uint32_t>(stream[i]) << (i * 8);
+	}
+	const bool length_valid = length <= stream.size() - LENGTH_HEADER_SIZE;
+	const size_t payload_size = length_valid ? length : stream.size() - LENGTH_HEADER_SIZE;
+	result.payload.assign(stream.begin() + LENGTH_HEADER_SIZE, stream.begin() + LENGTH_HEADER_SIZE + payload_size);
+	result.complete = length_valid && result.failed_blocks == 0;
+	return result;
+}
+
+void transmitBytes(const CorsairDeviceId* device_id, Leds& leds, std::span<const uint8_t> payload, const RsTransportOptions& options,
+	const FrameHeader& description)
+{
+	const PilotLayout pilots(leds.getLayout().getDataKeys(), options.num_pilots);
+	const auto keys = pilots.getDataKeys();
+	const FrameFormat format(static_cast<uint32_t>(keys.size()) * 3);
+	const RsTransport transport(format.getPayloadBitsPerFrame(), options);
+
+	std::vector<uint8_t> compressed{};
+	const size_t source_size = payload.size();
+	if (options.compress) {
+		compressed = compressPayload(payload);
+		payload = compressed;
+	}
+
+	FrameHeader header{};
+	header.payload_type = description.payload_type;
+	header.width = description.width;
+	header.height = description.height;
+	header.payload_length = static_cast<uint32_t>(payload.size());
+	header.compression = static_cast<uint8_t>(options.compress ? PayloadCompression::Lz : PayloadCompression::None);
+	header.symbol_rate_centihertz = static_cast<uint16_t>(std::lround(options.frequency * 100.0));
+	header.rs_block_length = static_cast<uint8_t>(options.block_length);
+	header.rs_data_length = static_cast<uint8_t>(options.data_length);
+	header.interleaver_type = static_cast<uint8_t>(options.interleaver.type);
+	header.interleaver_depth = static_cast<uint16_t>(options.interleaver.depth);
+	header.interleaver_delay = static_cast<uint8_t>(options.interleaver.delay);
+	const std::vector<uint8_t> bits = format.build(header, transport.encode(payload));
+	const int iters = static_cast<int>(bits.size() / format.getBitsPerFrame());
+
+	const TransmissionPlan plan = TransmissionPlan::compile(leds, iters, [&](int iteration) {
+		leds.setAll(0, 0, 0);
+		showFrameBits(leds, keys, bits.data() + static_cast<size_t>(iteration) * format.getBitsPerFrame());
+		pilots.show(leds, static_cast<uint64_t>(iteration));
+		});
+
+	myPrint("RS({}, {}): {} payload bytes in {} frames, {:.1f} payload bits per frame", options.block_length, options.data_length,
+		payload.size(), iters, iters > 0 ? static_cast<double>(payload.size()) * 8.0 / iters : 0.0);
+	if (options.num_pilots > 0) {
+		myPrint("{} pilot keys, {} data keys", options.num_pilots, keys.size());
+	}
+	const double duration = static_cast<double>(iters) / options.frequency;
+	if (options.compress) {
+		myPrint("Compressed {} source bytes to {} ({:.2f}x)", source_size, payload.size(),
+			payload.empty() ? 0.0 : static_cast<double>(source_size) / static_cast<double>(payload.size()));
+	}
+	myPrint("Transmitting for {} seconds, {:.1f} source bytes per second", duration, duration > 0.0 ? static_cast<double>(source_size) / duration : 0.0);
+
+	waitForKeyPress();
+
+	playTransmissionPlan(device_id, leds, plan, static_cast<int64_t>(1'000'000.0 / options.frequency));
+
+	leds.setAll(0, 0, 0);
+	setColors(device_id, leds);
+	waitForColors(leds);
+}
+
+std::optional<RsDecodeResult> decodeBytes(std::span<const uint8_t> received_bits, uint32_t bits_per_frame)
+{
+	const auto transmission = FrameParser(bits_per_frame).parse(received_bits);
+	if (!transmission) {
+		return std::nullopt;
+	}
+	const FrameHeader& header = transmission->header;
+	if (header.payload_type == PayloadType::Image || header.payload_type == PayloadType::PaletteImage || header.rs_block_length == 0 || header.rs_data_length >= header.rs_block_length) {
+		return std::nullopt;
+	}
+
+	RsTransportOptions options{};
+	options.block_length = header.rs_block_length;
+	options.data_length = header.rs_data_length;
+	options.interleaver.type = static_cast<InterleaverType>(header.interleaver_type);
+	options.interleaver.depth = header.interleaver_depth;
+	options.interleaver.delay = header.interleaver_delay;
+	options.frequency = header.symbol_rate_centihertz / 100.0;
+	const RsTransport transport(FrameFormat(bits_per_frame).getPayloadBitsPerFrame(), options);
+	RsDecodeResult result = transport.decode(transmission->payload_bits, transmission->frame_lost);
+
+	if (header.compression == static_cast<uint8_t>(PayloadCompression::Lz)) {
+		StreamingDecompressor decompressor{};
+		decompressor.feed(result.payload);
+		decompressor.finish();
+		std::vector<uint8_t> source{};
+		const bool intact = decompressor.decode(source) && decompressor.isDone();
+		result.payload = std::move(source);
+		result.complete = result.complete && intact;
+	}
+	return result;
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <iCUESDK/iCUESDK.h>
+
+#include "framing.h"
+#include "interleaver.h"
+#include "leds.h"
+#include "reed_solomon.h"
+
+struct RsTransportOptions {
+	uint32_t block_length = 255;
+	uint32_t data_length = 191; // code rate is data_length / block_length, corrects up to (block_length - data_length) / 2 bytes per block
+	// Bytes are the interleaved symbols, depth 0 puts every codeword in a row of its own so each frame carries byte j of
+	// every codeword and a lost frame costs each codeword only a few bytes
+	InterleaverOptions interleaver{ .type = InterleaverType::Block, .depth = 0 };
+	double frequency = 20.0; // frames per second
+	uint32_t num_pilots = 0; // data keys given over to pilots (see PilotLayout), 0 for none
+	bool compress = false; // compressPayload() first, worth it for text
+};
+
+struct RsDecodeResult {
+	std::vector<uint8_t> payload;
+	uint32_t corrected_bytes;
+	uint32_t failed_blocks; // blocks with too many errors, their bytes are passed through uncorrected
+	bool complete; // every block decoded and the length header was readable
+};
+
+// Byte stream carried in frames of bits_per_frame bits, on the keyboard that is the payload part of each data frame of a
+// FrameFormat. The payload is prefixed with its length (4 bytes, little endian), split into blocks of
+// data_length bytes (the last padded with zeros) and each block becomes a Reed-Solomon codeword. The codeword bytes are
+// interleaved and sent most significant bit first, the last frame is padded with zeros.
+// Bits are held one per byte (0 or 1) so decoders further down the stack can hand over what they read directly.
+class RsTransport {
+	ReedSolomon m_code;
+	InterleaverOptions m_interleaver_options;
+	uint32_t m_bits_per_frame;
+
+	Interleaver getInterleaver(size_t num_blocks) const;
+
+	// Every block that fits in num_frames, the encoder fills the padding with zero blocks so the decoder can work this out too
+	size_t getNumBlocksForFrames(size_t num_frames) const;
+
+public:
+	RsTransport(uint32_t bits_per_frame, const RsTransportOptions& options = {});
+
+	uint32_t getBitsPerFrame() const { return m_bits_per_frame; }
+
+	const ReedSolomon& getCode() const { return m_code; }
+
+	uint32_t getNumFrames(size_t payload_size) const;
+
+	// getNumFrames() * getBitsPerFrame() bits
+	std::vector<uint8_t> encode(std::span<const uint8_t> payload) const;
+
+	// received_bits holds whole frames as the receiver read them. frame_lost has one entry per frame, non-zero for frames the
+	// receiver missed or couldn't read; their bits are ignored and the bytes they carried are decoded as erasures.
+	RsDecodeResult decode(std::span<const uint8_t> received_bits, std::span<const uint8_t> frame_lost = {}) const;
+};
+
+// Sends payload as a framed transmission (see FrameFormat) on the data keys, the header carries the code and interleaver.
+// payload_type, width and height of the header are taken from description, the rest is filled in here.
+void transmitBytes(const CorsairDeviceId* device_id, Leds& leds, std::span<const uint8_t> payload, const RsTransportOptions& options = {},
+	const FrameHeader& description = {});
+
+// Receive side of transmitBytes(): finds the transmission in the frames a receiver read (bits_per_frame = 3 per data key,
+// not counting pilots; with pilots, slicePilotSymbols() gives the frames)
+// and decodes it with the parameters from its header, frames that failed their CRC or never arrived become erasures.
+// Compressed payloads are decompressed, as far as the stream stays intact if some blocks failed.
+std::optional<RsDecodeResult> decodeBytes(std::span<const uint8_t> received_bits, uint32_t bits_per_frame);
\ No newline at end of file
@@ -6,7 +6,7 @@
 #include <numbers>
 #include <thread>
 
-#include "fixed_update_loop.h"
+#include "frame_pipeline.h"
 #include "set_colors.h"
 #include "my_print.h"
 
@@ -17,13 +17,9 @@ void samplingTest(const CorsairDeviceId* device_id, Leds& leds, double frequency
 
 	auto start = std::chrono::high_resolution_clock::now();
 
-	waitForColors();
+	waitForColors(leds);
 
-	startFixedUpdateLoop(iterations, static_cast<int64_t>(1'000'000.0 / frequency), [&](int iteration) {
+	startFramePipeline(device_id, leds, iterations, static_cast<int64_t>(1'000'000.0 / frequency), [&](int iteration) {
 		leds.setAll(0, (iteration % 2) * 255, 0);
-		waitForColors();
-		setColors(device_id, leds);
 		});
-
-	waitForColors();
 }
\ No newline at end of file
@@ -2,33 +2,31 @@
 
 #include <cassert>
 
-#include <atomic>
 #include <span>
 
 #include <iCUESDK/iCUESDK.h>
 
 #include "corsair_helpers.h"
 
-static std::atomic<bool> s_color_set{ true };
-
-static void onColorSet(void*, CorsairError error)
+uint64_t setColors(const CorsairDeviceId* device_id, Leds& leds)
 {
-	CHECKCORSAIR(error);
-	s_color_set.store(true, std::memory_order_relaxed);
+	FrameColors changed{};
+	leds.takeChangedColors(changed);
+	return setColors(device_id, leds.getBackend(), leds.getFlushTracker(), std::span<const CorsairLedColor>(changed.data(), changed.size()));
 }
 
-void setColors(const CorsairDeviceId* device_id, const Leds& leds)
+uint64_t setColors(const CorsairDeviceId* device_id, LightingBackend& backend, FlushTracker& tracker, std::span<const CorsairLedColor> colors)
 {
-	assert(s_color_set.load(std::memory_order_relaxed) == true);
-	s_color_set.store(false, std::memory_order_relaxed);
-	CHECKCORSAIR(CorsairSetLedColorsBuffer(*device_id, static_cast<int>(leds.getCount()), leds.getColorsBuffer()));
-	CHECKCORSAIR(CorsairSetLedColorsFlushBufferAsync(onColorSet, nullptr));
-
+	assert(tracker.hasFreeSlot());
+	if (!colors.empty()) {
+		CHECKCORSAIR(backend.setLedColorsBuffer(device_id, static_cast<int>(colors.size()), colors.data()));
+	}
+	const FlushTracker::Ticket ticket = tracker.beginFlush();
+	CHECKCORSAIR(backend.setLedColorsFlushBufferAsync(ticket.callback, ticket.context));
+	return ticket.sequence;
 }
 
-void waitForColors()
+void waitForColors(const Leds& leds)
 {
-	while (s_color_set.load(std::memory_order_relaxed) == false) {
-		_mm_pause(); // designed for spinning on an atomic variable (like here)
-	}
+	leds.getFlushTracker().waitForAll();
 }
\ No newline at end of file
@@ -4,8 +4,17 @@
 
 #include <iCUESDK/iCUESDK.h>
 
+#include "flush_tracker.h"
 #include "leds.h"
+#include "lighting_backend.h"
 
-void setColors(const CorsairDeviceId* device_id, const Leds& leds);
+// Submits only what changed in leds since the last submission (see Leds::setDeltaSubmission())
+// Returns the sequence number of the flush, see FlushTracker
+uint64_t setColors(const CorsairDeviceId* device_id, Leds& leds);
 
-void waitForColors();
\ No newline at end of file
+// colors can be any subset of the device's LEDs, including none (the flush still happens)
+// tracker must have a free slot
+uint64_t setColors(const CorsairDeviceId* device_id, LightingBackend& backend, FlushTracker& tracker, std::span<const CorsairLedColor> colors);
+
+// Waits until every flush submitted for this device has completed, see FlushTracker::setWaitStrategy()
+void waitForColors(const Leds& leds);
\ No newline at end of file
@@ -0,0 +1,317 @@
+#include "simulated_k70.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <iCUESDK/iCUESDKLedIdEnum.h>
+
+#include "my_print.h"
+
+static constexpr CorsairDeviceId SIMULATED_DEVICE_ID = "{SIMULATED-K70-RGB}";
+
+// Centre of every LED in mm, same ordering and units as CorsairGetLedPositions() on a K70 RGB with the ISO (UK) layout.
+// Rows are centred at 36.5, 51.3, 69.8, 88.3, 106.8 and 125.3.
+// Two-row keys (ISO enter, keypad plus, keypad enter) are reported at their centre, just off the midpoint between their rows.
+// The last 3 LEDs (mute and the two logo LEDs) sit above the function row.
+static constexpr std::array<CorsairLedPosition, SIMULATED_K70_LED_COUNT> LED_POSITIONS{ {
+	{ CLK_Escape, 21.5, 36.5 },
+	{ CLK_F1, 59.6, 36.5 },
+	{ CLK_F2, 78.7, 36.5 },
+	{ CLK_F3, 97.7, 36.5 },
+	{ CLK_F4, 116.8, 36.5 },
+	{ CLK_F5, 145.3, 36.5 },
+	{ CLK_F6, 164.4, 36.5 },
+	{ CLK_F7, 183.5, 36.5 },
+	{ CLK_F8, 202.5, 36.5 },
+	{ CLK_F9, 231.1, 36.5 },
+	{ CLK_F10, 250.1, 36.5 },
+	{ CLK_F11, 269.2, 36.5 },
+	{ CLK_F12, 288.2, 36.5 },
+	{ CLK_PrintScreen, 312.0, 36.5 },
+	{ CLK_ScrollLock, 331.1, 36.5 },
+	{ CLK_PauseBreak, 350.1, 36.5 },
+	{ CLK_Stop, 373.9, 36.5 },
+	{ CLK_ScanPreviousTrack, 393.0, 36.5 },
+	{ CLK_PlayPause, 412.1, 36.5 },
+	{ CLK_ScanNextTrack, 431.1, 36.5 },
+	{ CLK_GraveAccentAndTilde, 21.5, 51.3 },
+	{ CLK_1, 40.6, 51.3 },
+	{ CLK_2, 59.6, 51.3 },
+	{ CLK_3, 78.7, 51.3 },
+	{ CLK_4, 97.7, 51.3 },
+	{ CLK_5, 116.8, 51.3 },
+	{ CLK_6, 135.8, 51.3 },
+	{ CLK_7, 154.9, 51.3 },
+	{ CLK_8, 173.9, 51.3 },
+	{ CLK_9, 193.0, 51.3 },
+	{ CLK_0, 212.0, 51.3 },
+	{ CLK_MinusAndUnderscore, 231.1, 51.3 },
+	{ CLK_EqualsAndPlus, 250.1, 51.3 },
+	{ CLK_Backspace, 278.7, 51.3 },
+	{ CLK_Insert, 312.0, 51.3 },
+	{ CLK_Home, 331.1, 51.3 },
+	{ CLK_PageUp, 350.1, 51.3 },
+	{ CLK_NumLock, 373.9, 51.3 },
+	{ CLK_KeypadSlash, 393.0, 51.3 },
+	{ CLK_KeypadAsterisk, 412.1, 51.3 },
+	{ CLK_KeypadMinus, 431.1, 51.3 },
+	{ CLK_Tab, 26.3, 69.8 },
+	{ CLK_Q, 50.1, 69.8 },
+	{ CLK_W, 69.2, 69.8 },
+	{ CLK_E, 88.2, 69.8 },
+	{ CLK_R, 107.2, 69.8 },
+	{ CLK_T, 126.3, 69.8 },
+	{ CLK_Y, 145.3, 69.8 },
+	{ CLK_U, 164.4, 69.8 },
+	{ CLK_I, 183.5, 69.8 },
+	{ CLK_O, 202.5, 69.8 },
+	{ CLK_P, 221.6, 69.8 },
+	{ CLK_BracketLeft, 240.6, 69.8 },
+	{ CLK_BracketRight, 259.6, 69.8 },
+	{ CLK_Delete, 312.0, 69.8 },
+	{ CLK_End, 331.1, 69.8 },
+	{ CLK_PageDown, 350.1, 69.8 },
+	{ CLK_Keypad7, 373.9, 69.8 },
+	{ CLK_Keypad8, 393.0, 69.8 },
+	{ CLK_Keypad9, 412.1, 69.8 },
+	{ CLK_CapsLock, 28.7, 88.3 },
+	{ CLK_A, 54.9, 88.3 },
+	{ CLK_S, 73.9, 88.3 },
+	{ CLK_D, 93.0, 88.3 },
+	{ CLK_F, 112.0, 88.3 },
+	{ CLK_G, 131.1, 88.3 },
+	{ CLK_H, 150.1, 88.3 },
+	{ CLK_J, 169.2, 88.3 },
+	{ CLK_K, 188.2, 88.3 },
+	{ CLK_L, 207.3, 88.3 },
+	{ CLK_SemicolonAndColon, 226.3, 88.3 },
+	{ CLK_ApostropheAndDoubleQuote, 245.4, 88.3 },
+	{ CLK_NonUsTilde, 264.4, 88.3 },
+	{ CLK_Enter, 280.6, 79.1 },
+	{ CLK_Keypad4, 373.9, 88.3 },
+	{ CLK_Keypad5, 393.0, 88.3 },
+	{ CLK_Keypad6, 412.1, 88.3 },
+	{ CLK_KeypadPlus, 431.1, 79.1 },
+	{ CLK_LeftShift, 23.9, 106.8 },
+	{ CLK_NonUsBackslash, 45.3, 106.8 },
+	{ CLK_Z, 64.4, 106.8 },
+	{ CLK_X, 83.4, 106.8 },
+	{ CLK_C, 102.5, 106.8 },
+	{ CLK_V, 121.5, 106.8 },
+	{ CLK_B, 140.6, 106.8 },
+	{ CLK_N, 159.6, 106.8 },
+	{ CLK_M, 178.7, 106.8 },
+	{ CLK_CommaAndLessThan, 197.7, 106.8 },
+	{ CLK_PeriodAndBiggerThan, 216.8, 106.8 },
+	{ CLK_SlashAndQuestionMark, 235.8, 106.8 },
+	{ CLK_RightShift, 271.6, 106.8 },
+	{ CLK_UpArrow, 331.1, 106.8 },
+	{ CLK_Keypad1, 373.9, 106.8 },
+	{ CLK_Keypad2, 393.0, 106.8 },
+	{ CLK_Keypad3, 412.1, 106.8 },
+	{ CLK_KeypadEnter, 431.1, 116.0 },
+	{ CLK_LeftCtrl, 23.9, 125.3 },
+	{ CLK_LeftGui, 47.7, 125.3 },
+	{ CLK_LeftAlt, 71.5, 125.3 },
+	{ CLK_Space, 143.0, 125.3 },
+	{ CLK_RightAlt, 214.4, 125.3 },
+	{ CLK_RightGui, 238.2, 125.3 },
+	{ CLK_Application, 262.0, 125.3 },
+	{ CLK_RightCtrl, 285.8, 125.3 },
+	{ CLK_LeftArrow, 312.0, 125.3 },
+	{ CLK_DownArrow, 331.1, 125.3 },
+	{ CLK_RightArrow, 350.1, 125.3 },
+	{ CLK_Keypad0, 383.5, 125.3 },
+	{ CLK_KeypadPeriodAndDelete, 412.1, 125.3 },
+	{ CLK_Mute, 431.1, 22.0 },
+	{ (CLG_KeyboardOem << 16) | 1, 173.9, 10.0 },
+	{ (CLG_KeyboardOem << 16) | 2, 193.0, 10.0 },
+} };
+
+SimulatedK70Backend::SimulatedK70Backend(const SimulatedK70Options& options) : m_options(options)
+{
+	for (uint32_t i = 0; i < SIMULATED_K70_LED_COUNT; ++i) {
+		m_buffer[i] = CorsairLedColor{ .id = LED_POSITIONS[i].id, .r = 0, .g = 0, .b = 0, .a = 255 };
+	}
+	m_latched = m_buffer;
+	m_displayed = m_buffer;
+}
+
+SimulatedK70Backend::~SimulatedK70Backend()
+{
+	if (m_device_thread.joinable()) {
+		disconnect();
+	}
+}
+
+void SimulatedK70Backend::deviceThread()
+{
+	const auto refresh_period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / m_options.refresh_hz));
+	auto next_refresh = Clock::now() + refresh_period;
+
+	std::unique_lock lock(m_mutex);
+	while (!m_stop) {
+		auto wake_time = next_refresh;
+		if (!m_pending_flushes.empty()) {
+			wake_time = std::min(wake_time, m_pending_flushes.front().due);
+		}
+		m_cv.wait_until(lock, wake_time);
+
+		const auto now = Clock::now();
+
+		// The flush reaches the device, then iCUE reports completion
+		while (!m_pending_flushes.empty() && m_pending_flushes.front().due <= now) {
+			PendingFlush flush = std::move(m_pending_flushes.front());
+			m_pending_flushes.pop_front();
+			if (m_latched_valid) {
+				++m_num_frames_skipped;
+			}
+			m_latched = flush.colors;
+			m_latched_valid = true;
+			if (flush.callback) {
+				lock.unlock();
+				flush.callback(flush.context, CE_Success);
+				lock.lock();
+			}
+		}
+
+		// The device only shows whatever was most recently written at its own refresh rate
+		if (now >= next_refresh) {
+			if (m_latched_valid) {
+				m_displayed = m_latched;
+				m_latched_valid = false;
+				++m_num_frames_displayed;
+			}
+			next_refresh += refresh_period;
+			if (next_refresh < now) {
+				next_refresh = now + refresh_period; // fell behind, don't try to catch up
+			}
+		}
+	}
+}
+
+CorsairError SimulatedK70Backend::connect()
+{
+	{
+		std::lock_guard lock(m_mutex);
+		if (m_connected) {
+			return CE_InvalidOperation;
+		}
+		m_connected = true;
+		m_stop = false;
+	}
+	m_device_thread = std::thread(&SimulatedK70Backend::deviceThread, this);
+	myPrint("Connected to simulated K70 ({} Hz refresh, {} us flush latency)", m_options.refresh_hz, m_options.flush_latency.count());
+	return CE_Success;
+}
+
+CorsairError SimulatedK70Backend::disconnect()
+{
+	{
+		std::lock_guard lock(m_mutex);
+		if (!m_connected) {
+			return CE_NotConnected;
+		}
+		m_stop = true;
+	}
+	m_cv.notify_one();
+	m_device_thread.join();
+
+	std::lock_guard lock(m_mutex);
+	m_connected = false;
+	myPrint("Simulated K70: {} flushes, {} frames displayed, {} frames skipped, {} flushes dropped at disconnect",
+		m_num_flushes, m_num_frames_displayed, m_num_frames_skipped, m_pending_flushes.size());
+	m_pending_flushes.clear();
+	return CE_Success;
+}
+
+const CorsairDeviceId* SimulatedK70Backend::findKeyboard()
+{
+	myPrint("Found 1 devices:");
+	myPrint("[0]:");
+	myPrint("    model: K70 RGB (simulated)");
+	myPrint("    id: {}", SIMULATED_DEVICE_ID);
+	myPrint("    LED count: {}", SIMULATED_K70_LED_COUNT);
+	return &SIMULATED_DEVICE_ID;
+}
+
+CorsairError SimulatedK70Backend::requestControl(const CorsairDeviceId* device_id)
+{
+	if (std::strcmp(*device_id, SIMULATED_DEVICE_ID) != 0) {
+		return CE_DeviceNotFound;
+	}
+	std::lock_guard lock(m_mutex);
+	if (!m_connected) {
+		return CE_NotConnected;
+	}
+	m_has_control = true;
+	return CE_Success;
+}
+
+CorsairError SimulatedK70Backend::releaseControl(const CorsairDeviceId* device_id)
+{
+	if (std::strcmp(*device_id, SIMULATED_DEVICE_ID) != 0) {
+		return CE_DeviceNotFound;
+	}
+	std::lock_guard lock(m_mutex);
+	if (!m_has_control) {
+		return CE_InvalidOperation;
+	}
+	m_has_control = false;
+	return CE_Success;
+}
+
+CorsairError SimulatedK70Backend::getLedPositions(const CorsairDeviceId* device_id, int size_max, CorsairLedPosition* led_positions, int* size)
+{
+	if (std::strcmp(*device_id, SIMULATED_DEVICE_ID) != 0) {
+		return CE_DeviceNotFound;
+	}
+	if (size_max < 0 || !led_positions || !size) {
+		return CE_InvalidArguments;
+	}
+	const int count = std::min(size_max, static_cast<int>(SIMULATED_K70_LED_COUNT));
+	std::copy_n(LED_POSITIONS.begin(), count, led_positions);
+	*size = count;
+	return CE_Success;
+}
+
+CorsairError SimulatedK70Backend::setLedColorsBuffer(const CorsairDeviceId* device_id, int size, const CorsairLedColor* led_colors)
+{
+	if (std::strcmp(*device_id, SIMULATED_DEVICE_ID) != 0) {
+		return CE_DeviceNotFound;
+	}
+	if (size < 0 || (size > 0 && !led_colors)) {
+		return CE_InvalidArguments;
+	}
+	std::lock_guard lock(m_mutex);
+	if (!m_connected) {
+		return CE_NotConnected;
+	}
+	if (!m_has_control) {
+		return CE_NoControl;
+	}
+	for (int i = 0; i < size; ++i) {
+		const auto it = std::find_if(LED_POSITIONS.begin(), LED_POSITIONS.end(), [&](const CorsairLedPosition& position) {
+			return position.id == led_colors[i].id;
+			});
+		if (it == LED_POSITIONS.end()) {
+			return CE_InvalidArguments;
+		}
+		m_buffer[it - LED_POSITIONS.begin()] = led_colors[i];
+	}
+	return CE_Success;
+}
+
+CorsairError SimulatedK70Backend::setLedColorsFlushBufferAsync(CorsairAsyncCallback callback, void* context)
+{
+	{
+		std::lock_guard lock(m_mutex);
+		if (!m_connected) {
+			return CE_NotConnected;
+		}
+		m_pending_flushes.push_back(PendingFlush{ .due = Clock::now() + m_options.flush_latency, .callback = callback, .context = context, .colors = m_buffer });
+		++m_num_flushes;
+	}
+	m_cv.notify_one();
+	return CE_Success;
+}
\ No newline at end of file
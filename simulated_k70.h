@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <iCUESDK/iCUESDK.h>
+
+#include "lighting_backend.h"
+
+constexpr uint32_t SIMULATED_K70_LED_COUNT = 112;
+
+struct SimulatedK70Options {
+	// The device only picks up the most recently flushed buffer this many times per second.
+	// Flushing faster than this means some frames are never displayed (see morse_code.cpp)
+	double refresh_hz = 20.0;
+	// Time between CorsairSetLedColorsFlushBufferAsync() and its callback
+	std::chrono::microseconds flush_latency{ 2'000 };
+};
+
+// An in-process stand-in for a 112 LED K70 (ISO layout) so everything can run without iCUE or any hardware.
+class SimulatedK70Backend : public LightingBackend {
+	using Clock = std::chrono::steady_clock;
+	using Frame = std::array<CorsairLedColor, SIMULATED_K70_LED_COUNT>;
+
+	struct PendingFlush {
+		Clock::time_point due;
+		CorsairAsyncCallback callback;
+		void* context;
+		Frame colors;
+	};
+
+	const SimulatedK70Options m_options;
+
+	std::mutex m_mutex{}; // protects everything below, accessed by caller threads and m_device_thread
+	std::condition_variable m_cv{};
+	bool m_connected = false;
+	bool m_has_control = false;
+	bool m_stop = false;
+	Frame m_buffer{}; // what CorsairSetLedColorsBuffer writes to
+	std::deque<PendingFlush> m_pending_flushes{};
+	Frame m_latched{}; // written to the device but not displayed yet
+	bool m_latched_valid = false;
+	Frame m_displayed{};
+
+	uint64_t m_num_flushes = 0;
+	uint64_t m_num_frames_displayed = 0;
+	uint64_t m_num_frames_skipped = 0; // overwritten by a newer flush before the device refreshed
+
+	std::thread m_device_thread{};
+
+	void deviceThread();
+
+public:
+	explicit SimulatedK70Backend(const SimulatedK70Options& options = {});
+	SimulatedK70Backend(const SimulatedK70Backend&) = delete;
+	SimulatedK70Backend& operator=(const SimulatedK70Backend&) = delete;
+	~SimulatedK70Backend() override;
+
+	CorsairError connect() override;
+	CorsairError disconnect() override;
+	const CorsairDeviceId* findKeyboard() override;
+	CorsairError requestControl(const CorsairDeviceId* device_id) override;
+	CorsairError releaseControl(const CorsairDeviceId* device_id) override;
+	CorsairError getLedPositions(const CorsairDeviceId* device_id, int size_max, CorsairLedPosition* led_positions, int* size) override;
+	CorsairError setLedColorsBuffer(const CorsairDeviceId* device_id, int size, const CorsairLedColor* led_colors) override;
+	CorsairError setLedColorsFlushBufferAsync(CorsairAsyncCallback callback, void* context) override;
+};
\ No newline at end of file
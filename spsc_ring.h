@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+
+#include <array>
+#include <atomic>
+
+// A lock-free single-producer single-consumer ring buffer.
+// Slots are written and read in place (begin/end pairs) so large objects never have to be copied in or out.
+// Capacity must be a power of two.
+template <typename T, uint32_t Capacity>
+class SpscRing {
+
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0);
+
+	std::array<T, Capacity> m_slots{};
+	alignas(64) std::atomic<uint32_t> m_head{}; // total number of pushes, only written by the producer
+	alignas(64) std::atomic<uint32_t> m_tail{}; // total number of pops, only written by the consumer
+
+public:
+	// PRODUCER
+
+	// returns nullptr if full
+	T* tryBeginPush()
+	{
+		const uint32_t head = m_head.load(std::memory_order_relaxed);
+		const uint32_t tail = m_tail.load(std::memory_order_acquire);
+		if (head - tail == Capacity) {
+			return nullptr;
+		}
+		return &m_slots[head & (Capacity - 1)];
+	}
+
+	// Blocks (without spinning) until a slot is free
+	T* beginPush()
+	{
+		while (true) {
+			const uint32_t tail = m_tail.load(std::memory_order_acquire);
+			if (T* slot = tryBeginPush()) {
+				return slot;
+			}
+			m_tail.wait(tail, std::memory_order_acquire);
+		}
+	}
+
+	// Publishes the slot returned by tryBeginPush()/beginPush()
+	void endPush()
+	{
+		m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		m_head.notify_one();
+	}
+
+	// CONSUMER
+
+	// returns nullptr if empty
+	T* tryBeginPop()
+	{
+		const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+		const uint32_t head = m_head.load(std::memory_order_acquire);
+		if (head == tail) {
+			return nullptr;
+		}
+		return &m_slots[tail & (Capacity - 1)];
+	}
+
+	// Blocks (without spinning) until a slot has been pushed
+	T* beginPop()
+	{
+		while (true) {
+			const uint32_t head = m_head.load(std::memory_order_acquire);
+			if (T* slot = tryBeginPop()) {
+				return slot;
+			}
+			m_head.wait(head, std::memory_order_acquire);
+		}
+	}
+
+	// Releases the slot returned by tryBeginPop()/beginPop() back to the producer
+	void endPop()
+	{
+		m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		m_tail.notify_one();
+	}
+
+	constexpr uint32_t capacity() const { return Capacity; }
+};
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include "transfer_function.h"
+
+#include <cassert>
+#include <cmath>
+
+#include <algorithm>
+
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static uint8_t toChannel(double fraction)
+{
+	return static_cast<uint8_t>(std::lround(std::clamp(fraction, 0.0, 1.0) * 255.0));
+}
+
+TransferCurve makeIdentityCurve()
+{
+	TransferCurve curve{};
+	for (int i = 0; i < 256; ++i) {
+		curve[i] = static_cast<uint8_t>(i);
+	}
+	return curve;
+}
+
+TransferCurve makeGammaCurve(double gamma)
+{
+	TransferCurve curve{};
+	for (int i = 0; i < 256; ++i) {
+		curve[i] = toChannel(std::pow(i / 255.0, gamma));
+	}
+	return curve;
+}
+
+TransferCurve makePolynomialCurve(std::span<const double> coefficients)
+{
+	TransferCurve curve{};
+	for (int i = 0; i < 256; ++i) {
+		// Horner's method
+		const double x = i / 255.0;
+		double y = 0.0;
+		for (auto it = coefficients.rbegin(); it != coefficients.rend(); ++it) {
+			y = y * x + *it;
+		}
+		curve[i] = toChannel(y);
+	}
+	return curve;
+}
+
+TransferCurve makeMeasuredCurve(std::span<const CurvePoint> points)
+{
+	assert(!points.empty());
+	assert(std::is_sorted(points.begin(), points.end(), [](const CurvePoint& a, const CurvePoint& b) { return a.input < b.input; }));
+
+	TransferCurve curve{};
+	size_t segment = 0;
+	for (int i = 0; i < 256; ++i) {
+		const double x = i / 255.0;
+		while (segment + 1 < points.size() && points[segment + 1].input <= x) {
+			++segment;
+		}
+		if (x <= points.front().input) {
+			curve[i] = toChannel(points.front().output);
+		}
+		else if (segment + 1 >= points.size()) {
+			curve[i] = toChannel(points.back().output);
+		}
+		else {
+			const CurvePoint& a = points[segment];
+			const CurvePoint& b = points[segment + 1];
+			const double t = (x - a.input) / (b.input - a.input);
+			curve[i] = toChannel(a.output + (b.output - a.output) * t);
+		}
+	}
+	return curve;
+}
+
+TransferCurve invertCurve(const TransferCurve& curve)
+{
+	assert(std::is_sorted(curve.begin(), curve.end()));
+
+	TransferCurve inverse{};
+	int input = 0;
+	for (int wanted = 0; wanted < 256; ++wanted) {
+		while (input < 255 && curve[input] < wanted) {
+			++input;
+		}
+		inverse[wanted] = static_cast<uint8_t>(input);
+	}
+	return inverse;
+}
+
+WideTransferCurve widenCurve(const TransferCurve& curve)
+{
+	WideTransferCurve wide{};
+	std::copy(curve.begin(), curve.end(), wide.begin());
+	return wide;
+}
+
+// MSVC compiles AVX2 intrinsics without /arch:AVX2, which this project doesn't set, so the gather below is in every
+// build there and is picked at run time on CPUs that have it
+#if defined(_MSC_VER) || defined(__AVX2__)
+#define TRANSFER_CURVE_AVX2
+
+static bool cpuHasAvx2()
+{
+#ifdef _MSC_VER
+	int info[4]{};
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+	__cpuid(info, 1);
+	// AVX and OSXSAVE, and the OS saves the YMM registers
+	const bool os_saves_ymm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+	__cpuidex(info, 7, 0);
+	return os_saves_ymm && (info[1] & (1 << 5));
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+// 16 values per step, 8 lookups to each 32-bit gather, returns how many were done
+static uint32_t applyTransferCurveAvx2(const WideTransferCurve& wide, const uint8_t* in, uint8_t* out, uint32_t count)
+{
+	const __m256i to_bytes = _mm256_setr_epi8(
+		0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	uint32_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		const __m256i lo = _mm256_i32gather_epi32(wide.data(), _mm256_cvtepu8_epi32(values), 4);
+		const __m256i hi = _mm256_i32gather_epi32(wide.data(), _mm256_cvtepu8_epi32(_mm_srli_si128(values, 8)), 4);
+		// each 128-bit half now has its 4 results in the low dword
+		const __m256i lo_bytes = _mm256_shuffle_epi8(lo, to_bytes);
+		const __m256i hi_bytes = _mm256_shuffle_epi8(hi, to_bytes);
+		const __m128i result = _mm_setr_epi32(
+			_mm256_extract_epi32(lo_bytes, 0), _mm256_extract_epi32(lo_bytes, 4),
+			_mm256_extract_epi32(hi_bytes, 0), _mm256_extract_epi32(hi_bytes, 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), result);
+	}
+	// the rest of the build is SSE code, avoid the transition penalty
+	_mm256_zeroupper();
+	return i;
+}
+#endif
+
+void applyTransferCurve(const TransferCurve& curve, [[maybe_unused]] const WideTransferCurve& wide, const uint8_t* in, uint8_t* out, uint32_t count)
+{
+	uint32_t i = 0;
+#ifdef TRANSFER_CURVE_AVX2
+	static const bool has_avx2 = cpuHasAvx2();
+	if (has_avx2) {
+		i = applyTransferCurveAvx2(wide, in, out, count);
+	}
+#endif
+	for (; i < count; ++i) {
+		out[i] = curve[in[i]];
+	}
+}
+
+TransferFunction::TransferFunction(const TransferCurve& r, const TransferCurve& g, const TransferCurve& b) : m_curves{ r, g, b }, m_wide_curves{ widenCurve(r), widenCurve(g), widenCurve(b) }
+{
+}
\ No newline at end of file
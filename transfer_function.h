@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+
+#include <array>
+#include <span>
+
+// 256-entry lookup table mapping a channel value to what is actually sent to the device
+using TransferCurve = std::array<uint8_t, 256>;
+
+TransferCurve makeIdentityCurve();
+
+// out = in^gamma, both as fractions of 255. 2 and 3 give the old square and cube transforms.
+TransferCurve makeGammaCurve(double gamma);
+
+// out = c[0] + c[1] * in + c[2] * in^2 + ..., in and out as fractions of 255, clamped to 0-255
+TransferCurve makePolynomialCurve(std::span<const double> coefficients);
+
+struct CurvePoint {
+	double input; // 0 to 1
+	double output; // 0 to 1
+};
+
+// Piecewise linear through points (sorted by input), flat beyond the first and last point.
+// Feed it a measured response to reproduce it, or invert it to cancel it out.
+TransferCurve makeMeasuredCurve(std::span<const CurvePoint> points);
+
+// For a non-decreasing curve: for each wanted output, the smallest input that reaches it
+TransferCurve invertCurve(const TransferCurve& curve);
+
+// The same table with 32-bit entries, which the AVX2 path of applyTransferCurve() gathers from
+using WideTransferCurve = std::array<int32_t, 256>;
+
+WideTransferCurve widenCurve(const TransferCurve& curve);
+
+// out[i] = curve[in[i]], in and out may be the same array. wide must be widenCurve(curve).
+void applyTransferCurve(const TransferCurve& curve, const WideTransferCurve& wide, const uint8_t* in, uint8_t* out, uint32_t count);
+
+// One curve per channel (0 = R, 1 = G, 2 = B), widened once here rather than on every frame
+class TransferFunction {
+	std::array<TransferCurve, 3> m_curves;
+	std::array<WideTransferCurve, 3> m_wide_curves;
+
+public:
+	TransferFunction(const TransferCurve& r, const TransferCurve& g, const TransferCurve& b);
+
+	static TransferFunction uniform(const TransferCurve& curve) { return TransferFunction(curve, curve, curve); }
+
+	const TransferCurve& getCurve(uint32_t channel) const { return m_curves[channel]; }
+
+	const WideTransferCurve& getWideCurve(uint32_t channel) const { return m_wide_curves[channel]; }
+};
\ No newline at end of file
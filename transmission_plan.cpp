@@ -0,0 +1,104 @@
+#include "transmission_plan.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+
+#include <span>
+
+#include "my_print.h"
+#include "set_colors.h"
+
+namespace {
+
+constexpr char PLAN_FILE_MAGIC[4]{ 'L', 'T', 'P', '1' };
+
+struct PlanFileHeader {
+	char magic[4];
+	uint32_t leds_per_frame;
+	uint64_t num_frames;
+};
+
+}
+
+bool TransmissionPlanWriter::open(const std::filesystem::path& path, uint32_t leds_per_frame)
+{
+	m_stream.open(path, std::ios::binary | std::ios::trunc);
+	m_leds_per_frame = leds_per_frame;
+	m_num_frames = 0;
+
+	// the frame count is patched in by finish()
+	PlanFileHeader header{};
+	std::memcpy(header.magic, PLAN_FILE_MAGIC, sizeof(header.magic));
+	header.leds_per_frame = leds_per_frame;
+	m_stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	return m_stream.good();
+}
+
+void TransmissionPlanWriter::writeFrame(const CorsairLedColor* colors)
+{
+	m_stream.write(reinterpret_cast<const char*>(colors), static_cast<std::streamsize>(sizeof(CorsairLedColor) * m_leds_per_frame));
+	++m_num_frames;
+}
+
+bool TransmissionPlanWriter::finish()
+{
+	m_stream.seekp(offsetof(PlanFileHeader, num_frames));
+	m_stream.write(reinterpret_cast<const char*>(&m_num_frames), sizeof(m_num_frames));
+	m_stream.close();
+	return !m_stream.fail();
+}
+
+std::optional<TransmissionPlan> TransmissionPlan::loadFile(const std::filesystem::path& path)
+{
+	TransmissionPlan plan{};
+	if (!plan.m_file.open(path) || plan.m_file.size() < sizeof(PlanFileHeader)) {
+		return std::nullopt;
+	}
+
+	PlanFileHeader header{};
+	std::memcpy(&header, plan.m_file.data(), sizeof(header));
+	const uint64_t frames_size = plan.m_file.size() - sizeof(header);
+	if (std::memcmp(header.magic, PLAN_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+		header.leds_per_frame == 0 || header.leds_per_frame > CORSAIR_DEVICE_LEDCOUNT_MAX ||
+		frames_size / (sizeof(CorsairLedColor) * header.leds_per_frame) < header.num_frames) {
+		return std::nullopt;
+	}
+
+	plan.m_leds_per_frame = header.leds_per_frame;
+	plan.m_num_frames = header.num_frames;
+	plan.m_frames = reinterpret_cast<const CorsairLedColor*>(plan.m_file.data() + sizeof(header));
+	return plan;
+}
+
+FixedUpdateLoopStats playTransmissionPlan(const CorsairDeviceId* device_id, Leds& leds, const TransmissionPlan& plan, int64_t period_microseconds)
+{
+	assert(plan.getLedsPerFrame() == leds.getCount());
+
+	LightingBackend& backend = leds.getBackend();
+	FlushTracker& tracker = leds.getFlushTracker();
+
+	myPrint("Playing plan: {} frames, {:.1f} KiB{}", plan.getNumFrames(),
+		static_cast<double>(plan.getNumFrames() * plan.getLedsPerFrame() * sizeof(CorsairLedColor)) / 1024.0, plan.isMapped() ? " (mapped)" : "");
+
+	tracker.resetTelemetry();
+	const FixedUpdateLoopStats stats = startFixedUpdateLoop(static_cast<int>(plan.getNumFrames()), period_microseconds, [&](int iteration) {
+		tracker.recordTick();
+		tracker.waitForFreeSlot();
+		setColors(device_id, backend, tracker, plan.getFrame(static_cast<uint64_t>(iteration)));
+
+		// fault in the next frame of a mapped plan now rather than on the next tick
+		if (static_cast<uint64_t>(iteration) + 1 < plan.getNumFrames()) {
+			const std::span<const CorsairLedColor> next = plan.getFrame(static_cast<uint64_t>(iteration) + 1);
+			[[maybe_unused]] volatile uint8_t touch = next.front().r;
+			touch = next.back().r;
+		}
+		});
+	tracker.waitForAll();
+	tracker.reportTelemetry();
+
+	leds.invalidate();
+
+	return stats;
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <iCUESDK/iCUESDK.h>
+
+#include "fixed_update_loop.h"
+#include "leds.h"
+#include "mapped_file.h"
+
+// Writes a plan file one frame at a time so a plan never has to fit in memory
+class TransmissionPlanWriter {
+	std::ofstream m_stream{};
+	uint32_t m_leds_per_frame = 0;
+	uint64_t m_num_frames = 0;
+
+public:
+	bool open(const std::filesystem::path& path, uint32_t leds_per_frame);
+
+	void writeFrame(const CorsairLedColor* colors);
+
+	// Fills in the frame count, returns false if anything failed to write
+	bool finish();
+};
+
+// A whole transmission rendered ahead of time into one contiguous array.
+// Frame i is the color of every LED of the device, laid out exactly as CorsairSetLedColorsBuffer() wants it,
+// so playing it back is just handing the SDK a pointer per tick.
+// Plans either live in memory or are memory-mapped from a file written by compileToFile().
+class TransmissionPlan {
+	uint32_t m_leds_per_frame = 0;
+	uint64_t m_num_frames = 0;
+	std::vector<CorsairLedColor> m_storage{}; // empty if mapped
+	MappedFile m_file{};
+	const CorsairLedColor* m_frames = nullptr;
+
+public:
+	// render(i) fills in leds for frame i, like with startFramePipeline()
+	template<typename Func>
+	static TransmissionPlan compile(Leds& leds, int num_frames, Func&& render)
+	{
+		TransmissionPlan plan{};
+		plan.m_leds_per_frame = leds.getCount();
+		plan.m_num_frames = static_cast<uint64_t>(std::max(num_frames, 0));
+		plan.m_storage.resize(plan.m_num_frames * plan.m_leds_per_frame);
+		for (int i = 0; i < num_frames; ++i) {
+			render(i);
+			leds.getColors(plan.m_storage.data() + static_cast<size_t>(i) * plan.m_leds_per_frame);
+		}
+		plan.m_frames = plan.m_storage.data();
+		return plan;
+	}
+
+	// Same as compile() but streams the frames to a file for loadFile(), for transmissions too long to keep in memory
+	template<typename Func>
+	static bool compileToFile(const std::filesystem::path& path, Leds& leds, int num_frames, Func&& render)
+	{
+		TransmissionPlanWriter writer{};
+		if (!writer.open(path, leds.getCount())) {
+			return false;
+		}
+		FrameColors frame{};
+		frame.resize_uninitialized(leds.getCount());
+		for (int i = 0; i < num_frames; ++i) {
+			render(i);
+			leds.getColors(frame.data());
+			writer.writeFrame(frame.data());
+		}
+		return writer.finish();
+	}
+
+	// Memory-maps a plan file, frames are paged in as playback reaches them
+	static std::optional<TransmissionPlan> loadFile(const std::filesystem::path& path);
+
+	uint64_t getNumFrames() const { return m_num_frames; }
+
+	uint32_t getLedsPerFrame() const { return m_leds_per_frame; }
+
+	bool isMapped() const { return m_file.data() != nullptr; }
+
+	std::span<const CorsairLedColor> getFrame(uint64_t frame) const
+	{
+		return { m_frames + frame * m_leds_per_frame, m_leds_per_frame };
+	}
+};
+
+// Submits one frame of the plan per tick. The plan must have been compiled for this device.
+// leds isn't touched apart from being told the device no longer matches it.
+FixedUpdateLoopStats playTransmissionPlan(const CorsairDeviceId* device_id, Leds& leds, const TransmissionPlan& plan, int64_t period_microseconds);
\ No newline at end of file
@@ -1,20 +1,29 @@
 #include "transmit_image.h"
 
+#include <cmath>
+
 #include <algorithm>
 #include <array>
 #include <thread>
 #include <chrono>
 #include <map>
 #include <bit>
-
-#include <conio.h>
+#include <optional>
+#include <span>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
 #include "set_colors.h"
 #include "my_print.h"
-#include "fixed_update_loop.h"
+#include "console.h"
+#include "framing.h"
+#include "image_codec.h"
+#include "interleaver.h"
+#include "palette_quantizer.h"
+#include "pilot.h"
+#include "rs_transport.h"
+#include "transmission_plan.h"
 
 struct Bitmap {
 	std::vector<uint8_t> data;
@@ -45,65 +54,57 @@ static Bitmap readImage(const std::filesystem::path& path)
 	return output;
 }
 
-static auto getOrdered105(const Leds& leds)
+// pixels holds num_keys R8G8B8A8 pixels per frame (padded to whole frames here), pixel i of each frame goes to data key i
+static void transmitPixelFrames(const CorsairDeviceId* device_id, Leds& leds, std::vector<uint8_t> pixels, FrameHeader header, const PilotLayout& pilots,
+	double frequency)
 {
-	// generate LUT to get keys in order
-	std::map<int, std::vector<int>> rows{};
-	for (int i = 0; i < leds.getCount(); ++i) {
-		auto pos = leds.getAllLedPositions()[i];
-		if (pos.cy < 34.3) {
-			// There are 112 LEDs, top 3 shouldn't be added
-			continue;
-		}
-		if (pos.cy > 34.3 && pos.cy <= 38.6) {
-			rows[0].push_back(i);
-		}
-		if (pos.cy > 38.6 && pos.cy <= 59.5) {
-			rows[1].push_back(i);
-		}
-		if (pos.cy > 59.5 && pos.cy <= 78.5) {
-			rows[2].push_back(i);
-		}
-		if (pos.cy > 78.5 && pos.cy <= 97.6) {
-			rows[3].push_back(i);
-		}
-		if (pos.cy > 97.6 && pos.cy <= 116.1) {
-			rows[4].push_back(i);
-		}
-		if (pos.cy > 116.1 && pos.cy <= 135.6) {
-			rows[5].push_back(i);
-		}
-	}
+	const auto ordered = pilots.getDataKeys();
+	const int num_keys = static_cast<int>(ordered.size());
 
-	for (auto& [i, row] : rows) {
-		std::sort(row.begin(), row.end(), [&](int first, int second) ->bool {
-			// returns true if first is less than second
-			double x1 = leds.getAllLedPositions()[first].cx;
-			double x2 = leds.getAllLedPositions()[second].cx;
-			return x1 < x2;
-			});
+	std::vector<int32_t> source_for_led(leds.getCount(), -1);
+	for (int i = 0; i < num_keys; ++i) {
+		source_for_led[ordered[i]] = i;
 	}
 
-	// remove multimedia keys
-	rows[0].pop_back();
-	rows[0].pop_back();
-	rows[0].pop_back();
-	rows[0].pop_back();
+	const int iters = static_cast<int>(ceil(static_cast<double>(pixels.size() / 4) / static_cast<double>(num_keys)));
 
-	std::vector<int> ordered{};
+	// hack to avoid OOB read
+	pixels.resize(iters * num_keys * 4);
 
-	for (const auto& [i, row] : rows) {
-		for (int i : row) {
-			ordered.push_back(i);
-		}
-	}
+	// the lead-in tells the receiver the image size, the pixel frames after it carry no framing of their own
+	const FrameFormat format(static_cast<uint32_t>(num_keys) * 3);
+	header.symbol_rate_centihertz = static_cast<uint16_t>(std::lround(frequency * 100.0));
+	header.num_data_frames = static_cast<uint32_t>(iters);
+	const std::vector<uint8_t> lead_in = format.buildLeadIn(header);
+	const int num_lead_in_frames = static_cast<int>(FrameFormat::NUM_LEAD_IN_FRAMES);
 
-	assert(ordered.size() == 105);
+	const TransmissionPlan plan = TransmissionPlan::compile(leds, num_lead_in_frames + iters, [&](int iteration) {
+		leds.setAll(0, 0, 0);
+		if (iteration < num_lead_in_frames) {
+			showFrameBits(leds, ordered, lead_in.data() + static_cast<size_t>(iteration) * format.getBitsPerFrame());
+			pilots.show(leds, static_cast<uint64_t>(iteration));
+			return;
+		}
+		const size_t pixel_frame = static_cast<size_t>(iteration - num_lead_in_frames);
+		const auto frame_pixels = std::span<const uint8_t>(pixels).subspan(pixel_frame * num_keys * 4, static_cast<size_t>(num_keys) * 4);
+		leds.setFromPixels(frame_pixels, 4, source_for_led);
+		pilots.show(leds, static_cast<uint64_t>(iteration));
+		});
+
+	myPrint("LED count: {}", leds.getCount());
+
+	myPrint("Transmitting {}x{} image for {} seconds", header.width, header.height, static_cast<double>(num_lead_in_frames + iters) / frequency);
 
-	return ordered;
+	waitForKeyPress();
+
+	playTransmissionPlan(device_id, leds, plan, static_cast<int64_t>(1'000'000.0 / frequency));
+
+	leds.setAll(0, 0, 0);
+	setColors(device_id, leds);
+	waitForColors(leds);
 }
 
-void transmitImage(const CorsairDeviceId* device_id, Leds& leds, const std::filesystem::path& path)
+void transmitImage(const CorsairDeviceId* device_id, Leds& leds, const std::filesystem::path& path, uint32_t num_pilots)
 {
 	auto bitmap = readImage(path);
 	if (bitmap.data.empty()) {
@@ -111,46 +112,105 @@ void transmitImage(const CorsairDeviceId* device_id, Leds& leds, const std::file
 		abort();
 	}
 
-	auto ordered = getOrdered105(leds);
-
-	leds.setAll(0, 255, 0);
-	setColors(device_id, leds);
-	waitForColors();
-
-	const double frequency = 5.0;
-	const int iters = static_cast<int>(ceil(static_cast<double>(bitmap.width * bitmap.height) / 105.0));
-
-	// hack to avoid OOB read
-	bitmap.data.resize(iters * 105 * 4);
+	FrameHeader header{};
+	header.payload_type = PayloadType::Image;
+	header.payload_length = bitmap.width * bitmap.height;
+	header.width = static_cast<uint16_t>(bitmap.width);
+	header.height = static_cast<uint16_t>(bitmap.height);
+	header.bits_per_channel = 8;
 
-	myPrint("LED count: {}", leds.getCount());
+	const PilotLayout pilots(leds.getLayout().getDataKeys(), num_pilots);
+	transmitPixelFrames(device_id, leds, std::move(bitmap.data), header, pilots, 5.0);
+}
 
-	myPrint("Transmitting for {} seconds", static_cast<double>(iters) / frequency);
+void transmitImageQuantized(const CorsairDeviceId* device_id, Leds& leds, const std::filesystem::path& path, const PaletteOptions& palette_options,
+	double frequency, uint32_t num_pilots)
+{
+	const auto bitmap = readImage(path);
+	if (bitmap.data.empty()) {
+		myPrint("Failed to open image: {}", path.string());
+		abort();
+	}
 
-	std::this_thread::sleep_for(std::chrono::seconds(1));
+	const auto alphabet = getRgb232Alphabet();
+	const QuantizedImage image = quantizeImage(bitmap.data, bitmap.width, bitmap.height, 4, alphabet, palette_options);
 
-	_getch();
+	const PilotLayout pilots(leds.getLayout().getDataKeys(), num_pilots);
+	const size_t num_keys = pilots.getDataKeys().size();
 
-	startFixedUpdateLoop(iters, static_cast<int64_t>(1'000'000.0 / frequency), [&](int iteration) {
-		leds.setAll(0, 0, 0);
-		for (int i = 0; i < 105; ++i) {
-			uint8_t r = bitmap.data[(iteration * 105 + i) * 4 + 0];
-			uint8_t g = bitmap.data[(iteration * 105 + i) * 4 + 1];
-			uint8_t b = bitmap.data[(iteration * 105 + i) * 4 + 2];
-			leds.setLed(ordered[i], r, g, b);
-		}
-		waitForColors();
-		setColors(device_id, leds);
-		});
+	// palette frame first, then the pixels as palette colors
+	std::vector<uint8_t> pixels{};
+	pixels.reserve((num_keys + image.indices.size()) * 4);
+	for (size_t i = 0; i < num_keys; ++i) {
+		const PaletteColor& color = image.palette[i % image.palette.size()];
+		pixels.insert(pixels.end(), { color.r, color.g, color.b, 255 });
+	}
+	for (const uint8_t index : image.indices) {
+		const PaletteColor& color = image.palette[index];
+		pixels.insert(pixels.end(), { color.r, color.g, color.b, 255 });
+	}
 
-	waitForColors();
+	FrameHeader header{};
+	header.payload_type = PayloadType::PaletteImage;
+	header.payload_length = bitmap.width * bitmap.height;
+	header.width = static_cast<uint16_t>(bitmap.width);
+	header.height = static_cast<uint16_t>(bitmap.height);
+	// the alphabet has 128 colors, so asking for more than 7 bits still gives a palette that only needs 7
+	const uint32_t palette_bits = std::max<uint32_t>(1, static_cast<uint32_t>(std::bit_width(image.palette.size() - 1)));
+	header.bits_per_channel = static_cast<uint8_t>(palette_bits);
+
+	myPrint("{} color palette from the 2-3-2 alphabet, {} bits per key instead of 24", image.palette.size(), palette_bits);
+	transmitPixelFrames(device_id, leds, std::move(pixels), header, pilots, frequency);
+}
 
-	leds.setAll(0, 0, 255);
-	setColors(device_id, leds);
-	waitForColors();
+// branches of the interleaver used for progressive images
+constexpr uint32_t PROGRESSIVE_INTERLEAVER_DEPTH = 4;
 
-	std::this_thread::sleep_for(std::chrono::seconds(1));
+void transmitImageProgressive(const CorsairDeviceId* device_id, Leds& leds, const std::filesystem::path& path, const ImageCodecOptions& codec_options,
+	RsTransportOptions options)
+{
+	const auto bitmap = readImage(path);
+	if (bitmap.data.empty()) {
+		myPrint("Failed to open image: {}", path.string());
+		abort();
+	}
 
+	const std::vector<uint8_t> encoded = encodeProgressiveImage(bitmap.data, bitmap.width, bitmap.height, 4, codec_options);
+
+	// A whole-stream interleaver would hold every scan back until the end. A convolutional one with a few branches, each
+	// delayed by about a codeword more than the last, still spreads a lost frame over PROGRESSIVE_INTERLEAVER_DEPTH
+	// codewords but only holds bytes back by (depth - 1) codewords.
+	// The coded stream doesn't compress any further.
+	options.interleaver.type = InterleaverType::Convolutional;
+	options.interleaver.depth = PROGRESSIVE_INTERLEAVER_DEPTH;
+	options.interleaver.delay = (options.block_length + PROGRESSIVE_INTERLEAVER_DEPTH - 1) / PROGRESSIVE_INTERLEAVER_DEPTH;
+	options.compress = false;
+
+	// when each scan can be decoded: the codewords holding it (after the 4 byte length) have all been sent
+	const PilotLayout pilots(leds.getLayout().getDataKeys(), options.num_pilots);
+	const FrameFormat format(static_cast<uint32_t>(pilots.getDataKeys().size()) * 3);
+	const Interleaver interleaver(InterleaverOptions{ .type = options.interleaver.type, .depth = options.interleaver.depth,
+		.delay = options.interleaver.delay, .symbol_size = 1 });
+	const auto ends = getProgressiveScanEnds(encoded);
+	for (size_t i = 0; i < ends.size(); ++i) {
+		const size_t codeword_bytes = (ends[i] + 4 + options.data_length - 1) / options.data_length * options.block_length;
+		size_t last_byte = 0;
+		for (size_t byte = 0; byte < codeword_bytes; ++byte) {
+			last_byte = std::max(last_byte, interleaver.getPosition(byte, codeword_bytes));
+		}
+		const size_t frames = FrameFormat::NUM_LEAD_IN_FRAMES + ((last_byte + 1) * 8 + format.getPayloadBitsPerFrame() - 1) / format.getPayloadBitsPerFrame();
+		const auto band = PROGRESSIVE_SCAN_BANDS[i];
+		myPrint("Scan {} (coefficients {}-{}): {} bytes, decodable after {:.1f} seconds", i + 1, band[0], band[1], ends[i],
+			static_cast<double>(frames) / options.frequency);
+	}
+	myPrint("{}x{} image coded to {} bytes ({:.2f} bits per pixel, quality {})", bitmap.width, bitmap.height, encoded.size(),
+		static_cast<double>(encoded.size()) * 8.0 / (static_cast<double>(bitmap.width) * bitmap.height), codec_options.quality);
+
+	FrameHeader description{};
+	description.payload_type = PayloadType::CodedImage;
+	description.width = static_cast<uint16_t>(bitmap.width);
+	description.height = static_cast<uint16_t>(bitmap.height);
+	transmitBytes(device_id, leds, encoded, options, description);
 }
 
 struct Color {
@@ -179,7 +239,7 @@ static Color getColor(int i)
 	return c;
 }
 
-void transmitText(const CorsairDeviceId* device_id, Leds& leds, std::vector<char> text)
+void transmitText(const CorsairDeviceId* device_id, Leds& leds, std::vector<char> text, const std::filesystem::path& plan_path)
 {
 
 	// only keep printable chars + newline (\n)
@@ -189,165 +249,12 @@ void transmitText(const CorsairDeviceId* device_id, Leds& leds, std::vector<char
 		return !(std::isprint(c));
 		});
 
-	// generate LUT to get keys in order
-	std::array<std::vector<int>, 6> rows{};
-	for (int i = 0; i < leds.getCount(); ++i) {
-		auto pos = leds.getAllLedPositions()[i];
-		if (pos.cy < 34.3) {
-			// There are 112 LEDs, top 3 shouldn't be added
-			continue;
-		}
-		if (pos.cy > 34.3 && pos.cy <= 38.6) {
-			rows[0].push_back(i);
-			continue;
-		}
-		if (pos.cy > 38.6 && pos.cy <= 59.5) {
-			rows[1].push_back(i);
-			continue;
-		}
-		if (pos.cy > 59.5 && pos.cy <= 78.5) {
-			rows[2].push_back(i);
-			continue;
-		}
-		if (pos.cy > 78.5 && pos.cy <= 97.6) {
-			rows[3].push_back(i);
-			continue;
-		}
-		if (pos.cy > 97.6 && pos.cy <= 116.1) {
-			rows[4].push_back(i);
-			continue;
-		}
-		if (pos.cy > 116.1 && pos.cy <= 135.6) {
-			rows[5].push_back(i);
-			continue;
-		}
-		throw std::runtime_error("Key didn't match?");
-	}
-
-	for (int i = 0; i < rows.size(); ++i) {
-		std::sort(rows[i].begin(), rows[i].end(), [&](int first, int second) ->bool {
-			// returns true if first is less than second
-			double x1 = leds.getAllLedPositions()[first].cx;
-			double x2 = leds.getAllLedPositions()[second].cx;
-			return x1 < x2;
-			});
-	}
-
-	std::array<std::vector<int>, 8> sections{};
-	// top left going right, then bottom left going right
-	// section 0
-	for (int index = 0; index < rows[0].size(); ++index) {
-		if (index < 5) {
-			sections[0].push_back(rows[0][index]);
-			continue;
-		}
-		if (index < 13) {
-			sections[1].push_back(rows[0][index]);
-			continue;
-		}
-		if (index < 16) {
-			sections[2].push_back(rows[0][index]);
-			continue;
-		}
-		sections[3].push_back(rows[0][index]);
-	}
-
-	for (int index = 0; index < rows[1].size(); ++index) {
-		if (index < 6) {
-			sections[0].push_back(rows[1][index]);
-			continue;
-		}
-		if (index < 14) {
-			sections[1].push_back(rows[1][index]);
-			continue;
-		}
-		if (index < 17) {
-			sections[2].push_back(rows[1][index]);
-			continue;
-		}
-		sections[3].push_back(rows[1][index]);
-	}
-
-	for (int index = 0; index < rows[2].size(); ++index) {
-		if (index < 6) {
-			sections[0].push_back(rows[2][index]);
-			continue;
-		}
-		if (index < 13) {
-			sections[1].push_back(rows[2][index]);
-			continue;
-		}
-		if (index < 16) {
-			sections[2].push_back(rows[2][index]);
-			continue;
-		}
-		sections[3].push_back(rows[2][index]);
-	}
-
-	for (int index = 0; index < rows[3].size(); ++index) {
-		if (index < 6) {
-			sections[4].push_back(rows[3][index]);
-			continue;
-		}
-		if (index < 13) {
-			sections[5].push_back(rows[3][index]);
-			continue;
-		}
-		if (index == 13) {
-			// big enter key
-			sections[1].push_back(rows[3][index]);
-			continue;
-		}
-		if (index == 17) {
-			// numpad plus
-			sections[3].push_back(rows[3][index]);
-			continue;
-		}
-		sections[7].push_back(rows[3][index]);
-	}
-
-	for (int index = 0; index < rows[4].size(); ++index) {
-		if (index < 6) {
-			sections[4].push_back(rows[4][index]);
-			continue;
-		}
-		if (index < 13) {
-			sections[5].push_back(rows[4][index]);
-			continue;
-		}
-		if (index < 14) {
-			sections[6].push_back(rows[4][index]);
-			continue;
-		}
-		sections[7].push_back(rows[4][index]);
-	}
-	for (int index = 0; index < rows[5].size(); ++index) {
-		if (index < 4) {
-			sections[4].push_back(rows[5][index]);
-			continue;
-		}
-		if (index < 8) {
-			sections[5].push_back(rows[5][index]);
-			continue;
-		}
-		if (index < 11) {
-			sections[6].push_back(rows[5][index]);
-			continue;
-		}
-		sections[7].push_back(rows[5][index]);
-	}
-
-	assert(sections[0].size() == 17);
-	assert(sections[1].size() == 24);
-	assert(sections[2].size() == 9);
-	assert(sections[3].size() == 12);
-	assert(sections[4].size() == 16);
-	assert(sections[5].size() == 18);
-	assert(sections[6].size() == 4);
-	assert(sections[7].size() == 9);
+	// 8 sections, bit n of every character is shown on section n (section 7 shows parity instead)
+	const auto& sections = leds.getLayout().getSections();
 
 #if 0
 	{
+		const auto ordered = leds.getLayout().getOrderedKeys();
 		int section_index = 0;
 		for (const auto& section : sections) {
 			std::cout << "sections[" << section_index << "] = {\n";
@@ -369,18 +276,14 @@ void transmitText(const CorsairDeviceId* device_id, Leds& leds, std::vector<char
 
 	leds.setAll(0, 255, 0);
 	setColors(device_id, leds);
-	waitForColors();
+	waitForColors(leds);
 
 	const double frequency = 20.0;
 	const int iters = static_cast<int>(std::ceil(static_cast<double>(text.size()) / 3.0));
 
 	text.resize(iters * 3);
 
-	myPrint("Transmitting for {} seconds", static_cast<double>(iters) / frequency);
-
-	std::this_thread::sleep_for(std::chrono::seconds(1));
-
-	startFixedUpdateLoop(iters, static_cast<int64_t>(1'000'000.0 / frequency), [&](int iteration) {
+	const auto render = [&](int iteration) {
 		for (int section = 0; section < 8; ++section) {
 			for (const int i : sections[section]) {
 
@@ -416,15 +319,29 @@ void transmitText(const CorsairDeviceId* device_id, Leds& leds, std::vector<char
 
 			}
 		}
-		waitForColors();
-		setColors(device_id, leds);
-		});
+		};
+
+	std::optional<TransmissionPlan> plan{};
+	if (plan_path.empty()) {
+		plan = TransmissionPlan::compile(leds, iters, render);
+	}
+	else if (TransmissionPlan::compileToFile(plan_path, leds, iters, render)) {
+		plan = TransmissionPlan::loadFile(plan_path);
+	}
+	if (!plan) {
+		myPrint("Failed to write plan: {}", plan_path.string());
+		abort();
+	}
+
+	myPrint("Transmitting for {} seconds", static_cast<double>(iters) / frequency);
+
+	std::this_thread::sleep_for(std::chrono::seconds(1));
 
-	waitForColors();
+	playTransmissionPlan(device_id, leds, *plan, static_cast<int64_t>(1'000'000.0 / frequency));
 
 	leds.setAll(0, 0, 255);
 	setColors(device_id, leds);
-	waitForColors();
+	waitForColors(leds);
 
 	std::this_thread::sleep_for(std::chrono::seconds(1));
 }
\ No newline at end of file
@@ -1,12 +1,33 @@
 #pragma once
 
+#include <cstdint>
+
 #include <filesystem>
 #include <vector>
 
 #include <iCUESDK/iCUESDK.h>
 
+#include "image_codec.h"
 #include "leds.h"
+#include "palette_quantizer.h"
+#include "rs_transport.h"
+
+// num_pilots data keys become pilots (see PilotLayout), giving the receiver a per-frame reference for the pixel levels
+void transmitImage(const CorsairDeviceId* device_id, Leds& leds, const std::filesystem::path& path, uint32_t num_pilots = 0);
+
+// Quantizes the image to a palette from getRgb232Alphabet() (see quantizeImage()) and sends it like transmitImage(), with
+// a frame showing the palette (data key i shows entry i modulo its size) ahead of the pixels. The receiver only has to
+// tell 2^bits_per_symbol well separated colors apart instead of reading 8 bits per channel, so frames can go faster.
+void transmitImageQuantized(const CorsairDeviceId* device_id, Leds& leds, const std::filesystem::path& path, const PaletteOptions& palette_options = {},
+	double frequency = 10.0, uint32_t num_pilots = 0);
 
-void transmitImage(const CorsairDeviceId* device_id, Leds& leds, const std::filesystem::path& path);
+// Sends the image through encodeProgressiveImage() and transmitBytes() with its scans in order, so a receiver has the
+// whole image at low detail after the first scan and refines it with each one after, see decodeProgressiveImage().
+// The interleaver is replaced by a short convolutional one so a lost frame is spread over 4 codewords (the default
+// spreads it over all of them, but only decodes at the end), which makes each scan arrive about 3 codewords later than
+// it would uninterleaved and adds as much padding at the end. Prints when each scan will have arrived.
+void transmitImageProgressive(const CorsairDeviceId* device_id, Leds& leds, const std::filesystem::path& path, const ImageCodecOptions& codec_options = {},
+	RsTransportOptions options = {});
 
-void transmitText(const CorsairDeviceId* device_id, Leds& leds, std::vector<char> text);
\ No newline at end of file
+// With a plan_path the frames are written to that file and memory-mapped from it instead of being kept in memory
+void transmitText(const CorsairDeviceId* device_id, Leds& leds, std::vector<char> text, const std::filesystem::path& plan_path = {});
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include "wait_benchmark.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "flush_tracker.h"
+#include "latency_histogram.h"
+#include "my_print.h"
+#include "set_colors.h"
+
+// CPU time used by the calling thread so far
+static int64_t getThreadCpuTimeNs()
+{
+#ifdef _WIN32
+	FILETIME creation{}, exit{}, kernel{}, user{};
+	GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+	const auto toNs = [](const FILETIME& time) {
+		return ((static_cast<int64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) * 100; // 100 ns units
+		};
+	return toNs(kernel) + toNs(user);
+#else
+	timespec time{};
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+	return static_cast<int64_t>(time.tv_sec) * 1'000'000'000 + time.tv_nsec;
+#endif
+}
+
+static int64_t nowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void flushWaitBenchmark(const CorsairDeviceId* device_id, Leds& leds, int flushes_per_strategy)
+{
+	constexpr std::array<std::pair<FlushWaitStrategy, std::string_view>, 3> STRATEGIES{ {
+		{ FlushWaitStrategy::Spin, "spin" },
+		{ FlushWaitStrategy::Block, "block" },
+		{ FlushWaitStrategy::SpinThenBlock, "spin then block" },
+	} };
+
+	FlushTracker& tracker = leds.getFlushTracker();
+	const FlushWaitStrategy original_strategy = tracker.getWaitStrategy();
+	const std::chrono::nanoseconds original_spin_duration = tracker.getSpinDuration();
+	auto wake_latency = std::make_unique<LatencyHistogram>();
+
+	waitForColors(leds);
+
+	for (const auto& [strategy, name] : STRATEGIES) {
+		tracker.setWaitStrategy(strategy);
+		wake_latency->reset();
+
+		const int64_t cpu_start_ns = getThreadCpuTimeNs();
+		const int64_t wall_start_ns = nowNs();
+		for (int i = 0; i < flushes_per_strategy; ++i) {
+			leds.setAll(0, (i % 2) * 255, 0);
+			setColors(device_id, leds);
+			waitForColors(leds);
+			wake_latency->record(static_cast<uint64_t>(std::max<int64_t>(0, nowNs() - tracker.getLastCompletionTimeNs())));
+		}
+		const int64_t cpu_ns = getThreadCpuTimeNs() - cpu_start_ns;
+		const int64_t wall_ns = nowNs() - wall_start_ns;
+
+		myPrint("{}: wake-up p50 {:.1f} us, p90 {:.1f} us, p99 {:.1f} us, max {:.1f} us", name,
+			wake_latency->percentile(0.5) / 1000.0, wake_latency->percentile(0.9) / 1000.0,
+			wake_latency->percentile(0.99) / 1000.0, wake_latency->max() / 1000.0);
+		myPrint("{}: waiting thread used {:.1f} ms CPU over {:.1f} ms ({:.0f}%)", name,
+			cpu_ns / 1'000'000.0, wall_ns / 1'000'000.0, wall_ns > 0 ? 100.0 * static_cast<double>(cpu_ns) / static_cast<double>(wall_ns) : 0.0);
+	}
+
+	tracker.setWaitStrategy(original_strategy, original_spin_duration);
+}
\ No newline at end of file
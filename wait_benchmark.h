@@ -0,0 +1,9 @@
+#pragma once
+
+#include <iCUESDK/iCUESDK.h>
+
+#include "leds.h"
+
+// Sends flushes one at a time with each FlushWaitStrategy and reports how long the waiting thread took to resume after
+// the completion callback, and how much CPU time it used while waiting
+void flushWaitBenchmark(const CorsairDeviceId* device_id, Leds& leds, int flushes_per_strategy = 200);
\ No newline at end of file